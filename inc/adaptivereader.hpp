@@ -0,0 +1,122 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#ifndef _ADAPTIVEREADER_HPP
+#define _ADAPTIVEREADER_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include "tcpstream.hpp"
+#include "bytebuffer.hpp"
+
+namespace netlib
+{
+
+
+/**
+ * @brief The AdaptiveReader reads from a TcpStream into a buffer whose size
+ * follows the recent read sizes, like a receive buffer size predictor.
+ * 
+ * If a read fills the whole buffer, the next read uses a buffer twice as 
+ * large, so that bursts need fewer syscalls. If two reads in a row use less 
+ * than half of the buffer, it shrinks by half, so that idle connections 
+ * don't hold on to large buffers. In addition, the number of available bytes
+ * is queried after a read that filled the whole buffer, so the rest of a 
+ * burst that is already queued is read in one call. The memory of a buffer 
+ * that became too large is only released after several smaller reads in a 
+ * row, so alternating burst and small reads don't reallocate every time.
+ */
+class AdaptiveReader
+{
+private:
+
+    /**
+     * @brief The stream that is read from.
+     */
+    TcpStream &stream;
+
+    /**
+     * @brief The smallest buffer size.
+     */
+    size_t minSize;
+
+    /**
+     * @brief The largest buffer size.
+     */
+    size_t maxSize;
+
+    /**
+     * @brief The predicted size of the next read.
+     */
+    size_t nextSize;
+
+    /**
+     * @brief True if the previous read used less than half of the buffer.
+     */
+    bool decreaseNow = false;
+
+    /**
+     * @brief True if the previous read filled the whole buffer.
+     */
+    bool lastFilled = false;
+
+    /**
+     * @brief The number of reads in a row that used less than half of the 
+     * allocated buffer.
+     */
+    unsigned oversizedReads = 0;
+
+    /**
+     * @brief The buffer that the data is read into.
+     */
+    ByteBuffer buffer;
+
+    /**
+     * @brief Update the predicted size from the result of the last read.
+     */
+    void record(size_t bufferSize, size_t bytesRead);
+
+public:
+
+    /**
+     * @brief Create an AdaptiveReader for the given stream. The stream must 
+     * outlive the AdaptiveReader.
+     * 
+     * @param stream The connected TcpStream that is read from.
+     * @param minSize The smallest buffer size that is used.
+     * @param initialSize The buffer size of the first read.
+     * @param maxSize The largest buffer size that is used.
+     */
+    AdaptiveReader(TcpStream &stream, size_t minSize = 512, size_t initialSize = 4096, size_t maxSize = 1024 * 1024);
+
+    AdaptiveReader(const AdaptiveReader &other) = delete;
+    AdaptiveReader& operator=(const AdaptiveReader &other) = delete;
+
+    /**
+     * @brief Receive data from the stream with a single read call. The data 
+     * is valid until the next call to read.
+     * 
+     * If receiving fails, an exception is thrown.
+     * 
+     * @param data Set to the received data.
+     * 
+     * @return The number of bytes that were received. 0 if the connection 
+     * was closed, -1 if no data is available in non-blocking mode.
+     */
+    ssize_t read(const uint8_t *&data);
+
+    /**
+     * @brief Get the predicted buffer size of the next read.
+     */
+    size_t getNextSize() const;
+
+};
+
+
+} // namespace netlib
+
+#endif // _ADAPTIVEREADER_HPP
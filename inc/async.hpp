@@ -0,0 +1,1028 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#ifndef _ASYNC_HPP
+#define _ASYNC_HPP
+
+// Coroutines require C++20. In older language modes this header is empty and
+// the async functions of the sockets are declared but not available.
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <stdexcept>
+#include <system_error>
+
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "eventloop.hpp"
+#include "iouring.hpp"
+#include "tcpstream.hpp"
+#include "tcplistener.hpp"
+#include "udpsocket.hpp"
+
+namespace netlib
+{
+
+
+template <typename T = void>
+class Task;
+
+namespace detail
+{
+
+/**
+ * @brief The common part of the promise types of Task.
+ */
+class TaskPromiseBase
+{
+public:
+
+    /**
+     * @brief Resumes the coroutine that is awaiting the finished task.
+     */
+    struct FinalAwaiter
+    {
+        bool await_ready() const noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) const noexcept
+        {
+            return handle.promise().continuation;
+        }
+
+        void await_resume() const noexcept { }
+    };
+
+    /**
+     * @brief The coroutine that is resumed once the task is finished.
+     */
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+
+    /**
+     * @brief The exception that escaped the task, if any.
+     */
+    std::exception_ptr exception;
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+
+    void unhandled_exception() noexcept { exception = std::current_exception(); }
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase
+{
+private:
+    std::optional<T> value;
+
+public:
+    Task<T> get_return_object() noexcept;
+
+    template <typename U>
+    void return_value(U &&result) { value.emplace(std::forward<U>(result)); }
+
+    T result()
+    {
+        if (exception) std::rethrow_exception(exception);
+        return std::move(*value);
+    }
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase
+{
+public:
+    Task<void> get_return_object() noexcept;
+
+    void return_void() const noexcept { }
+
+    void result()
+    {
+        if (exception) std::rethrow_exception(exception);
+    }
+};
+
+/**
+ * @brief A coroutine that starts immediately and destroys itself when it is
+ * finished. Used to run a Task without anyone awaiting it.
+ */
+class DetachedTask
+{
+public:
+    struct promise_type
+    {
+        DetachedTask get_return_object() const noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept { }
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+};
+
+} // namespace detail
+
+/**
+ * @brief A lazily started coroutine that produces a value of type T. The
+ * coroutine starts running when the Task is awaited with co_await, and the
+ * awaiting coroutine is resumed once the Task has finished. Exceptions that
+ * escape the coroutine are rethrown in the awaiting coroutine.
+ *
+ * Tasks that are not awaited by another coroutine can be run with
+ * netlib::spawn or netlib::syncWait.
+ */
+template <typename T>
+class Task
+{
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+private:
+
+    /**
+     * @brief The handle of the coroutine that is owned by this Task.
+     */
+    std::coroutine_handle<promise_type> handle;
+
+    explicit Task(std::coroutine_handle<promise_type> _handle) : handle{_handle} { }
+
+public:
+
+    /**
+     * @brief Destroy the coroutine. A task that is still running must not be
+     * destroyed, unless it is suspended and waiting for I/O.
+     */
+    ~Task()
+    {
+        if (handle) handle.destroy();
+    }
+
+    Task(Task &&other) noexcept : handle{std::exchange(other.handle, nullptr)} { }
+
+    Task& operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (handle) handle.destroy();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    Task(const Task &other) = delete;
+    Task& operator=(const Task &other) = delete;
+
+    /**
+     * @brief Check if the coroutine has finished.
+     */
+    bool isDone() const noexcept { return handle && handle.done(); }
+
+    bool await_ready() const noexcept { return handle.done(); }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    T await_resume() { return handle.promise().result(); }
+
+    friend class detail::TaskPromise<T>;
+
+    template <typename U>
+    friend U syncWait(EventLoop &loop, Task<U> task);
+};
+
+template <typename T>
+Task<T> detail::TaskPromise<T>::get_return_object() noexcept
+{
+    return Task<T>{std::coroutine_handle<TaskPromise<T>>::from_promise(*this)};
+}
+
+inline Task<void> detail::TaskPromise<void>::get_return_object() noexcept
+{
+    return Task<void>{std::coroutine_handle<TaskPromise<void>>::from_promise(*this)};
+}
+
+namespace detail
+{
+
+inline DetachedTask runDetached(Task<void> task)
+{
+    co_await task;
+}
+
+} // namespace detail
+
+/**
+ * @brief Start running a task on the given EventLoop without waiting for it.
+ * The task runs until its first suspension before this returns, and is
+ * resumed by the EventLoop afterwards. The coroutine is destroyed when the
+ * task is finished.
+ *
+ * Exceptions can't be reported to anyone, so if an exception escapes the
+ * task, std::terminate is called. The task must not reference temporaries,
+ * like the captures of a lambda that is called in the same statement.
+ */
+inline void spawn(EventLoop &loop, Task<void> task)
+{
+    EventLoop::CurrentGuard guard(loop);
+    detail::runDetached(std::move(task));
+}
+
+/**
+ * @brief Run the given EventLoop until the task is finished and return its
+ * result. Exceptions that escape the task are rethrown.
+ */
+template <typename T>
+T syncWait(EventLoop &loop, Task<T> task)
+{
+    EventLoop::CurrentGuard guard(loop);
+
+    task.handle.resume();
+    while (!task.handle.done()) loop.runOnce();
+
+    return task.await_resume();
+}
+
+/**
+ * @brief Socket operations for the awaitables. This has access to the 
+ * internals of the socket classes.
+ */
+class AsyncIo
+{
+public:
+
+    /**
+     * @brief Check if the stream uses TLS. TLS streams can't use io_uring, 
+     * since the data has to pass through OpenSSL.
+     */
+    static bool isTls(const TcpStream &stream) noexcept
+    {
+#ifdef NETLIB_SSL
+        return stream.isSocketValid() && stream.socket->ssl != nullptr;
+#else
+        (void)stream;
+        return false;
+#endif
+    }
+
+    /**
+     * @brief Check if an operation on the stream can use io_uring.
+     */
+    static bool canUseRing(const TcpStream &stream) noexcept
+    {
+        return stream.isSocketValid() && !isTls(stream);
+    }
+
+    /**
+     * @brief Read without blocking. This also holds for TLS streams, whose 
+     * socket is switched to non-blocking mode for the SSL_read.
+     */
+    static ssize_t read(TcpStream &stream, void *data, size_t len, std::error_code &ec) noexcept
+    {
+        if (!stream.isSocketValid())
+        {
+            ec = std::make_error_code(std::errc::not_connected);
+            return -1;
+        }
+
+        return finish(stream, stream.socket->readNonBlocking(data, len), ec);
+    }
+
+    /**
+     * @brief Write without blocking. A TLS write that would block must be 
+     * repeated with the same arguments.
+     */
+    static ssize_t write(TcpStream &stream, const void *data, size_t len, std::error_code &ec) noexcept
+    {
+        if (!stream.isSocketValid())
+        {
+            ec = std::make_error_code(std::errc::not_connected);
+            return -1;
+        }
+
+        return finish(stream, stream.socket->writeNonBlocking(data, len), ec);
+    }
+
+    /**
+     * @brief Get the events to wait for before an operation on the stream
+     * that would block is repeated. TLS streams may have to wait for the
+     * other direction, for example during a renegotiation.
+     */
+    static uint32_t retryEvents(const TcpStream &stream, uint32_t events) noexcept
+    {
+        if (!isTls(stream)) return events;
+
+        short pollEvents = stream.socket->retryEvents(events == EventLoop::READABLE ? POLLIN : POLLOUT);
+        return pollEvents == POLLIN ? EventLoop::READABLE : EventLoop::WRITABLE;
+    }
+
+    /**
+     * @brief Convert the result of a stream operation and close the stream on
+     * errors, like the blocking functions do.
+     */
+    static ssize_t finish(TcpStream &stream, ssize_t res, std::error_code &ec) noexcept
+    {
+        if (res >= 0)
+        {
+            ec.clear();
+            return res;
+        }
+
+        ec = std::error_code{errno, std::system_category()};
+        if (!isWouldBlock(ec)) stream.close();
+        return -1;
+    }
+
+    /**
+     * @brief Same as finish, but for the result of an io_uring operation.
+     */
+    static ssize_t finishResult(TcpStream &stream, int32_t res, std::error_code &ec) noexcept
+    {
+        if (res >= 0)
+        {
+            ec.clear();
+            return res;
+        }
+
+        ec = std::error_code{-res, std::system_category()};
+        stream.close();
+        return -1;
+    }
+
+    /**
+     * @brief Record a completed io_uring operation in the I/O statistics.
+     */
+    static void recordResult(TcpStream &stream, IoOp op, std::chrono::steady_clock::time_point start, 
+        int32_t res) noexcept
+    {
+        recordIo(op, stream.socket->ioCounters, start, res < 0 ? -1 : res);
+    }
+
+    /**
+     * @brief Record a completed io_uring operation in the I/O statistics.
+     */
+    static void recordResult(UdpSocket &socket, IoOp op, std::chrono::steady_clock::time_point start, 
+        int32_t res) noexcept
+    {
+        recordIo(op, socket.ioCounters, start, res < 0 ? -1 : res);
+    }
+
+    /**
+     * @brief Receive a UDP packet without blocking. The flags are passed to recvfrom in addition
+     * to MSG_DONTWAIT.
+     */
+    static ssize_t receive(UdpSocket &socket, void *data, size_t len, SockAddr &remote, std::error_code &ec, 
+        int flags = 0) noexcept
+    {
+        SockAddr::RawSockAddr remote_raw_saddr;
+        std::memset(&remote_raw_saddr, 0, sizeof(SockAddr::RawSockAddr));
+        socklen_t remote_raw_socklen = socket.raw_socklen;
+
+        ssize_t bytes_read = measureIo(IoOp::UdpReceive, socket.ioCounters, [&]() {
+            return ::recvfrom(socket.sockfd, data, len, MSG_DONTWAIT | flags, &remote_raw_saddr.generic, &remote_raw_socklen);
+        });
+
+        if (bytes_read < 0)
+        {
+            ec = std::error_code{errno, std::system_category()};
+            return -1;
+        }
+
+        remote = SockAddr(&remote_raw_saddr.generic, socket.local.address.type);
+
+        ec.clear();
+        return bytes_read;
+    }
+
+    /**
+     * @brief Send a UDP packet without blocking.
+     */
+    static ssize_t sendTo(UdpSocket &socket, const SockAddr &remote, const void *data, size_t len, 
+        std::error_code &ec) noexcept
+    {
+        ssize_t bytes_sent = measureIo(IoOp::UdpSend, socket.ioCounters, [&]() {
+            return ::sendto(socket.sockfd, data, len, MSG_DONTWAIT, &remote.raw_sockaddr.generic, socket.raw_socklen);
+        });
+
+        if (bytes_sent < 0)
+        {
+            ec = std::error_code{errno, std::system_category()};
+            return -1;
+        }
+
+        ec.clear();
+        return bytes_sent;
+    }
+
+    /**
+     * @brief Prepare a recvmsg or sendmsg header for a single buffer.
+     */
+    static void prepareMsg(UdpSocket &socket, msghdr &msg, iovec &iov, void *data, size_t len, 
+        const SockAddr::RawSockAddr *addr) noexcept
+    {
+        iov.iov_base = data;
+        iov.iov_len = len;
+
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_name = (void*)addr;
+        msg.msg_namelen = socket.raw_socklen;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+    }
+
+    /**
+     * @brief Create the SockAddr of a received packet.
+     */
+    static SockAddr remoteAddress(const UdpSocket &socket, SockAddr::RawSockAddr &raw) noexcept
+    {
+        return SockAddr(&raw.generic, socket.local.address.type);
+    }
+
+    /**
+     * @brief Get the raw address to send to.
+     */
+    static const SockAddr::RawSockAddr * rawAddress(const SockAddr &addr) noexcept
+    {
+        return &addr.raw_sockaddr;
+    }
+
+    /**
+     * @brief Check if the socket can send to the address.
+     */
+    static bool isSameType(const UdpSocket &socket, const SockAddr &addr) noexcept
+    {
+        return addr.address.type == socket.local.address.type;
+    }
+
+    /**
+     * @brief Create the TcpStream for a socket that was accepted by io_uring.
+     */
+    static TcpStream acceptedStream(TcpListener &listener, int sockfd, SockAddr::RawSockAddr &remote, 
+        std::error_code &ec) noexcept
+    {
+        return listener.acceptedStream(sockfd, remote, ec);
+    }
+
+    /**
+     * @brief Check if the error only means that the operation would block.
+     */
+    static bool isWouldBlock(const std::error_code &ec) noexcept
+    {
+        return ec == std::errc::operation_would_block || ec == std::errc::resource_unavailable_try_again;
+    }
+};
+
+/**
+ * @brief Base of the socket awaitables. The awaitable itself is registered as
+ * the waiter in the EventLoop, so no memory is allocated per operation.
+ * 
+ * If the EventLoop uses io_uring, the operation is queued in the ring and the
+ * coroutine is suspended until it completes. All operations that are queued
+ * during one loop iteration are submitted together. Otherwise, the operation
+ * is first tried without blocking, and only if it would block, the coroutine
+ * is suspended until epoll reports the socket as ready. TLS streams always
+ * use epoll. Their socket is switched to non-blocking mode for each SSL call,
+ * so a slow TLS peer can't block the other coroutines of the loop either.
+ *
+ * Only one operation can be awaited per socket at a time.
+ */
+class IoAwaitable : public EventLoop::Waiter
+{
+private:
+
+    /**
+     * @brief The EventLoop that resumes the coroutine.
+     */
+    EventLoop *loop;
+
+    /**
+     * @brief The suspended coroutine.
+     */
+    std::coroutine_handle<> handle;
+
+    /**
+     * @brief True while the coroutine is suspended.
+     */
+    bool waiting = false;
+
+    /**
+     * @brief True while an io_uring operation is queued or running.
+     */
+    bool inFlight = false;
+
+    /**
+     * @brief The result of the last io_uring operation.
+     */
+    int32_t ringResult = 0;
+
+    /**
+     * @brief Queue the io_uring operation.
+     */
+    void submit()
+    {
+        prepareOperation(loop->prepare(*this));
+        inFlight = true;
+        started = ioStartTime();
+    }
+
+protected:
+
+    /**
+     * @brief The time when the io_uring operation was queued, only set if 
+     * the instrumentation is enabled.
+     */
+    std::chrono::steady_clock::time_point started;
+
+    /**
+     * @brief True if io_uring is used for the operation.
+     */
+    bool ringMode;
+
+    /**
+     * @brief The file descriptor that is waited on.
+     */
+    int fd;
+
+    /**
+     * @brief The events that are waited for, READABLE or WRITABLE.
+     */
+    uint32_t events;
+
+    /**
+     * @brief An exception that occurred while the coroutine was suspended. It
+     * is rethrown when the coroutine is resumed.
+     */
+    std::exception_ptr exception;
+
+    /**
+     * @brief Try to complete the operation without blocking. Only used 
+     * without io_uring.
+     *
+     * @param ready True if the socket was reported as ready by the EventLoop.
+     *
+     * @return True if the operation is done (successful or failed), false if
+     * it would block.
+     */
+    virtual bool attempt(bool ready) = 0;
+
+    /**
+     * @brief Fill the SQE for the io_uring operation. Only used with 
+     * io_uring.
+     */
+    virtual void prepareOperation(io_uring_sqe *sqe) { (void)sqe; }
+
+    /**
+     * @brief Handle the result of the io_uring operation.
+     * 
+     * @return True if the operation is done, false if it has to be queued 
+     * again.
+     */
+    virtual bool completeOperation(int32_t result) { (void)result; return true; }
+
+    /**
+     * @brief Rethrow the exception that occurred while suspended, if any.
+     */
+    void rethrow() const
+    {
+        if (exception) std::rethrow_exception(exception);
+    }
+
+    IoAwaitable(int _fd, uint32_t _events, bool useRing) : loop{EventLoop::current()}, fd{_fd}, events{_events}
+    {
+        if (loop == nullptr)
+            throw std::runtime_error("Async operations must run on an EventLoop");
+
+        ringMode = useRing && loop->getIoUring() != nullptr;
+    }
+
+public:
+
+    ~IoAwaitable() override
+    {
+        // The coroutine was destroyed while waiting
+        if (!waiting) return;
+
+        if (inFlight) loop->cancelOperation(*this);
+        else if (ringMode) loop->unschedule(*this);
+        else loop->cancelWait(fd, *this);
+    }
+
+    IoAwaitable(const IoAwaitable &other) = delete;
+    IoAwaitable& operator=(const IoAwaitable &other) = delete;
+
+    bool await_ready() 
+    {
+        // With io_uring, the operation is always queued to batch the syscalls
+        if (ringMode) return false;
+
+        return attempt(false);
+    }
+
+    void await_suspend(std::coroutine_handle<> _handle)
+    {
+        handle = _handle;
+
+        if (ringMode) submit();
+        else loop->waitOnce(fd, events, *this);
+
+        waiting = true;
+    }
+
+    void notify(uint32_t) override
+    {
+        // The operation is attempted after the dispatch, so that no coroutine
+        // runs while the events are dispatched
+        loop->schedule(*this);
+    }
+
+    void complete(int32_t result, uint32_t) override
+    {
+        inFlight = false;
+        ringResult = result;
+        loop->schedule(*this);
+    }
+
+    void resume() override
+    {
+        try
+        {
+            if (ringMode)
+            {
+                if (!completeOperation(ringResult))
+                {
+                    submit();
+                    return;
+                }
+            }
+            else if (!attempt(true))
+            {
+                loop->waitOnce(fd, events, *this);
+                return;
+            }
+        }
+        catch (...)
+        {
+            exception = std::current_exception();
+        }
+
+        waiting = false;
+        handle.resume();
+    }
+};
+
+/**
+ * @brief Awaitable of TcpStream::asyncRead.
+ */
+class ReadAwaitable : public IoAwaitable
+{
+private:
+    TcpStream &stream;
+    void *data;
+    size_t len;
+    ssize_t result = -1;
+    std::error_code ec;
+
+protected:
+    bool attempt(bool) override
+    {
+        result = AsyncIo::read(stream, data, len, ec);
+        if (!AsyncIo::isWouldBlock(ec)) return true;
+
+        events = AsyncIo::retryEvents(stream, EventLoop::READABLE);
+        return false;
+    }
+
+    void prepareOperation(io_uring_sqe *sqe) override
+    {
+        IoUring::prepRecv(sqe, fd, data, len, 0);
+    }
+
+    bool completeOperation(int32_t res) override
+    {
+        AsyncIo::recordResult(stream, IoOp::TcpRead, started, res);
+        result = AsyncIo::finishResult(stream, res, ec);
+        return true;
+    }
+
+public:
+    ReadAwaitable(TcpStream &_stream, void *_data, size_t _len)
+        : IoAwaitable{_stream.getSocketFd(), EventLoop::READABLE, AsyncIo::canUseRing(_stream)}, 
+          stream{_stream}, data{_data}, len{_len}
+    { }
+
+    ssize_t await_resume()
+    {
+        rethrow();
+        if (ec) throw std::system_error(ec, "Error while reading from socket");
+        return result;
+    }
+};
+
+/**
+ * @brief Awaitable of TcpStream::asyncSendAll.
+ */
+class SendAllAwaitable : public IoAwaitable
+{
+private:
+    TcpStream &stream;
+    const uint8_t *data;
+    size_t len;
+    size_t sent = 0;
+    std::error_code ec;
+
+protected:
+    bool attempt(bool) override
+    {
+        while (sent < len)
+        {
+            ssize_t res = AsyncIo::write(stream, data + sent, len - sent, ec);
+            if (res < 0)
+            {
+                if (!AsyncIo::isWouldBlock(ec)) return true;
+
+                events = AsyncIo::retryEvents(stream, EventLoop::WRITABLE);
+                return false;
+            }
+            sent += res;
+        }
+        return true;
+    }
+
+    void prepareOperation(io_uring_sqe *sqe) override
+    {
+        IoUring::prepSend(sqe, fd, data + sent, len - sent, MSG_NOSIGNAL);
+    }
+
+    bool completeOperation(int32_t res) override
+    {
+        AsyncIo::recordResult(stream, IoOp::TcpWrite, started, res);
+        if (AsyncIo::finishResult(stream, res, ec) < 0) return true;
+
+        // Partial sends are continued with the remaining data
+        sent += res;
+        return sent >= len;
+    }
+
+public:
+    SendAllAwaitable(TcpStream &_stream, const void *_data, size_t _len)
+        : IoAwaitable{_stream.getSocketFd(), EventLoop::WRITABLE, AsyncIo::canUseRing(_stream) && _len > 0}, 
+          stream{_stream}, data{(const uint8_t*)_data}, len{_len}
+    { }
+
+    void await_resume()
+    {
+        rethrow();
+        if (sent < len) throw std::system_error(ec, "Error while writing to socket");
+    }
+};
+
+/**
+ * @brief Awaitable of TcpStream::asyncConnect. The connect is started when
+ * the awaitable is awaited. This always waits with epoll, since the socket is
+ * only created by the connect.
+ */
+class ConnectAwaitable : public IoAwaitable
+{
+private:
+    TcpStream &stream;
+
+protected:
+    bool attempt(bool ready) override
+    {
+        if (!ready)
+        {
+            bool done = stream.startConnect();
+            fd = stream.getSocketFd();
+            return done;
+        }
+        return stream.finishConnect();
+    }
+
+public:
+    ConnectAwaitable(TcpStream &_stream)
+        : IoAwaitable{0, EventLoop::WRITABLE, false}, stream{_stream}
+    { }
+
+    void await_resume() { rethrow(); }
+};
+
+/**
+ * @brief Awaitable of TcpListener::asyncAccept.
+ */
+class AcceptAwaitable : public IoAwaitable
+{
+private:
+    TcpListener &listener;
+    TcpStream stream;
+    SockAddr::RawSockAddr remote;
+    socklen_t remoteLen = sizeof(SockAddr::RawSockAddr);
+    std::error_code ec;
+
+protected:
+    bool attempt(bool ready) override
+    {
+        // Accepting on a blocking listener blocks, so the readiness has to
+        // be known first
+        if (!ready && !listener.isNonBlocking()) return false;
+
+        stream = listener.accept(ec);
+        return !AsyncIo::isWouldBlock(ec);
+    }
+
+    void prepareOperation(io_uring_sqe *sqe) override
+    {
+        std::memset(&remote, 0, sizeof(remote));
+        remoteLen = sizeof(remote);
+        IoUring::prepAccept(sqe, fd, &remote.generic, &remoteLen, listener.isNonBlocking() ? SOCK_NONBLOCK : 0);
+    }
+
+    bool completeOperation(int32_t res) override
+    {
+        if (res < 0)
+        {
+            ec = std::error_code{-res, std::system_category()};
+            return true;
+        }
+
+        stream = AsyncIo::acceptedStream(listener, res, remote, ec);
+        return true;
+    }
+
+public:
+    AcceptAwaitable(TcpListener &_listener)
+        : IoAwaitable{_listener.getSocketFd(), EventLoop::READABLE, _listener.getSocketFd() > 0}, listener{_listener}
+    { }
+
+    TcpStream await_resume()
+    {
+        rethrow();
+        if (ec) throw std::system_error(ec, "Error while accepting connection");
+        return std::move(stream);
+    }
+};
+
+/**
+ * @brief Awaitable of UdpSocket::asyncReceive.
+ */
+class ReceiveAwaitable : public IoAwaitable
+{
+private:
+    UdpSocket &socket;
+    void *data;
+    size_t len;
+    SockAddr *remote;
+    SockAddr ignoredRemote;
+    SockAddr::RawSockAddr rawRemote;
+    msghdr msg;
+    iovec iov;
+    ssize_t result = -1;
+    std::error_code ec;
+
+protected:
+    bool attempt(bool) override
+    {
+        result = AsyncIo::receive(socket, data, len, *remote, ec);
+        return !AsyncIo::isWouldBlock(ec);
+    }
+
+    void prepareOperation(io_uring_sqe *sqe) override
+    {
+        std::memset(&rawRemote, 0, sizeof(rawRemote));
+        AsyncIo::prepareMsg(socket, msg, iov, data, len, &rawRemote);
+        IoUring::prepRecvmsg(sqe, fd, &msg, 0);
+    }
+
+    bool completeOperation(int32_t res) override
+    {
+        AsyncIo::recordResult(socket, IoOp::UdpReceive, started, res);
+        if (res < 0)
+        {
+            ec = std::error_code{-res, std::system_category()};
+            return true;
+        }
+
+        result = res;
+        *remote = AsyncIo::remoteAddress(socket, rawRemote);
+        return true;
+    }
+
+public:
+    ReceiveAwaitable(UdpSocket &_socket, void *_data, size_t _len, SockAddr *_remote)
+        : IoAwaitable{_socket.getSocketFd(), EventLoop::READABLE, _socket.getSocketFd() > 0}, socket{_socket},
+          data{_data}, len{_len}, remote{_remote != nullptr ? _remote : &ignoredRemote}
+    { }
+
+    ssize_t await_resume()
+    {
+        rethrow();
+        if (ec) throw std::system_error(ec, "Error while receiving from socket");
+        return result;
+    }
+};
+
+/**
+ * @brief Awaitable of UdpSocket::asyncSendTo.
+ */
+class SendToAwaitable : public IoAwaitable
+{
+private:
+    UdpSocket &socket;
+    SockAddr remote;
+    const void *data;
+    size_t len;
+    msghdr msg;
+    iovec iov;
+    ssize_t result = -1;
+    std::error_code ec;
+
+protected:
+    bool attempt(bool) override
+    {
+        result = AsyncIo::sendTo(socket, remote, data, len, ec);
+        return !AsyncIo::isWouldBlock(ec);
+    }
+
+    void prepareOperation(io_uring_sqe *sqe) override
+    {
+        AsyncIo::prepareMsg(socket, msg, iov, (void*)data, len, AsyncIo::rawAddress(remote));
+        IoUring::prepSendmsg(sqe, fd, &msg, 0);
+    }
+
+    bool completeOperation(int32_t res) override
+    {
+        AsyncIo::recordResult(socket, IoOp::UdpSend, started, res);
+        if (res < 0) ec = std::error_code{-res, std::system_category()};
+        else result = res;
+        return true;
+    }
+
+public:
+    SendToAwaitable(UdpSocket &_socket, const SockAddr &_remote, const void *_data, size_t _len)
+        : IoAwaitable{_socket.getSocketFd(), EventLoop::WRITABLE, _socket.getSocketFd() > 0}, socket{_socket},
+          remote{_remote}, data{_data}, len{_len}
+    { 
+        // Can only send to remote addresses with the same ip type
+        if (!AsyncIo::isSameType(socket, remote))
+            throw std::system_error(std::make_error_code(std::errc::address_family_not_supported), 
+                "Error while writing to socket");
+    }
+
+    ssize_t await_resume()
+    {
+        rethrow();
+        if (ec) throw std::system_error(ec, "Error while writing to socket");
+        return result;
+    }
+};
+
+inline ReadAwaitable TcpStream::asyncRead(void *data, size_t len)
+{
+    return ReadAwaitable{*this, data, len};
+}
+
+inline SendAllAwaitable TcpStream::asyncSendAll(const void *data, size_t len)
+{
+    return SendAllAwaitable{*this, data, len};
+}
+
+inline ConnectAwaitable TcpStream::asyncConnect()
+{
+    return ConnectAwaitable{*this};
+}
+
+inline AcceptAwaitable TcpListener::asyncAccept()
+{
+    return AcceptAwaitable{*this};
+}
+
+inline ReceiveAwaitable UdpSocket::asyncReceive(void *data, size_t len, SockAddr &remote)
+{
+    return ReceiveAwaitable{*this, data, len, &remote};
+}
+
+inline ReceiveAwaitable UdpSocket::asyncReceive(void *data, size_t len)
+{
+    return ReceiveAwaitable{*this, data, len, nullptr};
+}
+
+inline SendToAwaitable UdpSocket::asyncSendTo(const SockAddr &remote, const void *data, size_t len)
+{
+    return SendToAwaitable{*this, remote, data, len};
+}
+
+
+} // namespace netlib
+
+#endif // __cpp_impl_coroutine
+
+#endif // _ASYNC_HPP
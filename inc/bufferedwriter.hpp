@@ -0,0 +1,141 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#ifndef _BUFFEREDWRITER_HPP
+#define _BUFFEREDWRITER_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "tcpstream.hpp"
+
+namespace netlib
+{
+
+
+/**
+ * @brief The BufferedWriter collects many small writes to a TcpStream in a
+ * local buffer and sends them with as few write calls as possible.
+ *
+ * The buffered data is sent when the buffer is full, when flush() is called
+ * or when the BufferedWriter is destroyed (the end of a batch). Writes that
+ * are larger than the buffer are sent directly without copying them.
+ *
+ * If corking is enabled, TCP_CORK is set on the socket for the duration of a
+ * batch, so that the kernel only emits full segments even if the buffer has
+ * to be sent in multiple parts. The cork is removed by flush().
+ */
+class BufferedWriter
+{
+private:
+
+    /**
+     * @brief The stream that the buffered data is written to.
+     */
+    TcpStream &stream;
+
+    /**
+     * @brief The buffered data that has not been sent yet. The capacity of
+     * this vector is reserved once and never exceeded.
+     */
+    std::vector<uint8_t> buffer;
+
+    /**
+     * @brief The maximum number of bytes that are buffered before sending.
+     */
+    size_t capacity;
+
+    /**
+     * @brief If set to true, TCP_CORK is used to batch the sent data into
+     * full segments.
+     */
+    bool cork;
+
+    /**
+     * @brief True if TCP_CORK is currently set on the socket.
+     */
+    bool corked = false;
+
+    /**
+     * @brief Set or remove TCP_CORK on the underlying socket.
+     */
+    void setCorked(bool corked);
+
+    /**
+     * @brief Send all buffered data without removing the cork.
+     */
+    void sendBuffer();
+
+public:
+
+    /**
+     * @brief Create a BufferedWriter that writes into the given stream. The
+     * stream must outlive the BufferedWriter.
+     *
+     * @param stream The connected TcpStream that the data is written to.
+     * @param capacity The number of bytes that are buffered before the data
+     * is sent automatically.
+     * @param cork Enable or disable the use of TCP_CORK while data is
+     * buffered.
+     */
+    BufferedWriter(TcpStream &stream, size_t capacity = 16 * 1024, bool cork = false);
+
+    /**
+     * @brief Flush the remaining buffered data. Errors during this last
+     * flush are ignored, call flush() explicitly to handle them.
+     */
+    ~BufferedWriter();
+
+    BufferedWriter(const BufferedWriter &other) = delete;
+    BufferedWriter& operator=(const BufferedWriter &other) = delete;
+
+    /**
+     * @brief Append len bytes of data to the buffer. If the buffer can't hold
+     * the data, the buffer is sent first. Data that is larger than the buffer
+     * capacity is sent directly.
+     *
+     * If sending fails, an exception is thrown.
+     *
+     * @param data Pointer to at least len bytes that will be written.
+     * @param len The number of bytes that will be written.
+     */
+    void write(const void *data, size_t len);
+
+    /**
+     * @brief Append all chars of the given string to the buffer.
+     *
+     * @see BufferedWriter::write
+     *
+     * @param str The string that will be written.
+     */
+    void writeString(const std::string &str);
+
+    /**
+     * @brief Send all buffered data and remove the cork if corking is
+     * enabled. This marks the end of a batch.
+     *
+     * If sending fails, an exception is thrown.
+     */
+    void flush();
+
+    /**
+     * @brief Get the number of bytes that are currently buffered.
+     */
+    size_t getBuffered() const;
+
+    /**
+     * @brief Get the maximum number of bytes that are buffered before
+     * sending.
+     */
+    size_t getCapacity() const;
+
+};
+
+
+} // namespace netlib
+
+#endif // _BUFFEREDWRITER_HPP
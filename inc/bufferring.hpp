@@ -0,0 +1,149 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#ifndef _BUFFERRING_HPP
+#define _BUFFERRING_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include <linux/io_uring.h>
+
+#include "bytebuffer.hpp"
+#include "iouring.hpp"
+
+namespace netlib
+{
+
+
+/**
+ * @brief A fixed set of equally sized receive buffers that are provided to the
+ * kernel through an io_uring buffer ring. Receive operations with buffer
+ * selection take a buffer from the ring only when data arrives, so no buffer
+ * has to be reserved for a socket that is idle. Once the data was processed,
+ * the buffer is given back with BufferRing::recycle.
+ *
+ * Without an IoUring, the BufferRing only keeps a list of the free buffers,
+ * which are taken with BufferRing::take.
+ */
+class BufferRing
+{
+private:
+
+    /**
+     * @brief The ring that the buffers are registered in, or nullptr.
+     */
+    IoUring *ring;
+
+    /**
+     * @brief The buffer group id that selects this ring in operations.
+     */
+    uint16_t groupId = 0;
+
+    /**
+     * @brief The number of buffers, a power of 2.
+     */
+    unsigned entries;
+
+    /**
+     * @brief The size of each buffer.
+     */
+    size_t bufferSize;
+
+    /**
+     * @brief The shared ring of buffer descriptors.
+     */
+    io_uring_buf_ring *bufRing = nullptr;
+
+    /**
+     * @brief The size of the mapped buffer descriptor ring.
+     */
+    size_t bufRingSize = 0;
+
+    /**
+     * @brief The local tail of the buffer descriptor ring.
+     */
+    uint16_t tail = 0;
+
+    /**
+     * @brief The memory of all buffers.
+     */
+    ByteBuffer storage;
+
+    /**
+     * @brief The ids of the free buffers, only used without an IoUring.
+     */
+    std::vector<uint16_t> freeIds;
+
+public:
+
+    /**
+     * @brief Create the buffers and register them in the ring.
+     *
+     * If the entries are not a power of 2, or the buffer ring can't be
+     * registered, an exception is thrown.
+     *
+     * @param ring The IoUring that uses the buffers, or nullptr to only
+     * manage the buffers locally.
+     * @param entries The number of buffers, a power of 2 up to 32768.
+     * @param bufferSize The size of each buffer.
+     */
+    BufferRing(IoUring *ring, unsigned entries = 64, size_t bufferSize = 16 * 1024);
+
+    /**
+     * @brief Unregister the buffer ring. No operation must use the buffers
+     * anymore.
+     */
+    ~BufferRing();
+
+    BufferRing(const BufferRing &other) = delete;
+    BufferRing& operator=(const BufferRing &other) = delete;
+
+    /**
+     * @brief Check if the buffers are registered in an IoUring.
+     */
+    bool isRegistered() const;
+
+    /**
+     * @brief Get the buffer group id for IOSQE_BUFFER_SELECT.
+     */
+    uint16_t getGroupId() const;
+
+    /**
+     * @brief Get the number of buffers.
+     */
+    unsigned getEntries() const;
+
+    /**
+     * @brief Get the size of each buffer.
+     */
+    size_t getBufferSize() const;
+
+    /**
+     * @brief Get the memory of the buffer with the given id.
+     */
+    uint8_t * getBuffer(uint16_t id);
+
+    /**
+     * @brief Give a buffer back, so that it can receive data again.
+     */
+    void recycle(uint16_t id);
+
+    /**
+     * @brief Take a free buffer. This is only used without an IoUring,
+     * otherwise the kernel selects the buffers.
+     *
+     * @return True if a buffer was free, false otherwise.
+     */
+    bool take(uint16_t &id);
+
+};
+
+
+} // namespace netlib
+
+#endif // _BUFFERRING_HPP
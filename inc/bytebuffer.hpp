@@ -0,0 +1,63 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#ifndef _BYTEBUFFER_HPP
+#define _BYTEBUFFER_HPP
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace netlib
+{
+
+
+/**
+ * @brief An allocator that default-initializes instead of value-initializes 
+ * elements that are constructed without a value. 
+ * 
+ * For trivial types like uint8_t this means that std::vector::resize does 
+ * not zero the new elements. This is useful for receive buffers, since the 
+ * new space is overwritten by the received data anyways.
+ */
+template <typename T, typename A = std::allocator<T>>
+class DefaultInitAllocator : public A
+{
+private:
+    using Traits = std::allocator_traits<A>;
+
+public:
+    template <typename U>
+    struct rebind
+    {
+        using other = DefaultInitAllocator<U, typename Traits::template rebind_alloc<U>>;
+    };
+
+    using A::A;
+
+    template <typename U>
+    void construct(U *ptr) noexcept(std::is_nothrow_default_constructible<U>::value)
+    {
+        ::new(static_cast<void*>(ptr)) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U *ptr, Args&&... args)
+    {
+        Traits::construct(static_cast<A&>(*this), ptr, std::forward<Args>(args)...);
+    }
+};
+
+/**
+ * @brief A growable byte buffer that does not zero newly added space on 
+ * resize.
+ */
+using ByteBuffer = std::vector<uint8_t, DefaultInitAllocator<uint8_t>>;
+
+
+} // namespace netlib
+
+#endif // _BYTEBUFFER_HPP
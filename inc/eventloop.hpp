@@ -0,0 +1,505 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#ifndef _EVENTLOOP_HPP
+#define _EVENTLOOP_HPP
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <memory>
+#include <vector>
+#include <queue>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include <sys/epoll.h>
+#include <linux/io_uring.h>
+
+#include "tcpstream.hpp"
+#include "tcplistener.hpp"
+#include "udpsocket.hpp"
+
+namespace netlib
+{
+
+class IoUring;
+
+
+/**
+ * @brief The EventLoop waits on many sockets at once with epoll and calls a 
+ * callback for every socket that becomes readable or writable. It also runs 
+ * timers and functions that are posted from other threads.
+ * 
+ * The sockets are used in level-triggered mode by default, so a callback is 
+ * called again as long as the socket stays ready. Registered sockets should
+ * be in non-blocking mode, so that a callback never blocks the loop.
+ * 
+ * If io_uring is available, the EventLoop also owns an IoUring that runs the
+ * async socket operations of coroutines. The epoll instance is then watched
+ * through the ring, so one io_uring_enter call submits all queued operations
+ * and waits for completions and socket events at the same time. If io_uring
+ * is not available, the async operations use epoll readiness instead.
+ * 
+ * Except for EventLoop::post and EventLoop::stop, the EventLoop must only be
+ * used from the thread that runs it. Callbacks may add and remove sockets 
+ * and timers, including their own.
+ */
+class EventLoop
+{
+public:
+
+    /**
+     * @brief The socket can be read from, or a listener can accept.
+     */
+    static constexpr uint32_t READABLE = 1;
+
+    /**
+     * @brief The socket can be written to.
+     */
+    static constexpr uint32_t WRITABLE = 2;
+
+    /**
+     * @brief An error occurred or the peer closed the connection. This is 
+     * always reported, even if it was not requested.
+     */
+    static constexpr uint32_t CLOSED = 4;
+
+    /**
+     * @brief Only report readiness changes (edge-triggered), instead of 
+     * reporting the socket as long as it is ready.
+     */
+    static constexpr uint32_t EDGE_TRIGGERED = 8;
+
+    /**
+     * @brief The callback for socket events. It receives the events that 
+     * occurred, a combination of READABLE, WRITABLE and CLOSED.
+     */
+    using IoCallback = std::function<void(uint32_t events)>;
+
+    /**
+     * @brief The callback for timers and posted functions.
+     */
+    using Callback = std::function<void()>;
+
+    /**
+     * @brief Identifies a timer for cancelation. 0 is never used.
+     */
+    using TimerId = uint64_t;
+
+    /**
+     * @brief Receiver of socket events. A pointer to the waiter is stored in 
+     * the epoll event data, so no lookup or allocation is needed on dispatch.
+     * 
+     * Waiters that are passed to EventLoop::waitOnce are owned by the caller,
+     * for example an awaitable inside a coroutine frame.
+     */
+    class Waiter
+    {
+    public:
+        virtual ~Waiter() = default;
+
+        /**
+         * @brief Called from the dispatch with the events that occurred.
+         */
+        virtual void notify(uint32_t events) = 0;
+
+        /**
+         * @brief Called with the result of an io_uring operation that was 
+         * prepared with EventLoop::prepare.
+         * 
+         * @param result The result of the operation, or a negative errno.
+         * @param flags The flags of the completion (IORING_CQE_F_*).
+         */
+        virtual void complete(int32_t result, uint32_t flags) { (void)result; (void)flags; }
+
+        /**
+         * @brief Called after the dispatch, if the waiter was scheduled with
+         * EventLoop::schedule.
+         */
+        virtual void resume() { }
+    };
+
+    /**
+     * @brief Makes the given EventLoop the current loop of the calling thread
+     * for the lifetime of this object.
+     */
+    class CurrentGuard
+    {
+    private:
+        EventLoop *previous;
+
+    public:
+        CurrentGuard(EventLoop &loop);
+        ~CurrentGuard();
+
+        CurrentGuard(const CurrentGuard &other) = delete;
+        CurrentGuard& operator=(const CurrentGuard &other) = delete;
+    };
+
+private:
+
+    /**
+     * @brief The maximum number of events that are dispatched per epoll_wait.
+     */
+    static constexpr int MAX_EVENTS = 256;
+
+    /**
+     * @brief A file descriptor that was registered with a callback.
+     */
+    struct Handler : public Waiter
+    {
+        int fd;
+        IoCallback callback;
+
+        Handler(int fd, IoCallback callback);
+
+        void notify(uint32_t events) override;
+    };
+
+    /**
+     * @brief A scheduled timer.
+     */
+    struct Timer
+    {
+        std::chrono::steady_clock::time_point deadline;
+        std::chrono::milliseconds interval;
+        Callback callback;
+    };
+
+    /**
+     * @brief The epoll file descriptor.
+     */
+    int epollfd = -1;
+
+    /**
+     * @brief The eventfd that wakes the loop for posted functions.
+     */
+    int wakefd = -1;
+
+    /**
+     * @brief The registered file descriptors.
+     */
+    std::unordered_map<int, std::unique_ptr<Handler>> handlers;
+
+    /**
+     * @brief Handlers that were removed during the current dispatch. They are
+     * destroyed after the dispatch, since later events of the same batch can
+     * still point to them.
+     */
+    std::vector<std::unique_ptr<Handler>> removed;
+
+    /**
+     * @brief The active timers by id.
+     */
+    std::unordered_map<TimerId, Timer> timers;
+
+    /**
+     * @brief The timer deadlines, earliest first. Entries of canceled or 
+     * rescheduled timers are skipped lazily.
+     */
+    std::priority_queue<std::pair<std::chrono::steady_clock::time_point, TimerId>, 
+        std::vector<std::pair<std::chrono::steady_clock::time_point, TimerId>>, 
+        std::greater<std::pair<std::chrono::steady_clock::time_point, TimerId>>> timerQueue;
+
+    /**
+     * @brief The id of the next timer.
+     */
+    TimerId nextTimerId = 1;
+
+    /**
+     * @brief Protects posted.
+     */
+    std::mutex postMutex;
+
+    /**
+     * @brief Functions posted from other threads.
+     */
+    std::vector<Callback> posted;
+
+    /**
+     * @brief Set to true to make EventLoop::run return.
+     */
+    std::atomic<bool> stopped{false};
+
+    /**
+     * @brief The events of the current dispatch.
+     */
+    epoll_event batch[MAX_EVENTS];
+
+    /**
+     * @brief The number of events in batch.
+     */
+    int batchCount = 0;
+
+    /**
+     * @brief The waiters that are resumed after the current dispatch. Entries
+     * of canceled waiters are set to nullptr.
+     */
+    std::vector<Waiter*> scheduled;
+
+    /**
+     * @brief The io_uring, or nullptr if only epoll is used.
+     */
+    std::unique_ptr<IoUring> ring;
+
+    /**
+     * @brief True while a poll on the epoll file descriptor is queued in the
+     * ring.
+     */
+    bool epollArmed = false;
+
+    /**
+     * @brief True if the poll on the epoll file descriptor has completed, 
+     * but the events were not yet dispatched.
+     */
+    bool epollReady = false;
+
+    /**
+     * @brief Wait for epoll events and dispatch them.
+     * 
+     * @return The number of waiters that were notified.
+     */
+    size_t dispatchEpoll(int timeoutMs);
+
+    /**
+     * @brief Submit the queued io_uring operations, wait for completions and
+     * dispatch them. Socket events are dispatched if the epoll file 
+     * descriptor became readable.
+     * 
+     * @return The number of waiters that were notified.
+     */
+    size_t dispatchIoUring(int timeoutMs);
+
+    /**
+     * @brief Pass all available completions to their waiters. The completion
+     * of the ignored waiter is only reported through ignoredDone.
+     * 
+     * @return The number of waiters that were notified.
+     */
+    size_t reapCompletions(Waiter *ignored, bool &ignoredDone);
+
+    /**
+     * @brief Translate EventLoop flags to epoll events.
+     */
+    static uint32_t toEpoll(uint32_t events);
+
+    /**
+     * @brief Run all timers that are due.
+     * 
+     * @return The number of timers that were run.
+     */
+    size_t runTimers();
+
+    /**
+     * @brief Run all posted functions.
+     * 
+     * @return The number of functions that were run.
+     */
+    size_t runPosted();
+
+    /**
+     * @brief Get the epoll timeout until the next timer is due, limited to 
+     * timeoutMs.
+     */
+    int nextTimeout(int timeoutMs);
+
+public:
+
+    /**
+     * @brief Create an EventLoop. If the epoll or eventfd file descriptors 
+     * can't be created, an exception is thrown.
+     * 
+     * @param useIoUring If true, an io_uring is used for the async socket 
+     * operations if the kernel supports it. If it is not supported, the 
+     * EventLoop silently falls back to epoll.
+     */
+    EventLoop(bool useIoUring = true);
+
+    ~EventLoop();
+
+    EventLoop(const EventLoop &other) = delete;
+    EventLoop& operator=(const EventLoop &other) = delete;
+
+    /**
+     * @brief Register a file descriptor. The callback is called from the loop
+     * whenever one of the events occurs.
+     * 
+     * If the file descriptor is already registered or can't be added, an 
+     * exception is thrown.
+     * 
+     * @param fd The file descriptor. It is not owned by the EventLoop and 
+     * must be removed before it is closed.
+     * @param events The events of interest, a combination of READABLE, 
+     * WRITABLE and EDGE_TRIGGERED.
+     * @param callback The function that is called with the events that 
+     * occurred.
+     */
+    void add(int fd, uint32_t events, IoCallback callback);
+
+    /**
+     * @brief Register a connected TcpStream. 
+     * @see EventLoop::add(int, uint32_t, IoCallback)
+     */
+    void add(const TcpStream &stream, uint32_t events, IoCallback callback);
+
+    /**
+     * @brief Register a listening TcpListener. It is READABLE when a 
+     * connection can be accepted.
+     * @see EventLoop::add(int, uint32_t, IoCallback)
+     */
+    void add(const TcpListener &listener, uint32_t events, IoCallback callback);
+
+    /**
+     * @brief Register a bound UdpSocket.
+     * @see EventLoop::add(int, uint32_t, IoCallback)
+     */
+    void add(const UdpSocket &socket, uint32_t events, IoCallback callback);
+
+    /**
+     * @brief Change the events of interest of a registered file descriptor, 
+     * for example to wait for WRITABLE only while data is queued.
+     * 
+     * If the file descriptor is not registered, an exception is thrown.
+     */
+    void modify(int fd, uint32_t events);
+
+    /**
+     * @brief Unregister a file descriptor. Nothing happens if it is not 
+     * registered.
+     */
+    void remove(int fd);
+
+    /**
+     * @brief Wait once for events on a file descriptor, without allocating. 
+     * After the waiter is notified, the file descriptor is disabled until the
+     * next call to waitOnce. The file descriptor must not be registered with 
+     * EventLoop::add, and only one waiter can wait on it at a time.
+     * 
+     * If the file descriptor can't be added, an exception is thrown.
+     * 
+     * @param fd The file descriptor. It is not owned by the EventLoop.
+     * @param events The events of interest, a combination of READABLE and 
+     * WRITABLE.
+     * @param waiter The waiter that is notified. It must stay valid until it 
+     * was notified or EventLoop::cancelWait was called.
+     */
+    void waitOnce(int fd, uint32_t events, Waiter &waiter);
+
+    /**
+     * @brief Stop waiting on a file descriptor. The waiter is not notified or
+     * resumed afterwards, even if its events are already pending.
+     */
+    void cancelWait(int fd, Waiter &waiter);
+
+    /**
+     * @brief Resume the waiter after the current dispatch. This must only be 
+     * called from Waiter::notify.
+     */
+    void schedule(Waiter &waiter);
+
+    /**
+     * @brief Remove the waiter from the waiters that are resumed after the 
+     * current dispatch.
+     */
+    void unschedule(Waiter &waiter);
+
+    /**
+     * @brief Get the io_uring of this EventLoop.
+     * 
+     * @return The IoUring, or nullptr if io_uring is not used.
+     */
+    IoUring * getIoUring();
+
+    /**
+     * @brief Get a submission queue entry for an io_uring operation of the 
+     * waiter. The entry is submitted with the next iteration of the loop, 
+     * together with all other queued operations. Once the operation has 
+     * completed, Waiter::complete is called.
+     * 
+     * This must only be called if EventLoop::getIoUring is not nullptr.
+     */
+    io_uring_sqe * prepare(Waiter &waiter);
+
+    /**
+     * @brief Cancel the io_uring operation of the waiter and wait until the
+     * kernel has completed it, so that its buffers can be released. The 
+     * waiter is not called or resumed afterwards.
+     */
+    void cancelOperation(Waiter &waiter);
+
+    /**
+     * @brief Get the EventLoop that is running on the calling thread, or 
+     * nullptr if there is none.
+     */
+    static EventLoop * current();
+
+    /**
+     * @brief Check if a file descriptor is registered.
+     */
+    bool contains(int fd) const;
+
+    /**
+     * @brief Get the number of registered file descriptors.
+     */
+    size_t size() const;
+
+    /**
+     * @brief Run a function after a delay. 
+     * 
+     * @param delay The time until the function is run.
+     * @param callback The function that is run.
+     * @param interval If non-zero, the function is run repeatedly with this 
+     * interval until the timer is canceled.
+     * 
+     * @return The id that can be used to cancel the timer.
+     */
+    TimerId addTimer(std::chrono::milliseconds delay, Callback callback, 
+        std::chrono::milliseconds interval = std::chrono::milliseconds(0));
+
+    /**
+     * @brief Cancel a timer. Nothing happens if it already ran or was 
+     * canceled.
+     */
+    void cancelTimer(TimerId id);
+
+    /**
+     * @brief Run a function on the loop thread. This can be called from any 
+     * thread and wakes up the loop.
+     */
+    void post(Callback task);
+
+    /**
+     * @brief Wait for events once and dispatch them, then run due timers and
+     * posted functions.
+     * 
+     * If waiting fails, an exception is thrown.
+     * 
+     * @param timeoutMs The maximum number of milliseconds to wait, or -1 to 
+     * wait until something happens.
+     * 
+     * @return The number of callbacks that were called.
+     */
+    size_t runOnce(int timeoutMs = -1);
+
+    /**
+     * @brief Dispatch events until EventLoop::stop is called.
+     */
+    void run();
+
+    /**
+     * @brief Make EventLoop::run return after the current iteration. This can
+     * be called from any thread.
+     */
+    void stop();
+
+};
+
+
+} // namespace netlib
+
+#endif // _EVENTLOOP_HPP
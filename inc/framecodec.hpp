@@ -0,0 +1,184 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#ifndef _FRAMECODEC_HPP
+#define _FRAMECODEC_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include <sys/uio.h>
+
+#include "tcpstream.hpp"
+#include "bytebuffer.hpp"
+
+namespace netlib
+{
+
+
+/**
+ * @brief A view into the payload of a received frame. The data is owned by 
+ * the FrameCodec that returned it.
+ */
+struct FrameView
+{
+    /**
+     * @brief Pointer to the first byte of the payload.
+     */
+    const uint8_t *data = nullptr;
+
+    /**
+     * @brief The number of bytes in the payload.
+     */
+    size_t size = 0;
+};
+
+/**
+ * @brief The FrameCodec sends and receives length-prefixed messages over a 
+ * TcpStream. Every frame consists of a 4 byte length in network byte order, 
+ * followed by the payload.
+ * 
+ * Outgoing frames are sent with a single vectored write of prefix and 
+ * payload, so the payload is never copied. Incoming data is read in large 
+ * chunks into a reusable buffer, so that many small frames are parsed out of 
+ * a single read. Received payloads are returned as views into that buffer.
+ * 
+ * Frames with a payload larger than the maximum frame size are rejected in 
+ * both directions.
+ */
+class FrameCodec
+{
+private:
+
+    /**
+     * @brief The stream that the frames are sent and received over.
+     */
+    TcpStream &stream;
+
+    /**
+     * @brief The maximum size of a frame payload in bytes.
+     */
+    size_t maxFrameSize;
+
+    /**
+     * @brief The receive buffer. Only grows if a single frame does not fit.
+     */
+    ByteBuffer buffer;
+
+    /**
+     * @brief Offset of the first byte in buffer that was not parsed yet.
+     */
+    size_t readPos = 0;
+
+    /**
+     * @brief Offset after the last byte in buffer that was received.
+     */
+    size_t writePos = 0;
+
+    /**
+     * @brief The number of bytes of the last returned frame. They are 
+     * released on the next call to receiveFrame.
+     */
+    size_t consumed = 0;
+
+    /**
+     * @brief True if the connection was closed by the peer.
+     */
+    bool eof = false;
+
+    /**
+     * @brief Read more data from the stream, making sure that at least needed
+     * bytes starting at readPos fit into the buffer.
+     * 
+     * @return False if no data was read because of EOF, or because no data is
+     * available in non-blocking mode.
+     */
+    bool fill(size_t needed);
+
+public:
+
+    /**
+     * @brief The size of the length prefix in bytes.
+     */
+    static constexpr size_t HEADER_SIZE = 4;
+
+    /**
+     * @brief Create a FrameCodec for the given stream. The stream must be 
+     * connected and must outlive the FrameCodec.
+     * 
+     * @param stream The connected TcpStream that frames are sent over.
+     * @param maxFrameSize The maximum payload size of a single frame.
+     * @param bufferSize The initial size of the receive buffer. This should be
+     * large enough to hold many typical frames.
+     */
+    FrameCodec(TcpStream &stream, size_t maxFrameSize = 16 * 1024 * 1024, size_t bufferSize = 64 * 1024);
+
+    FrameCodec(const FrameCodec &other) = delete;
+    FrameCodec& operator=(const FrameCodec &other) = delete;
+
+    /**
+     * @brief Send a single frame with the given payload.
+     * 
+     * If the payload exceeds the maximum frame size or sending fails, an 
+     * exception is thrown.
+     * 
+     * @param data Pointer to at least len bytes of payload.
+     * @param len The number of payload bytes.
+     */
+    void sendFrame(const void *data, size_t len);
+
+    /**
+     * @brief Send count frames, one for each of the given payloads, with as 
+     * few vectored writes as possible.
+     * 
+     * If a payload exceeds the maximum frame size, an exception is thrown 
+     * before any frame is sent. If sending fails, an exception is thrown as 
+     * well, but the frames before the failure may already have been sent.
+     * 
+     * @param payloads Pointer to count iovec structs that describe the 
+     * payloads.
+     * @param count The number of frames.
+     */
+    void sendFrames(const iovec *payloads, size_t count);
+
+    /**
+     * @brief Receive the next frame. The returned view is valid until the 
+     * next call to receiveFrame or until the FrameCodec is destroyed.
+     * 
+     * If a frame exceeds the maximum frame size, the connection is closed in
+     * the middle of a frame or receiving fails, an exception is thrown.
+     * 
+     * @param frame The view that is set to the payload of the received frame.
+     * 
+     * @return True if a frame was received. False if the connection was 
+     * closed by the peer, or if no complete frame is available yet in 
+     * non-blocking mode. Use isEof to distinguish them.
+     */
+    bool receiveFrame(FrameView &frame);
+
+    /**
+     * @brief Check if the connection was closed by the peer. Frames that were
+     * already received can still be returned by receiveFrame.
+     */
+    bool isEof() const;
+
+    /**
+     * @brief Get the number of received bytes that were not returned as a 
+     * frame yet.
+     */
+    size_t getBuffered() const;
+
+    /**
+     * @brief Get the maximum payload size of a single frame.
+     */
+    size_t getMaxFrameSize() const;
+
+};
+
+
+} // namespace netlib
+
+#endif // _FRAMECODEC_HPP
@@ -0,0 +1,250 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#ifndef _IOSTATS_HPP
+#define _IOSTATS_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+
+#include <unistd.h>
+
+namespace netlib
+{
+
+
+/**
+ * @brief The socket operations that are instrumented.
+ */
+enum class IoOp
+{
+    TcpRead,
+    TcpWrite,
+    UdpSend,
+    UdpReceive,
+};
+
+/**
+ * @brief The number of values in IoOp.
+ */
+constexpr size_t IO_OP_COUNT = 4;
+
+/**
+ * @brief The number of latency histogram buckets. Bucket i counts calls that 
+ * took [2^i, 2^(i+1)) nanoseconds, the last bucket also counts all slower 
+ * calls.
+ */
+constexpr size_t IO_LATENCY_BUCKETS = 32;
+
+/**
+ * @brief Aggregated statistics of one operation type.
+ */
+struct IoOpStats
+{
+    /**
+     * @brief The number of calls.
+     */
+    uint64_t calls = 0;
+
+    /**
+     * @brief The number of calls that failed, including would-block results.
+     */
+    uint64_t errors = 0;
+
+    /**
+     * @brief The number of bytes that were transferred.
+     */
+    uint64_t bytes = 0;
+
+    /**
+     * @brief The summed latency of all calls in nanoseconds.
+     */
+    uint64_t totalNs = 0;
+
+    /**
+     * @brief Log2 bucketed latency histogram.
+     */
+    uint64_t latency[IO_LATENCY_BUCKETS] = {};
+
+    /**
+     * @brief Estimate a latency percentile from the histogram.
+     * 
+     * @param percentile The percentile in the range [0, 1].
+     * 
+     * @return The upper bound in nanoseconds of the bucket that contains the 
+     * percentile, or 0 if no calls were recorded.
+     */
+    uint64_t percentileNs(double percentile) const;
+};
+
+/**
+ * @brief A snapshot of the statistics of all threads, per operation type.
+ */
+struct IoStatsSnapshot
+{
+    IoOpStats ops[IO_OP_COUNT];
+
+    const IoOpStats & operator[](IoOp op) const { return ops[(size_t)op]; }
+};
+
+/**
+ * @brief Plain copy of the I/O counters of a single socket.
+ */
+struct IoCounters
+{
+    uint64_t readCalls = 0;
+    uint64_t readBytes = 0;
+    uint64_t writeCalls = 0;
+    uint64_t writeBytes = 0;
+    uint64_t errors = 0;
+};
+
+/**
+ * @brief The I/O counters of a single socket. The counters are updated with 
+ * relaxed atomics, since the socket can be used by different threads after
+ * cloning. Without NETLIB_INSTRUMENT this class is empty and all functions 
+ * are inline no-ops.
+ * 
+ * @note This is an internal class and is not indended to be used directly.
+ */
+class SocketIoCounters
+{
+#ifdef NETLIB_INSTRUMENT
+private:
+    std::atomic<uint64_t> readCalls{0};
+    std::atomic<uint64_t> readBytes{0};
+    std::atomic<uint64_t> writeCalls{0};
+    std::atomic<uint64_t> writeBytes{0};
+    std::atomic<uint64_t> errors{0};
+
+public:
+    SocketIoCounters() = default;
+    SocketIoCounters(const SocketIoCounters &other) { *this = other; }
+    SocketIoCounters& operator=(const SocketIoCounters &other);
+
+    /**
+     * @brief Count a call with the result res.
+     */
+    void record(bool write, ssize_t res) noexcept;
+
+    /**
+     * @brief Get a copy of the current counter values.
+     */
+    IoCounters load() const noexcept;
+#else
+public:
+    void record(bool, ssize_t) noexcept { }
+    IoCounters load() const noexcept { return IoCounters{}; }
+#endif // NETLIB_INSTRUMENT
+};
+
+/**
+ * @brief Process wide socket I/O statistics. 
+ * 
+ * If netlib is built with NETLIB_INSTRUMENT, every read, write, sendto and 
+ * recvfrom call is counted and its latency is recorded in a histogram. Each 
+ * thread records into its own aggregate without synchronization, the 
+ * aggregates are only merged when a snapshot is taken. Without 
+ * NETLIB_INSTRUMENT, the instrumentation compiles to nothing and snapshots 
+ * are empty.
+ */
+class IoStats
+{
+public:
+
+    /**
+     * @brief True if netlib was built with instrumentation.
+     */
+#ifdef NETLIB_INSTRUMENT
+    static constexpr bool ENABLED = true;
+#else
+    static constexpr bool ENABLED = false;
+#endif // NETLIB_INSTRUMENT
+
+    /**
+     * @brief Merge the statistics of all threads, including threads that 
+     * already exited. The statistics are never reset, so the calls in an 
+     * interval are the difference of two snapshots.
+     */
+    static IoStatsSnapshot snapshot();
+
+    /**
+     * @brief Record a call in the aggregate of the current thread.
+     * 
+     * @param op The type of the call.
+     * @param ns The latency of the call in nanoseconds.
+     * @param res The result of the call, the number of bytes or -1.
+     */
+#ifdef NETLIB_INSTRUMENT
+    static void record(IoOp op, uint64_t ns, ssize_t res) noexcept;
+#else
+    static void record(IoOp, uint64_t, ssize_t) noexcept { }
+#endif // NETLIB_INSTRUMENT
+};
+
+/**
+ * @brief Get the start time of an instrumented operation. Without 
+ * NETLIB_INSTRUMENT the clock is not read.
+ * 
+ * @note This is an internal function and is not indended to be used directly.
+ */
+inline std::chrono::steady_clock::time_point ioStartTime() noexcept
+{
+#ifdef NETLIB_INSTRUMENT
+    return std::chrono::steady_clock::now();
+#else
+    return {};
+#endif // NETLIB_INSTRUMENT
+}
+
+/**
+ * @brief Record an operation that started at start in the statistics and the
+ * counters, if the instrumentation is enabled. This is used directly for 
+ * operations that complete without a syscall of their own, like io_uring 
+ * completions. errno is preserved.
+ * 
+ * @note This is an internal function and is not indended to be used directly.
+ */
+inline void recordIo(IoOp op, SocketIoCounters &counters, std::chrono::steady_clock::time_point start, 
+    ssize_t res) noexcept
+{
+#ifdef NETLIB_INSTRUMENT
+    auto end = std::chrono::steady_clock::now();
+
+    int savedErrno = errno;
+    IoStats::record(op, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), res);
+    counters.record(op == IoOp::TcpWrite || op == IoOp::UdpSend, res);
+    errno = savedErrno;
+#else
+    (void)op;
+    (void)counters;
+    (void)start;
+    (void)res;
+#endif // NETLIB_INSTRUMENT
+}
+
+/**
+ * @brief Call fn and record the call in the statistics and the counters, if
+ * the instrumentation is enabled. Otherwise this is only a call to fn. errno
+ * is preserved.
+ * 
+ * @note This is an internal function and is not indended to be used directly.
+ */
+template <typename Fn>
+inline ssize_t measureIo(IoOp op, SocketIoCounters &counters, Fn &&fn)
+{
+    auto start = ioStartTime();
+    ssize_t res = fn();
+    recordIo(op, counters, start, res);
+    return res;
+}
+
+} // namespace netlib
+
+#endif // _IOSTATS_HPP
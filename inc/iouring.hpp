@@ -0,0 +1,254 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#ifndef _IOURING_HPP
+#define _IOURING_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+
+namespace netlib
+{
+
+
+/**
+ * @brief Minimal io_uring instance that uses the raw syscalls, so no external
+ * library is needed. The submission and completion rings are shared with the
+ * kernel, so many operations can be submitted and completed with a single
+ * io_uring_enter call.
+ *
+ * Operations are prepared in submission queue entries (SQEs) obtained with
+ * IoUring::getSqe and are only submitted with the next call to
+ * IoUring::submit. The completions (CQEs) are then taken from the completion
+ * queue with IoUring::popCompletion. The user_data of the SQE is passed
+ * through to its CQE.
+ *
+ * @note This is a low level class. The EventLoop uses it to run the async
+ * socket operations if io_uring is available.
+ */
+class IoUring
+{
+private:
+
+    /**
+     * @brief The io_uring file descriptor.
+     */
+    int ringfd = -1;
+
+    /**
+     * @brief The features reported by the kernel (IORING_FEAT_*).
+     */
+    uint32_t features = 0;
+
+    /**
+     * @brief The mapped submission ring, completion ring and SQE array.
+     */
+    void *sqRing = nullptr;
+    void *cqRing = nullptr;
+    io_uring_sqe *sqes = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    size_t sqesSize = 0;
+
+    /**
+     * @brief Pointers into the submission ring.
+     */
+    unsigned *sqHead = nullptr;
+    unsigned *sqTail = nullptr;
+    unsigned *sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+
+    /**
+     * @brief Pointers into the completion ring.
+     */
+    unsigned *cqHead = nullptr;
+    unsigned *cqTail = nullptr;
+    io_uring_cqe *cqes = nullptr;
+    unsigned cqMask = 0;
+
+    /**
+     * @brief The local tail of the submission ring. Entries between the
+     * shared tail and this are prepared but not yet published.
+     */
+    unsigned sqLocalTail = 0;
+
+    /**
+     * @brief The number of published entries that are not yet submitted.
+     */
+    unsigned toSubmit = 0;
+
+    /**
+     * @brief The next unused buffer group id.
+     */
+    uint16_t nextBufferGroup = 0;
+
+    /**
+     * @brief Publish all prepared entries to the kernel.
+     */
+    void flush();
+
+    /**
+     * @brief Unmap the rings and close the file descriptor.
+     */
+    void release();
+
+public:
+
+    /**
+     * @brief Create an io_uring with the given number of submission entries.
+     * The completion queue is twice as large.
+     *
+     * If io_uring is not supported or disabled, an exception is thrown.
+     */
+    IoUring(unsigned entries = 256);
+
+    ~IoUring();
+
+    IoUring(const IoUring &other) = delete;
+    IoUring& operator=(const IoUring &other) = delete;
+
+    /**
+     * @brief Check if io_uring can be used on this system. The check is only
+     * done once.
+     */
+    static bool isSupported();
+
+    /**
+     * @brief Check if the kernel reports a feature (IORING_FEAT_*).
+     */
+    bool hasFeature(uint32_t feature) const;
+
+    /**
+     * @brief Get the io_uring file descriptor.
+     */
+    int getFd() const;
+
+    /**
+     * @brief Get a cleared submission queue entry. If the submission queue is
+     * full, the prepared entries are submitted first.
+     *
+     * If submitting fails, an exception is thrown.
+     */
+    io_uring_sqe * getSqe();
+
+    /**
+     * @brief Get the number of prepared entries that are not yet submitted.
+     */
+    unsigned getPending() const;
+
+    /**
+     * @brief Submit all prepared entries with one io_uring_enter call, and
+     * optionally wait for completions.
+     *
+     * If io_uring_enter fails with a different error than a timeout or an
+     * interrupt, an exception is thrown.
+     *
+     * @param minComplete The number of completions to wait for.
+     * @param timeoutMs The maximum time to wait in milliseconds, or -1 to
+     * wait without timeout. Waiting with a timeout requires
+     * IORING_FEAT_EXT_ARG.
+     *
+     * @return The number of submitted entries.
+     */
+    unsigned submit(unsigned minComplete = 0, int timeoutMs = -1);
+
+    /**
+     * @brief Take the next completion from the completion queue.
+     *
+     * @return True if a completion was available, false otherwise.
+     */
+    bool popCompletion(io_uring_cqe &cqe);
+
+    /**
+     * @brief Register files, so that operations can refer to them by index
+     * with IOSQE_FIXED_FILE. Entries of -1 are empty slots that can be
+     * updated later.
+     *
+     * If registering fails, an exception is thrown.
+     */
+    void registerFiles(const int *fds, unsigned count);
+
+    /**
+     * @brief Replace the registered files beginning at the given index.
+     *
+     * If updating fails, an exception is thrown.
+     */
+    void updateFiles(unsigned offset, const int *fds, unsigned count);
+
+    /**
+     * @brief Remove all registered files.
+     */
+    void unregisterFiles();
+
+    /**
+     * @brief Register buffers, so that IoUring::prepReadFixed and
+     * IoUring::prepWriteFixed can use them without mapping the pages for
+     * every operation. The buffers must stay valid until they are
+     * unregistered.
+     *
+     * If registering fails, an exception is thrown.
+     */
+    void registerBuffers(const iovec *buffers, unsigned count);
+
+    /**
+     * @brief Remove all registered buffers.
+     */
+    void unregisterBuffers();
+
+    /**
+     * @brief Register a ring of provided buffers (5.19+). Operations with 
+     * IOSQE_BUFFER_SELECT pick a buffer from the ring of their buffer group 
+     * only when data arrives.
+     *
+     * If registering fails, an exception is thrown.
+     *
+     * @param ringAddr The page aligned memory of the io_uring_buf_ring.
+     * @param entries The number of entries, a power of 2.
+     * @param groupId The buffer group id of the ring.
+     */
+    void registerBufferRing(void *ringAddr, unsigned entries, uint16_t groupId);
+
+    /**
+     * @brief Remove a registered buffer ring.
+     */
+    void unregisterBufferRing(uint16_t groupId);
+
+    /**
+     * @brief Get a buffer group id that was not used before on this ring.
+     */
+    uint16_t allocateBufferGroup();
+
+    /**
+     * @brief Prepare helpers that fill an SQE for the given operation. The
+     * multishot variants produce completions with IORING_CQE_F_MORE until 
+     * they are canceled or fail, and the recv variants select their buffers
+     * from the given buffer group.
+     */
+    static void prepRecv(io_uring_sqe *sqe, int fd, void *data, size_t len, int flags);
+    static void prepSend(io_uring_sqe *sqe, int fd, const void *data, size_t len, int flags);
+    static void prepRecvmsg(io_uring_sqe *sqe, int fd, msghdr *msg, int flags);
+    static void prepSendmsg(io_uring_sqe *sqe, int fd, const msghdr *msg, int flags);
+    static void prepAccept(io_uring_sqe *sqe, int fd, sockaddr *addr, socklen_t *addrlen, int flags);
+    static void prepReadFixed(io_uring_sqe *sqe, int fd, void *data, size_t len, uint16_t bufIndex);
+    static void prepWriteFixed(io_uring_sqe *sqe, int fd, const void *data, size_t len, uint16_t bufIndex);
+    static void prepPollAdd(io_uring_sqe *sqe, int fd, uint32_t pollMask);
+    static void prepCancel(io_uring_sqe *sqe, uint64_t userData);
+    static void prepMultishotAccept(io_uring_sqe *sqe, int fd, int flags);
+    static void prepRecvMultishot(io_uring_sqe *sqe, int fd, uint16_t groupId, int flags);
+    static void prepRecvmsgMultishot(io_uring_sqe *sqe, int fd, msghdr *msg, uint16_t groupId, int flags);
+
+};
+
+
+} // namespace netlib
+
+#endif // _IOURING_HPP
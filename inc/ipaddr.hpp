@@ -136,6 +136,7 @@ public:
     friend class TcpListener;
     friend class UdpSocket;
     friend class Resolver;
+    friend class AsyncIo;
 
 };
 
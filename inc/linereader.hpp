@@ -0,0 +1,147 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#ifndef _LINEREADER_HPP
+#define _LINEREADER_HPP
+
+#include <vector>
+#include <string_view>
+#include <cstddef>
+
+#include "tcpstream.hpp"
+#include "bytebuffer.hpp"
+
+namespace netlib
+{
+
+
+/**
+ * @brief The LineReader receives data from a TcpStream in large chunks and 
+ * splits it into lines terminated by "\n" or "\r\n", for text protocols.
+ * 
+ * Each received chunk is scanned once with the LineScanner and all complete 
+ * lines in it are queued. The lines are returned as views into the receive 
+ * buffer, so no line is copied.
+ */
+class LineReader
+{
+private:
+
+    /**
+     * @brief The stream that the lines are received from.
+     */
+    TcpStream &stream;
+
+    /**
+     * @brief The maximum length of a line in bytes, without terminator.
+     */
+    size_t maxLineLength;
+
+    /**
+     * @brief The receive buffer. Only grows if a single line does not fit.
+     */
+    ByteBuffer buffer;
+
+    /**
+     * @brief Offset of the first byte in buffer that is not part of a queued
+     * or returned line.
+     */
+    size_t readPos = 0;
+
+    /**
+     * @brief Offset up to which buffer was already scanned for line feeds.
+     */
+    size_t scanPos = 0;
+
+    /**
+     * @brief Offset after the last byte in buffer that was received.
+     */
+    size_t writePos = 0;
+
+    /**
+     * @brief The lines that were found, but not returned yet.
+     */
+    std::vector<std::string_view> lines;
+
+    /**
+     * @brief Index of the next line in lines that will be returned.
+     */
+    size_t nextLine = 0;
+
+    /**
+     * @brief True if the connection was closed by the peer.
+     */
+    bool eof = false;
+
+    /**
+     * @brief Receive more data and queue all complete lines in it. 
+     * 
+     * @return False if no data was read because of EOF, or because no data is
+     * available in non-blocking mode.
+     */
+    bool fill();
+
+public:
+
+    /**
+     * @brief Create a LineReader for the given stream. The stream must be 
+     * connected and must outlive the LineReader.
+     * 
+     * @param stream The connected TcpStream that lines are received from.
+     * @param maxLineLength The maximum length of a single line.
+     * @param bufferSize The initial size of the receive buffer.
+     */
+    LineReader(TcpStream &stream, size_t maxLineLength = 64 * 1024, size_t bufferSize = 64 * 1024);
+
+    LineReader(const LineReader &other) = delete;
+    LineReader& operator=(const LineReader &other) = delete;
+
+    /**
+     * @brief Receive the next line. The line terminator is not included. When
+     * the connection is closed, the remaining data without terminator is 
+     * returned as the last line.
+     * 
+     * The returned view is valid until the next call to readLine or 
+     * readLines, or until the LineReader is destroyed.
+     * 
+     * If a line exceeds the maximum line length or receiving fails, an 
+     * exception is thrown.
+     * 
+     * @param line The view that is set to the received line.
+     * 
+     * @return True if a line was received. False if the connection was 
+     * closed by the peer, or if no complete line is available yet in 
+     * non-blocking mode. Use isEof to distinguish them.
+     */
+    bool readLine(std::string_view &line);
+
+    /**
+     * @brief Receive all lines that are available with at most one read and 
+     * append them to out. This blocks only if no complete line is buffered. 
+     * 
+     * The returned views are valid until the next call to readLine or 
+     * readLines, or until the LineReader is destroyed.
+     * 
+     * @see LineReader::readLine
+     * 
+     * @param out The vector that the line views are appended to.
+     * 
+     * @return The number of lines that were appended.
+     */
+    size_t readLines(std::vector<std::string_view> &out);
+
+    /**
+     * @brief Check if the connection was closed by the peer. Lines that were
+     * already received can still be returned.
+     */
+    bool isEof() const;
+
+};
+
+
+} // namespace netlib
+
+#endif // _LINEREADER_HPP
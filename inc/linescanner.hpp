@@ -0,0 +1,75 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#ifndef _LINESCANNER_HPP
+#define _LINESCANNER_HPP
+
+#include <vector>
+#include <string_view>
+#include <cstddef>
+
+namespace netlib
+{
+
+
+/**
+ * @brief The LineScanner splits buffers of text into lines that are 
+ * terminated by "\n" or "\r\n".
+ * 
+ * The buffer is scanned for line feeds 16 or 32 bytes at a time using SSE2 or
+ * AVX2, depending on what the CPU supports. On other architectures a scalar 
+ * implementation is used. All lines in a buffer are found in a single pass.
+ */
+class LineScanner
+{
+private:
+
+    /**
+     * @brief Split implementation without SIMD instructions.
+     */
+    static size_t splitScalar(const char *data, size_t len, std::vector<std::string_view> &lines, size_t scanFrom);
+
+#if defined(__x86_64__) || defined(__i386__)
+
+    /**
+     * @brief Split implementation that scans 16 bytes at a time with SSE2.
+     */
+    static size_t splitSse2(const char *data, size_t len, std::vector<std::string_view> &lines, size_t scanFrom);
+
+    /**
+     * @brief Split implementation that scans 32 bytes at a time with AVX2. 
+     * This must only be called if the CPU supports AVX2.
+     */
+    static size_t splitAvx2(const char *data, size_t len, std::vector<std::string_view> &lines, size_t scanFrom);
+
+#endif
+
+public:
+
+    /**
+     * @brief Append a view of every complete line in data to lines. The line
+     * terminator ("\n" or "\r\n") is not part of the views. Data after the 
+     * last line feed is an incomplete line and is not returned.
+     * 
+     * @param data Pointer to at least len bytes of text.
+     * @param len The number of bytes in data.
+     * @param lines The vector that the line views are appended to. The views
+     * point into data.
+     * @param scanFrom Offset from which data is scanned. The bytes before it 
+     * must not contain a line feed, this avoids scanning an incomplete line 
+     * again after more data was appended.
+     * 
+     * @return The number of bytes that belong to complete lines, including 
+     * their terminators.
+     */
+    static size_t split(const char *data, size_t len, std::vector<std::string_view> &lines, size_t scanFrom = 0);
+
+};
+
+
+} // namespace netlib
+
+#endif // _LINESCANNER_HPP
@@ -0,0 +1,896 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#ifndef _MULTISHOT_HPP
+#define _MULTISHOT_HPP
+
+#include "async.hpp"
+
+// Like async.hpp, this requires coroutines
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <deque>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "bufferring.hpp"
+
+namespace netlib
+{
+
+
+/**
+ * @brief Accepts connections of a TcpListener with a single io_uring
+ * multishot accept (5.19+). The accept stays armed in the kernel and every
+ * incoming connection produces a completion, so at high connection rates
+ * there is no accept syscall per connection. Connections that arrive while
+ * no coroutine is waiting are queued.
+ *
+ * The completions don't carry the peer address, so it is queried with one
+ * getpeername call per connection. If the remote address of the streams is
+ * not needed, this can be disabled in the constructor.
+ *
+ * If the EventLoop does not use io_uring or the kernel does not support
+ * multishot accept, epoll readiness and TcpListener::accept are used instead.
+ *
+ * Use it from a coroutine with `TcpStream stream = co_await acceptor.next()`.
+ * Only one coroutine can wait at a time.
+ */
+class MultishotAcceptor : public EventLoop::Waiter
+{
+private:
+
+    EventLoop &loop;
+    TcpListener &listener;
+
+    /**
+     * @brief True if the multishot accept is used.
+     */
+    bool ringMode;
+
+    /**
+     * @brief True while the multishot accept is armed in the kernel.
+     */
+    bool armed = false;
+
+    /**
+     * @brief True if epoll reported the listener as readable.
+     */
+    bool readable = false;
+
+    /**
+     * @brief True while a one-shot epoll wait is registered for the listener.
+     */
+    bool waitRegistered = false;
+
+    /**
+     * @brief True if a resume is already scheduled in the EventLoop.
+     */
+    bool resumeScheduled = false;
+
+    /**
+     * @brief True if at least one connection was accepted with io_uring.
+     */
+    bool acceptedAny = false;
+
+    /**
+     * @brief True if the remote address of connections accepted with
+     * io_uring is queried with getpeername.
+     */
+    bool queryRemote;
+
+    /**
+     * @brief The accepted connections that were not yet taken.
+     */
+    std::deque<TcpStream> pending;
+
+    /**
+     * @brief The first error that occurred, reported by the next call to next.
+     */
+    std::error_code error;
+
+    /**
+     * @brief The waiting coroutine.
+     */
+    std::coroutine_handle<> handle;
+
+    void arm()
+    {
+        IoUring::prepMultishotAccept(loop.prepare(*this), listener.getSocketFd(),
+            listener.isNonBlocking() ? SOCK_NONBLOCK : 0);
+        armed = true;
+    }
+
+    void scheduleResume()
+    {
+        if (resumeScheduled) return;
+        resumeScheduled = true;
+        loop.schedule(*this);
+    }
+
+    /**
+     * @brief Wait with epoll until the listener is readable.
+     */
+    void waitReady()
+    {
+        loop.waitOnce(listener.getSocketFd(), EventLoop::READABLE, *this);
+        waitRegistered = true;
+    }
+
+    /**
+     * @brief Accept the pending connections without io_uring. A blocking
+     * listener only accepts one connection after it was reported readable.
+     */
+    void acceptReady(bool ready)
+    {
+        if (!ready && !listener.isNonBlocking()) return;
+
+        while (true)
+        {
+            std::error_code ec;
+            TcpStream stream = listener.accept(ec);
+
+            if (AsyncIo::isWouldBlock(ec)) break;
+            if (ec)
+            {
+                error = ec;
+                break;
+            }
+
+            pending.push_back(std::move(stream));
+            if (!listener.isNonBlocking()) break;
+        }
+    }
+
+    bool isReady() const
+    {
+        return !pending.empty() || error;
+    }
+
+public:
+
+    /**
+     * @brief Awaitable of MultishotAcceptor::next.
+     */
+    class NextAwaitable
+    {
+    private:
+        MultishotAcceptor &owner;
+        bool suspended = false;
+
+    public:
+        NextAwaitable(MultishotAcceptor &_owner) : owner{_owner} { }
+
+        ~NextAwaitable()
+        {
+            // The coroutine was destroyed while waiting
+            if (suspended) owner.handle = nullptr;
+        }
+
+        NextAwaitable(const NextAwaitable &other) = delete;
+        NextAwaitable& operator=(const NextAwaitable &other) = delete;
+
+        bool await_ready()
+        {
+            if (!owner.isReady() && !owner.ringMode) owner.acceptReady(false);
+            return owner.isReady();
+        }
+
+        void await_suspend(std::coroutine_handle<> _handle)
+        {
+            owner.handle = _handle;
+            suspended = true;
+
+            if (owner.ringMode)
+            {
+                if (!owner.armed) owner.arm();
+            }
+            else
+            {
+                owner.waitReady();
+            }
+        }
+
+        TcpStream await_resume()
+        {
+            suspended = false;
+
+            if (owner.pending.empty())
+            {
+                std::error_code ec = owner.error;
+                owner.error.clear();
+                throw std::system_error(ec, "Error while accepting connection");
+            }
+
+            TcpStream stream = std::move(owner.pending.front());
+            owner.pending.pop_front();
+            return stream;
+        }
+    };
+
+    /**
+     * @brief Create an acceptor for a listening TcpListener. Both the
+     * EventLoop and the listener must outlive the acceptor.
+     *
+     * @param queryRemote If false, the streams accepted with io_uring have
+     * the remote address 0.0.0.0:0 (or [::]:0), which saves the getpeername
+     * call per connection.
+     */
+    MultishotAcceptor(EventLoop &_loop, TcpListener &_listener, bool _queryRemote = true)
+        : loop{_loop}, listener{_listener}, ringMode{_loop.getIoUring() != nullptr}, 
+            queryRemote{_queryRemote}
+    { }
+
+    /**
+     * @brief Cancel the multishot accept. Connections that were accepted but
+     * not taken are closed.
+     */
+    ~MultishotAcceptor() override
+    {
+        // Only a registered wait is canceled, the fd number may be reused by now
+        if (armed) loop.cancelOperation(*this);
+        else if (waitRegistered) loop.cancelWait(listener.getSocketFd(), *this);
+
+        loop.unschedule(*this);
+    }
+
+    MultishotAcceptor(const MultishotAcceptor &other) = delete;
+    MultishotAcceptor& operator=(const MultishotAcceptor &other) = delete;
+
+    /**
+     * @brief Wait for the next connection with `co_await acceptor.next()`.
+     *
+     * If accepting failed, an exception is thrown.
+     */
+    NextAwaitable next()
+    {
+        return NextAwaitable{*this};
+    }
+
+    /**
+     * @brief Check if the io_uring multishot accept is used.
+     */
+    bool isMultishot() const
+    {
+        return ringMode;
+    }
+
+    /**
+     * @brief Get the number of accepted connections that were not yet taken.
+     */
+    size_t getPending() const
+    {
+        return pending.size();
+    }
+
+    void notify(uint32_t) override
+    {
+        readable = true;
+        waitRegistered = false;
+        scheduleResume();
+    }
+
+    void complete(int32_t result, uint32_t flags) override
+    {
+        if (!(flags & IORING_CQE_F_MORE)) armed = false;
+
+        if (result >= 0)
+        {
+            acceptedAny = true;
+
+            SockAddr::RawSockAddr remote;
+            std::memset(&remote, 0, sizeof(remote));
+            socklen_t remoteLen = sizeof(remote);
+
+            std::error_code ec;
+            if (queryRemote && getpeername(result, &remote.generic, &remoteLen) != 0)
+            {
+                ec = std::error_code{errno, std::system_category()};
+                ::close(result);
+
+                // The peer already reset the connection, like ECONNABORTED for accept
+                if (ec == std::errc::not_connected) ec.clear();
+                else if (!error) error = ec;
+            }
+            else
+            {
+                TcpStream stream = AsyncIo::acceptedStream(listener, result, remote, ec);
+                if (ec) error = ec;
+                else pending.push_back(std::move(stream));
+            }
+        }
+        else if (result == -EINVAL && !acceptedAny)
+        {
+            // Multishot accept is not supported by this kernel
+            ringMode = false;
+        }
+        else if (result != -ECANCELED && !error)
+        {
+            error = std::error_code{-result, std::system_category()};
+        }
+
+        scheduleResume();
+    }
+
+    void resume() override
+    {
+        resumeScheduled = false;
+        if (!handle) return;
+
+        if (!isReady())
+        {
+            if (ringMode)
+            {
+                if (!armed) arm();
+                return;
+            }
+
+            if (readable) acceptReady(true);
+            readable = false;
+
+            if (!isReady())
+            {
+                waitReady();
+                return;
+            }
+        }
+
+        std::coroutine_handle<> waiting = handle;
+        handle = nullptr;
+        waiting.resume();
+    }
+};
+
+/**
+ * @brief Data that was received by a MultishotReceiver. The data is stored in
+ * one of the receive buffers and must be given back with
+ * MultishotReceiver::release.
+ */
+struct ReceivedBuffer
+{
+    /**
+     * @brief The received data.
+     */
+    const uint8_t *data = nullptr;
+
+    /**
+     * @brief The number of bytes received. For TcpStreams, 0 means that the
+     * connection was closed. For UdpSockets, 0 is an empty packet.
+     */
+    size_t size = 0;
+
+    /**
+     * @brief The sender of a UDP packet.
+     */
+    SockAddr remote;
+
+    /**
+     * @brief True if the UDP packet was larger than the buffer and only the
+     * first size bytes of it were received.
+     */
+    bool truncated = false;
+
+    /**
+     * @brief The id of the receive buffer, or -1 if no buffer is used.
+     */
+    int bufferId = -1;
+};
+
+/**
+ * @brief Receives from a TcpStream or UdpSocket with a single io_uring
+ * multishot recv (6.0+) that selects its buffers from a provided buffer ring.
+ * The recv stays armed in the kernel and every arriving chunk or packet
+ * produces a completion. A buffer is only consumed when data actually
+ * arrives, so no buffer has to be posted in advance.
+ *
+ * If the EventLoop does not use io_uring, the kernel does not support it or
+ * the stream uses TLS, epoll readiness and non-blocking reads into the same
+ * buffers are used instead.
+ *
+ * Use it from a coroutine with `ReceivedBuffer buf = co_await receiver.next()`
+ * and give the buffer back with `receiver.release(buf)`. Only one coroutine
+ * can wait at a time.
+ */
+class MultishotReceiver : public EventLoop::Waiter
+{
+private:
+
+    EventLoop &loop;
+    TcpStream *stream;
+    UdpSocket *socket;
+    int fd;
+
+    /**
+     * @brief The receive buffers.
+     */
+    std::unique_ptr<BufferRing> buffers;
+
+    /**
+     * @brief True if the multishot recv is used.
+     */
+    bool ringMode;
+
+    /**
+     * @brief True while the multishot recv is armed in the kernel.
+     */
+    bool armed = false;
+
+    /**
+     * @brief True if epoll reported the socket as readable.
+     */
+    bool readable = false;
+
+    /**
+     * @brief True while a one-shot epoll wait is registered for the socket.
+     */
+    bool waitRegistered = false;
+
+    /**
+     * @brief True if a resume is already scheduled in the EventLoop.
+     */
+    bool resumeScheduled = false;
+
+    /**
+     * @brief True if a TcpStream was closed by the peer.
+     */
+    bool eof = false;
+
+    /**
+     * @brief The number of buffers that are received but not released.
+     */
+    unsigned held = 0;
+
+    /**
+     * @brief The received data that was not yet taken.
+     */
+    std::deque<ReceivedBuffer> pending;
+
+    /**
+     * @brief The first error that occurred, reported by the next call to next.
+     */
+    std::error_code error;
+
+    /**
+     * @brief The header of the multishot recvmsg for UDP sockets. Only the
+     * length of the address and control data is used.
+     */
+    msghdr msg;
+
+    /**
+     * @brief The waiting coroutine.
+     */
+    std::coroutine_handle<> handle;
+
+    /**
+     * @brief The time when the recv was armed or last completed, only set if
+     * the instrumentation is enabled.
+     */
+    std::chrono::steady_clock::time_point started;
+
+    void arm()
+    {
+        io_uring_sqe *sqe = loop.prepare(*this);
+
+        if (socket != nullptr) IoUring::prepRecvmsgMultishot(sqe, fd, &msg, buffers->getGroupId(), 0);
+        else IoUring::prepRecvMultishot(sqe, fd, buffers->getGroupId(), 0);
+
+        armed = true;
+        started = ioStartTime();
+    }
+
+    /**
+     * @brief Record a completion of the multishot recv in the I/O statistics.
+     */
+    void recordReceive(ssize_t res)
+    {
+        if (socket != nullptr) AsyncIo::recordResult(*socket, IoOp::UdpReceive, started, res);
+        else AsyncIo::recordResult(*stream, IoOp::TcpRead, started, res);
+        started = ioStartTime();
+    }
+
+    void scheduleResume()
+    {
+        if (resumeScheduled) return;
+        resumeScheduled = true;
+        loop.schedule(*this);
+    }
+
+    /**
+     * @brief Switch to epoll if the multishot recv can't be used.
+     */
+    void useFallback()
+    {
+        ringMode = false;
+        buffers = std::make_unique<BufferRing>(nullptr, buffers->getEntries(), buffers->getBufferSize());
+    }
+
+    /**
+     * @brief Receive the available data without io_uring, as long as free
+     * buffers are left.
+     */
+    void receiveReady()
+    {
+        uint16_t id;
+        while (!eof && !error)
+        {
+            if (!buffers->take(id))
+            {
+                // Waiting can't help if the caller holds all buffers
+                if (held == buffers->getEntries() && pending.empty())
+                    error = std::make_error_code(std::errc::no_buffer_space);
+                break;
+            }
+
+            ReceivedBuffer buf;
+            buf.data = buffers->getBuffer(id);
+            buf.bufferId = id;
+
+            std::error_code ec;
+            ssize_t res;
+            // With MSG_TRUNC, the full length of the packet is returned
+            if (socket != nullptr)
+                res = AsyncIo::receive(*socket, buffers->getBuffer(id), buffers->getBufferSize(), buf.remote, ec, 
+                    MSG_TRUNC);
+            else
+                res = AsyncIo::read(*stream, buffers->getBuffer(id), buffers->getBufferSize(), ec);
+
+            // Empty UDP packets are delivered like with io_uring
+            if (res < 0 || (res == 0 && socket == nullptr))
+            {
+                buffers->recycle(id);
+
+                if (AsyncIo::isWouldBlock(ec)) break;
+                if (ec) error = ec;
+                else eof = true;
+
+                break;
+            }
+
+            buf.size = std::min<size_t>(res, buffers->getBufferSize());
+            buf.truncated = (size_t)res > buf.size;
+            pending.push_back(buf);
+            held++;
+        }
+    }
+
+    /**
+     * @brief Convert a completion of the multishot recv to a ReceivedBuffer.
+     */
+    void addCompletion(int32_t result, uint32_t flags)
+    {
+        if (!(flags & IORING_CQE_F_BUFFER))
+        {
+            if (result == 0 && socket == nullptr)
+            {
+                eof = true;
+                recordReceive(0);
+            }
+            return;
+        }
+
+        uint16_t id = flags >> IORING_CQE_BUFFER_SHIFT;
+        uint8_t *data = buffers->getBuffer(id);
+        held++;
+
+        ReceivedBuffer buf;
+        buf.bufferId = id;
+
+        if (socket == nullptr)
+        {
+            buf.data = data;
+            buf.size = result;
+
+            // The last completion of a closed connection
+            if (result == 0) eof = true;
+        }
+        else
+        {
+            // The buffer starts with the header, followed by the address, the
+            // control data and the payload. The result is the number of bytes
+            // written to the buffer, while payloadlen is the full length of
+            // the packet, even if it didn't fit.
+            io_uring_recvmsg_out *out = (io_uring_recvmsg_out*)data;
+            uint8_t *name = data + sizeof(io_uring_recvmsg_out);
+            size_t headerLen = sizeof(io_uring_recvmsg_out) + msg.msg_namelen + msg.msg_controllen;
+
+            SockAddr::RawSockAddr raw;
+            std::memset(&raw, 0, sizeof(raw));
+            std::memcpy(&raw, name, std::min<size_t>(out->namelen, msg.msg_namelen));
+
+            size_t written = std::min<size_t>(result, buffers->getBufferSize());
+            buf.data = name + msg.msg_namelen + msg.msg_controllen;
+            buf.size = written > headerLen ? written - headerLen : 0;
+            buf.truncated = (out->flags & MSG_TRUNC) || out->payloadlen > buf.size;
+            buf.remote = AsyncIo::remoteAddress(*socket, raw);
+        }
+
+        recordReceive(buf.size);
+        pending.push_back(buf);
+    }
+
+    bool isReady() const
+    {
+        return !pending.empty() || error || eof;
+    }
+
+    /**
+     * @brief Get the events to wait for without io_uring. TLS reads may have
+     * to wait until the socket is writable.
+     */
+    uint32_t waitEvents() const
+    {
+        return stream != nullptr ? AsyncIo::retryEvents(*stream, EventLoop::READABLE) : EventLoop::READABLE;
+    }
+
+    /**
+     * @brief Wait with epoll until the socket is ready.
+     */
+    void waitReady()
+    {
+        loop.waitOnce(fd, waitEvents(), *this);
+        waitRegistered = true;
+    }
+
+    void init(unsigned bufferCount, size_t bufferSize, bool canUseRing)
+    {
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_namelen = sizeof(SockAddr::RawSockAddr);
+
+        ringMode = canUseRing && loop.getIoUring() != nullptr;
+
+        if (ringMode)
+        {
+            try
+            {
+                buffers = std::make_unique<BufferRing>(loop.getIoUring(), bufferCount, bufferSize);
+                return;
+            }
+            catch (const std::system_error &)
+            {
+                // Provided buffer rings are not supported by this kernel
+                ringMode = false;
+            }
+        }
+
+        buffers = std::make_unique<BufferRing>(nullptr, bufferCount, bufferSize);
+    }
+
+public:
+
+    /**
+     * @brief Awaitable of MultishotReceiver::next.
+     */
+    class NextAwaitable
+    {
+    private:
+        MultishotReceiver &owner;
+        bool suspended = false;
+
+    public:
+        NextAwaitable(MultishotReceiver &_owner) : owner{_owner} { }
+
+        ~NextAwaitable()
+        {
+            // The coroutine was destroyed while waiting
+            if (suspended) owner.handle = nullptr;
+        }
+
+        NextAwaitable(const NextAwaitable &other) = delete;
+        NextAwaitable& operator=(const NextAwaitable &other) = delete;
+
+        bool await_ready()
+        {
+            if (!owner.isReady() && !owner.ringMode) owner.receiveReady();
+            return owner.isReady();
+        }
+
+        void await_suspend(std::coroutine_handle<> _handle)
+        {
+            owner.handle = _handle;
+            suspended = true;
+
+            if (owner.ringMode)
+            {
+                if (!owner.armed) owner.arm();
+            }
+            else
+            {
+                owner.waitReady();
+            }
+        }
+
+        ReceivedBuffer await_resume()
+        {
+            suspended = false;
+
+            if (!owner.pending.empty())
+            {
+                ReceivedBuffer buf = owner.pending.front();
+                owner.pending.pop_front();
+                return buf;
+            }
+
+            if (owner.error)
+            {
+                std::error_code ec = owner.error;
+                owner.error.clear();
+                throw std::system_error(ec, "Error while receiving from socket");
+            }
+
+            // End of stream
+            return ReceivedBuffer{};
+        }
+    };
+
+    /**
+     * @brief Create a receiver for a connected TcpStream. Both the EventLoop
+     * and the stream must outlive the receiver.
+     *
+     * @param loop The EventLoop that runs the receiver.
+     * @param stream The stream that is received from.
+     * @param bufferCount The number of receive buffers, a power of 2.
+     * @param bufferSize The size of each receive buffer.
+     */
+    MultishotReceiver(EventLoop &_loop, TcpStream &_stream, unsigned bufferCount = 64, size_t bufferSize = 16 * 1024)
+        : loop{_loop}, stream{&_stream}, socket{nullptr}, fd{_stream.getSocketFd()}
+    {
+        init(bufferCount, bufferSize, AsyncIo::canUseRing(_stream));
+    }
+
+    /**
+     * @brief Create a receiver for a bound UdpSocket. Every ReceivedBuffer
+     * holds one packet. Packets that don't fit into a buffer are truncated
+     * and marked with ReceivedBuffer::truncated. With io_uring, the buffer
+     * also holds a header and the sender address, so 44 bytes less than
+     * the buffer size are left for the payload.
+     *
+     * @see MultishotReceiver(EventLoop&, TcpStream&, unsigned, size_t)
+     */
+    MultishotReceiver(EventLoop &_loop, UdpSocket &_socket, unsigned bufferCount = 64, size_t bufferSize = 2048)
+        : loop{_loop}, stream{nullptr}, socket{&_socket}, fd{_socket.getSocketFd()}
+    {
+        init(bufferCount, bufferSize, fd > 0);
+    }
+
+    /**
+     * @brief Cancel the multishot recv and release the buffers.
+     */
+    ~MultishotReceiver() override
+    {
+        // Only a registered wait is canceled, the fd number may be reused by now
+        if (armed) loop.cancelOperation(*this);
+        else if (waitRegistered) loop.cancelWait(fd, *this);
+
+        loop.unschedule(*this);
+    }
+
+    MultishotReceiver(const MultishotReceiver &other) = delete;
+    MultishotReceiver& operator=(const MultishotReceiver &other) = delete;
+
+    /**
+     * @brief Wait for the next received data with `co_await receiver.next()`.
+     * For TcpStreams, a ReceivedBuffer with size 0 is returned once the
+     * connection is closed. For UdpSockets, size 0 is an empty packet and
+     * not the end of the data.
+     *
+     * If receiving failed, an exception is thrown.
+     */
+    NextAwaitable next()
+    {
+        return NextAwaitable{*this};
+    }
+
+    /**
+     * @brief Give the buffer of received data back, so that it can be used
+     * for new data. The data must not be used afterwards.
+     */
+    void release(ReceivedBuffer &buf)
+    {
+        if (buf.bufferId < 0) return;
+
+        buffers->recycle((uint16_t)buf.bufferId);
+        held--;
+
+        buf.bufferId = -1;
+        buf.data = nullptr;
+        buf.size = 0;
+    }
+
+    /**
+     * @brief Check if the io_uring multishot recv is used.
+     */
+    bool isMultishot() const
+    {
+        return ringMode;
+    }
+
+    /**
+     * @brief Get the number of buffers that were received and not released.
+     */
+    unsigned getHeld() const
+    {
+        return held;
+    }
+
+    void notify(uint32_t) override
+    {
+        readable = true;
+        waitRegistered = false;
+        scheduleResume();
+    }
+
+    void complete(int32_t result, uint32_t flags) override
+    {
+        if (!(flags & IORING_CQE_F_MORE)) armed = false;
+
+        if (result >= 0)
+        {
+            addCompletion(result, flags);
+        }
+        else if ((result == -EINVAL || result == -ENOBUFS) && held == 0 && pending.empty())
+        {
+            // Multishot recv or the buffer ring is not supported by this 
+            // kernel, since all buffers are provided
+            useFallback();
+        }
+        else if (result == -ENOBUFS)
+        {
+            // All buffers are in use, the recv is armed again once the
+            // coroutine waits. Waiting can't help if the caller holds all
+            // buffers
+            if (held == buffers->getEntries() && pending.empty() && !error)
+                error = std::make_error_code(std::errc::no_buffer_space);
+        }
+        else if (result != -ECANCELED && !error)
+        {
+            recordReceive(-1);
+            error = std::error_code{-result, std::system_category()};
+            if (stream != nullptr) stream->close();
+        }
+
+        scheduleResume();
+    }
+
+    void resume() override
+    {
+        resumeScheduled = false;
+        if (!handle) return;
+
+        if (!isReady())
+        {
+            if (ringMode)
+            {
+                if (!armed) arm();
+                return;
+            }
+
+            if (readable) receiveReady();
+            readable = false;
+
+            if (!isReady())
+            {
+                waitReady();
+                return;
+            }
+        }
+
+        std::coroutine_handle<> waiting = handle;
+        handle = nullptr;
+        waiting.resume();
+    }
+};
+
+
+} // namespace netlib
+
+#endif // __cpp_impl_coroutine
+
+#endif // _MULTISHOT_HPP
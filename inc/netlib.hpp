@@ -14,5 +14,22 @@
 #include "udpsocket.hpp"
 #include "resolver.hpp"
 #include "sockcopy.hpp"
+#include "sockoptions.hpp"
+#include "bytebuffer.hpp"
+#include "bufferedwriter.hpp"
+#include "relay.hpp"
+#include "framecodec.hpp"
+#include "linescanner.hpp"
+#include "linereader.hpp"
+#include "transportinfo.hpp"
+#include "transportsampler.hpp"
+#include "iostats.hpp"
+#include "adaptivereader.hpp"
+#include "zerocopyreceiver.hpp"
+#include "iouring.hpp"
+#include "eventloop.hpp"
+#include "async.hpp"
+#include "bufferring.hpp"
+#include "multishot.hpp"
 
 #endif // _NETLIB_HPP
\ No newline at end of file
@@ -0,0 +1,56 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#ifndef _PIPE_HPP
+#define _PIPE_HPP
+
+#include <unistd.h>
+
+namespace netlib
+{
+
+/**
+ * @brief Wrapper around the two file descriptors of a pipe. The pipe is used as the in-kernel
+ * buffer when moving data between sockets and files with splice. If this object is dropped 
+ * (destroyed), both ends of the pipe are closed.
+ * 
+ * @note This is an internal wrapper class and is not indended to be used directly.
+ */
+class Pipe
+{
+public:
+    int readfd = -1;
+    int writefd = -1;
+
+    /**
+     * @brief Create a new pipe. If the pipe can't be created, an exception is thrown.
+     */
+    Pipe();
+
+    ~Pipe();
+
+    Pipe(const Pipe &other) = delete;
+    Pipe& operator=(const Pipe &other) = delete;
+
+    /**
+     * @brief Move up to len bytes from fd into the pipe.
+     * 
+     * @return The number of bytes moved, 0 on EOF or -1 on error.
+     */
+    ssize_t spliceFrom(int fd, size_t len, unsigned int flags);
+
+    /**
+     * @brief Move up to len bytes from the pipe into fd.
+     * 
+     * @return The number of bytes moved or -1 on error.
+     */
+    ssize_t spliceTo(int fd, size_t len, unsigned int flags);
+
+};
+
+}
+
+#endif // _PIPE_HPP
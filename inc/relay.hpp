@@ -0,0 +1,94 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#ifndef _RELAY_HPP
+#define _RELAY_HPP
+
+#include <atomic>
+#include <cstdint>
+
+#include "tcpstream.hpp"
+
+namespace netlib
+{
+
+
+/**
+ * @brief The Relay forwards all data between two connected TcpStreams in both
+ * directions, until both sides have finished sending.
+ * 
+ * On plain tcp connections the data is moved with splice through a pipe, so 
+ * the relayed bytes never leave the kernel. If one of the streams uses TLS, 
+ * the data is copied through a user space buffer instead. Both streams are 
+ * in non-blocking mode while the relay runs, so a peer that stops reading 
+ * only stalls its own direction.
+ * 
+ * When one side stops sending (EOF), the write side of the other connection 
+ * is shut down, so that the half-close is propagated through the relay.
+ */
+class Relay
+{
+private:
+
+    /**
+     * @brief The first stream of the relay.
+     */
+    TcpStream &a;
+
+    /**
+     * @brief The second stream of the relay.
+     */
+    TcpStream &b;
+
+    /**
+     * @brief The number of bytes that were relayed from a to b.
+     */
+    std::atomic<uint64_t> bytesAToB{0};
+
+    /**
+     * @brief The number of bytes that were relayed from b to a.
+     */
+    std::atomic<uint64_t> bytesBToA{0};
+
+public:
+
+    /**
+     * @brief Create a Relay between the two given streams. Both streams must 
+     * be connected and must outlive the Relay.
+     */
+    Relay(TcpStream &a, TcpStream &b);
+
+    Relay(const Relay &other) = delete;
+    Relay& operator=(const Relay &other) = delete;
+
+    /**
+     * @brief Forward data between the streams until both directions reached 
+     * EOF. This blocks the calling thread for the lifetime of the relayed 
+     * connection. The streams are not closed when this returns, and their 
+     * blocking mode is restored.
+     * 
+     * If relaying fails, an exception is thrown.
+     */
+    void run();
+
+    /**
+     * @brief Get the number of bytes that were relayed from a to b so far. 
+     * This can be called from other threads while the relay is running.
+     */
+    uint64_t getBytesAToB() const;
+
+    /**
+     * @brief Get the number of bytes that were relayed from b to a so far. 
+     * This can be called from other threads while the relay is running.
+     */
+    uint64_t getBytesBToA() const;
+
+};
+
+
+} // namespace netlib
+
+#endif // _RELAY_HPP
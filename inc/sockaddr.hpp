@@ -141,6 +141,7 @@ public:
     friend class TcpStream;
     friend class TcpListener;
     friend class UdpSocket;
+    friend class AsyncIo;
 
 };
 
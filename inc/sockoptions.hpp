@@ -0,0 +1,184 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#ifndef _SOCKOPTIONS_HPP
+#define _SOCKOPTIONS_HPP
+
+#include <optional>
+#include <system_error>
+
+namespace netlib
+{
+
+
+/**
+ * @brief SockOptions is a set of socket options that can be applied to 
+ * TcpStream, TcpListener and UdpSocket. Only the options that were explicitly
+ * set are applied, all other options keep the system defaults.
+ * 
+ * The setters return a reference to the SockOptions, so that they can be 
+ * chained. Example: SockOptions().setNoDelay(true).setSendBufferSize(1 << 20)
+ * 
+ * @note The TCP options (TCP_*) can't be applied to a UdpSocket.
+ */
+class SockOptions
+{
+private:
+
+    /** @brief TCP_NODELAY: Disable the nagle algorithm */
+    std::optional<bool> noDelay;
+
+    /** @brief TCP_QUICKACK: Send ACKs immediately */
+    std::optional<bool> quickAck;
+
+    /** @brief TCP_NOTSENT_LOWAT: Limit for unsent bytes in the socket buffer */
+    std::optional<int> notSentLowat;
+
+    /** @brief SO_SNDBUF: Size of the send buffer in bytes */
+    std::optional<int> sendBufferSize;
+
+    /** @brief SO_RCVBUF: Size of the receive buffer in bytes */
+    std::optional<int> receiveBufferSize;
+
+    /** @brief SO_KEEPALIVE: Send keepalive probes */
+    std::optional<bool> keepAlive;
+
+    /** @brief TCP_KEEPIDLE: Idle seconds before the first keepalive probe */
+    std::optional<int> keepAliveIdle;
+
+    /** @brief TCP_KEEPINTVL: Seconds between keepalive probes */
+    std::optional<int> keepAliveInterval;
+
+    /** @brief TCP_KEEPCNT: Number of unanswered probes before the connection is dropped */
+    std::optional<int> keepAliveCount;
+
+    /** @brief SO_BUSY_POLL: Microseconds to busy poll on blocking receives */
+    std::optional<int> busyPoll;
+
+    /** @brief TCP_FASTOPEN: Length of the queue for fast open connections on a listener */
+    std::optional<int> fastOpen;
+
+    /** @brief TCP_FASTOPEN_CONNECT: Send the first data of a connection with the SYN */
+    std::optional<bool> fastOpenConnect;
+
+    /** @brief SO_REUSEADDR: Allow binding to addresses in TIME_WAIT */
+    std::optional<bool> reuseAddress;
+
+    /** @brief SO_REUSEPORT: Allow multiple sockets to bind the same port */
+    std::optional<bool> reusePort;
+
+public:
+
+    /**
+     * @brief Enable or disable TCP_NODELAY. If enabled, small writes are sent
+     * immediately instead of being delayed by the nagle algorithm.
+     */
+    SockOptions & setNoDelay(bool noDelay);
+
+    /**
+     * @brief Enable or disable TCP_QUICKACK. If enabled, ACKs are sent 
+     * immediately instead of being delayed.
+     * 
+     * @note The kernel can reset this option on its own, so it might have to 
+     * be set again after reads.
+     */
+    SockOptions & setQuickAck(bool quickAck);
+
+    /**
+     * @brief Set TCP_NOTSENT_LOWAT. The socket is only reported as writable 
+     * if less than bytes unsent bytes are queued, which limits the latency 
+     * added by the send buffer.
+     */
+    SockOptions & setNotSentLowat(int bytes);
+
+    /**
+     * @brief Set the size of the send buffer (SO_SNDBUF) in bytes. The kernel
+     * doubles the value internally.
+     */
+    SockOptions & setSendBufferSize(int bytes);
+
+    /**
+     * @brief Set the size of the receive buffer (SO_RCVBUF) in bytes. The 
+     * kernel doubles the value internally. For TcpStreams this should be set
+     * before connecting, so that the window scaling can take it into account.
+     */
+    SockOptions & setReceiveBufferSize(int bytes);
+
+    /**
+     * @brief Enable or disable SO_KEEPALIVE.
+     */
+    SockOptions & setKeepAlive(bool keepAlive);
+
+    /**
+     * @brief Enable SO_KEEPALIVE and configure the keepalive probes.
+     * 
+     * @param idleSec The number of idle seconds before the first probe is 
+     * sent (TCP_KEEPIDLE).
+     * @param intervalSec The number of seconds between probes 
+     * (TCP_KEEPINTVL).
+     * @param count The number of unanswered probes before the connection is
+     * dropped (TCP_KEEPCNT).
+     */
+    SockOptions & setKeepAlive(int idleSec, int intervalSec, int count);
+
+    /**
+     * @brief Set SO_BUSY_POLL, the number of microseconds to busy poll the 
+     * device queue on blocking receives.
+     */
+    SockOptions & setBusyPoll(int microseconds);
+
+    /**
+     * @brief Enable TCP Fast Open on a TcpListener by setting TCP_FASTOPEN. 
+     * Clients with a valid fast open cookie can then send their first 
+     * request with the SYN, which saves one round trip. This is only 
+     * effective if server side fast open is enabled in the 
+     * net.ipv4.tcp_fastopen sysctl.
+     * 
+     * @param queueLength The maximum number of pending fast open connections
+     * that have not completed the handshake yet. 0 disables fast open.
+     */
+    SockOptions & setFastOpen(int queueLength);
+
+    /**
+     * @brief Enable or disable TCP Fast Open for a TcpStream by setting 
+     * TCP_FASTOPEN_CONNECT. If a fast open cookie for the remote is cached, 
+     * TcpStream::connect returns without waiting for the handshake and the 
+     * data of the first send is attached to the SYN. Without cookie, a normal
+     * handshake is done and a cookie is requested for the next connection.
+     */
+    SockOptions & setFastOpenConnect(bool fastOpenConnect);
+
+    /**
+     * @brief Enable or disable SO_REUSEADDR.
+     */
+    SockOptions & setReuseAddress(bool reuseAddress);
+
+    /**
+     * @brief Enable or disable SO_REUSEPORT.
+     */
+    SockOptions & setReusePort(bool reusePort);
+
+    /**
+     * @brief Apply all options that were set to the socket sockfd. Applying 
+     * stops at the first option that fails.
+     * 
+     * @param sockfd The socket file descriptor.
+     * @param ec Set to the error of the failed option, or cleared on success.
+     */
+    void apply(int sockfd, std::error_code &ec) const noexcept;
+
+    /**
+     * @brief Same as apply(int, std::error_code&) but an exception is thrown 
+     * if an option can't be set.
+     */
+    void apply(int sockfd) const;
+
+};
+
+
+} // namespace netlib
+
+#endif // _SOCKOPTIONS_HPP
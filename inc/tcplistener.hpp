@@ -9,12 +9,16 @@
 
 #include "sockaddr.hpp"
 #include "tcpstream.hpp"
+#include "sockoptions.hpp"
 
 #include <filesystem>
+#include <system_error>
 
 namespace netlib
 {
 
+class AcceptAwaitable;
+
 
 /**
  * @brief Listen to a local ip address + port and accept incomming connections 
@@ -40,6 +44,29 @@ private:
      */
     bool autoclose = true;
 
+    /**
+     * @brief If set to true, the listening socket and all accepted streams 
+     * are in non-blocking mode.
+     */
+    bool nonBlocking = false;
+
+    /**
+     * @brief The socket options that are applied to the listening socket.
+     */
+    SockOptions options;
+
+    /**
+     * @brief The socket options that are applied to every accepted stream.
+     */
+    SockOptions streamOptions;
+
+    /**
+     * @brief Create the TcpStream for an accepted socket and apply the stream
+     * options. On errors, the socket is closed and an empty stream is 
+     * returned.
+     */
+    TcpStream acceptedStream(int sockfd, SockAddr::RawSockAddr &remote, std::error_code &ec) noexcept;
+
 public:
 
     /**
@@ -99,6 +126,8 @@ public:
      * This does not yet block and accept clients.
      * 
      * This will create the socket, bind it to the socket address and listen.
+     * To accept TCP Fast Open connections, SockOptions::setFastOpen has to be
+     * set with TcpListener::setOptions before calling listen.
      * 
      * @param connectionQueue The number of connections that will be queued 
      * before refusing new connections.
@@ -108,10 +137,70 @@ public:
     /**
      * @brief Block until a tcp connection is accepted. 
      * 
+     * In non-blocking mode this does not block. If no connection is pending,
+     * a closed TcpStream is returned, which can be checked with 
+     * TcpStream::isClosed.
+     * 
      * @return The TcpStream associated with the accepted connection.
      */
     TcpStream accept();
 
+    /**
+     * @brief Same as TcpListener::accept but errors are reported through ec 
+     * instead of exceptions. In non-blocking mode, ec is set to 
+     * std::errc::operation_would_block if no connection is pending.
+     * 
+     * @return The TcpStream associated with the accepted connection, or a 
+     * closed TcpStream if ec is set.
+     */
+    TcpStream accept(std::error_code &ec) noexcept;
+
+    /**
+     * @brief Enable or disable the non-blocking mode. This can be set before
+     * listening or on an open listener. In non-blocking mode, the accepted 
+     * streams are created in non-blocking mode as well.
+     * 
+     * @param nonBlocking Enable or disable the non-blocking mode.
+     */
+    void setNonBlocking(bool nonBlocking);
+
+    /**
+     * @brief Check if the non-blocking mode is enabled.
+     */
+    bool isNonBlocking() const;
+
+    /**
+     * @brief Set the socket options of the listening socket. The options are
+     * applied immediately if the listener is open, and every time listen 
+     * creates a new socket, before it is bound. This replaces the previously 
+     * set options.
+     * 
+     * If an option can't be applied, an exception is thrown.
+     * 
+     * @param options The socket options that will be applied.
+     */
+    void setOptions(const SockOptions &options);
+
+    /**
+     * @brief Set the default socket options for all streams that are 
+     * accepted by this listener. Streams that are already accepted are not 
+     * changed.
+     * 
+     * @param options The socket options that will be applied to accepted 
+     * streams.
+     */
+    void setStreamOptions(const SockOptions &options);
+
+    /**
+     * @brief Get the raw file descriptor of the socket, for example to 
+     * register it in an event loop. The file descriptor is still owned by 
+     * the TcpListener and must not be closed.
+     * 
+     * @return The socket file descriptor, or 0 if the socket is closed.
+     */
+    int getSocketFd() const;
+
+
     /**
      * @brief Check if the listener socket is closed or open. Open in this case 
      * means bound and listening.
@@ -147,6 +236,18 @@ public:
      */
     TcpListener clone() const;
 
+    /**
+     * @brief Accept a connection like TcpListener::accept from a coroutine, 
+     * with `co_await listener.asyncAccept()`. The coroutine is suspended and
+     * resumed by the current EventLoop once a connection is pending. This 
+     * requires C++20 and async.hpp.
+     * 
+     * If accepting fails, an exception is thrown.
+     */
+    AcceptAwaitable asyncAccept();
+
+    friend class AsyncIo;
+
 };
 
 
@@ -8,6 +8,12 @@
 #define _TCPSOCKETWRAPPER_HPP
 
 #include <unistd.h>
+#include <sys/uio.h>
+#include <cstdint>
+#include <atomic>
+
+#include "iostats.hpp"
+#include "timeoutmode.hpp"
 
 #ifdef NETLIB_SSL
 #include <openssl/ssl.h>
@@ -28,6 +34,42 @@ class TcpSocketWrapper
 public:
     int sockfd;
 
+    /**
+     * @brief True if SO_ZEROCOPY is enabled on the socket.
+     */
+    bool zerocopy = false;
+
+    /**
+     * @brief Writes smaller than this are copied even if zerocopy is enabled.
+     */
+    size_t zerocopyThreshold = 0;
+
+    /**
+     * @brief The number of send calls that used MSG_ZEROCOPY so far.
+     */
+    uint64_t zerocopyIssued = 0;
+
+    /**
+     * @brief The number of MSG_ZEROCOPY sends for which the kernel released the buffers.
+     */
+    uint64_t zerocopyCompleted = 0;
+
+    /**
+     * @brief The number of completed MSG_ZEROCOPY sends where the kernel copied the data anyways.
+     */
+    uint64_t zerocopyCopied = 0;
+
+    /**
+     * @brief The I/O counters of the connection, only updated if NETLIB_INSTRUMENT is enabled.
+     */
+    mutable SocketIoCounters ioCounters;
+
+    /**
+     * @brief The receive timeout that is currently set with SO_RCVTIMEO. Since all clones of a 
+     * TcpStream share the wrapper, they also share this cache.
+     */
+    RecvTimeout recvTimeout;
+
 #ifdef NETLIB_SSL
 
     SSL *ssl = nullptr;
@@ -63,6 +105,89 @@ public:
      */
     ssize_t read(void *data, size_t len) const;
 
+    /**
+     * @brief Same as TcpSocketWrapper::write, but never blocks, even if the socket is in 
+     * blocking mode. With SSL, the socket is switched to non-blocking mode for the SSL_write 
+     * and switched back afterwards. If SSL_write reports EAGAIN, it must be repeated with the 
+     * same arguments once retryEvents are ready.
+     * 
+     * @note This does not check if the wrapped socket is valid or not!
+     */
+    ssize_t writeNonBlocking(const void *data, size_t len) const;
+
+    /**
+     * @brief Same as TcpSocketWrapper::read, but never blocks, even if the socket is in 
+     * blocking mode. With SSL, already decrypted data is returned directly, otherwise the 
+     * socket is switched to non-blocking mode for the SSL_read like for writeNonBlocking.
+     * 
+     * @note This does not check if the wrapped socket is valid or not!
+     */
+    ssize_t readNonBlocking(void *data, size_t len) const;
+
+    /**
+     * @brief Get the poll events that have to be waited for, before an operation that failed 
+     * with EAGAIN is repeated. With SSL, a read may have to wait for POLLOUT and a write for 
+     * POLLIN, for example during a renegotiation. Otherwise events is returned.
+     */
+    short retryEvents(short events) const;
+
+    /**
+     * @brief Same as TcpSocketWrapper::read, but plain sockets use MSG_WAITALL so that the 
+     * kernel only returns once len bytes are received, the connection is closed or a signal 
+     * interrupts the call. SSL_read returns at most one record at a time.
+     * 
+     * @note This does not check if the wrapped socket is valid or not!
+     */
+    ssize_t readWaitAll(void *data, size_t len) const;
+
+    /**
+     * @brief Call either recv with MSG_PEEK or SSL_peek on the underlying connection, depending 
+     * on whether the ssl context is set, or not. The data stays in the receive queue.
+     * 
+     * @note This does not check if the wrapped socket is valid or not!
+     */
+    ssize_t peek(void *data, size_t len) const;
+
+    /**
+     * @brief Get the number of bytes that can be read without blocking. With SSL, this is the 
+     * number of decrypted bytes plus the number of raw bytes in the socket receive queue, 
+     * which includes the TLS record overhead.
+     * 
+     * @note This does not check if the wrapped socket is valid or not!
+     * 
+     * @return The number of available bytes, or -1 if the query failed.
+     */
+    ssize_t available() const;
+
+    /**
+     * @brief Call either writev or SSL_write on the underlying connection, depending on whether 
+     * the ssl context is set, or not. Since SSL has no vectored write, small buffers are gathered
+     * into a single TLS record, larger ones are written one entry at a time.
+     * 
+     * @note This does not check if the wrapped socket is valid or not!
+     */
+    ssize_t writev(const iovec *buffers, int count) const;
+
+    /**
+     * @brief Call either readv or SSL_read on the underlying connection, depending on whether 
+     * the ssl context is set, or not. With SSL the entries are filled one after another as long
+     * as decrypted data is pending.
+     * 
+     * @note This does not check if the wrapped socket is valid or not!
+     */
+    ssize_t readv(const iovec *buffers, int count) const;
+
+    /**
+     * @brief Read all pending zerocopy completion notifications from the socket error queue 
+     * without blocking and update the zerocopy counters.
+     * 
+     * @note TCP completes the zerocopy sends in order, so only the highest completed id is
+     * tracked. Ranges that end at or before it are ignored.
+     * 
+     * @return False if reading the error queue failed.
+     */
+    bool processZerocopyNotifications();
+
     /**
      * @brief Returns true if the underlying socketfd is set to something other than 0. This
      * does not check if the connection is broken.
@@ -76,6 +201,75 @@ public:
 
 };
 
+/**
+ * @brief Owner of a TcpSocketWrapper that avoids a heap allocation per connection. The wrapper 
+ * is stored inline as long as only one owner exists. The first call to share() moves it into a
+ * heap block with an intrusive reference count, which is then used by all sharing owners. The 
+ * wrapper is destroyed (and the connection closed) when the last owner is dropped.
+ * 
+ * @note The first share() moves the wrapper, so it must not run concurrently with I/O on the 
+ * same owner. Share before handing the owner to other threads. Concurrent calls to share() are 
+ * safe. References to the wrapper must not be kept across a share(), keep a reference to the 
+ * handle instead.
+ * 
+ * @note This is an internal wrapper class and is not indended to be used directly.
+ */
+class TcpSocketHandle
+{
+private:
+
+    /**
+     * @brief The heap block that is used once the wrapper is shared.
+     */
+    struct Shared
+    {
+        TcpSocketWrapper socket;
+        std::atomic<size_t> refs;
+    };
+
+    /**
+     * @brief The wrapper that is used while it is not shared. It is moved into the shared 
+     * block by share(), which is why it is mutable.
+     */
+    mutable TcpSocketWrapper local;
+
+    /**
+     * @brief The shared heap block, or nullptr if the local wrapper is used.
+     */
+    mutable std::atomic<Shared*> shared{nullptr};
+
+    /**
+     * @brief Drop the reference to the shared block, or close the local wrapper.
+     */
+    void release();
+
+public:
+
+    TcpSocketHandle();
+    TcpSocketHandle(int sockfd);
+
+    ~TcpSocketHandle();
+
+    TcpSocketHandle(TcpSocketHandle &&other);
+    TcpSocketHandle& operator=(TcpSocketHandle &&other);
+
+    TcpSocketHandle(const TcpSocketHandle &other) = delete;
+    TcpSocketHandle& operator=(const TcpSocketHandle &other) = delete;
+
+    /**
+     * @brief Create another owner of the same wrapper. On the first call, the wrapper is moved 
+     * into a shared heap block.
+     */
+    TcpSocketHandle share() const;
+
+    TcpSocketWrapper * operator->();
+    const TcpSocketWrapper * operator->() const;
+
+    TcpSocketWrapper & operator*();
+    const TcpSocketWrapper & operator*() const;
+
+};
+
 }
 
 #endif // _TCPSOCKETWRAPPER_HPP
\ No newline at end of file
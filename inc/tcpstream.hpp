@@ -9,13 +9,31 @@
 
 #include <string>
 #include <memory>
+#include <system_error>
+#include <chrono>
+
+#include <sys/uio.h>
 
 #include "sockaddr.hpp"
 #include "tcpsocketwrapper.hpp"
+#include "sockoptions.hpp"
+#include "bytebuffer.hpp"
+#include "transportinfo.hpp"
+#include "timeoutmode.hpp"
 
 namespace netlib
 {
 
+class ReadAwaitable;
+class SendAllAwaitable;
+class ConnectAwaitable;
+
+
+/**
+ * @brief An absolute point in time at which an operation times out.
+ */
+using Deadline = std::chrono::steady_clock::time_point;
+
 
 /**
  * @brief The TcpStream represents tcp a connection with another endpoint and is
@@ -34,15 +52,68 @@ private:
 
     /**
      * @brief The filedescriptor of the current socket. If this socket wrapper is marked
-     * as invalid, the connection is considered closed.
+     * as invalid, the connection is considered closed. The wrapper is stored inline until 
+     * the stream is cloned, then all clones share the same wrapper.
      */
-    std::shared_ptr<TcpSocketWrapper> socket;
+    TcpSocketHandle socket;
 
     /**
      * @brief If set to true, the socket is automatically closed on destruction
      */
     bool autoclose = true;
 
+    /**
+     * @brief If set to true, the socket is in non-blocking mode.
+     */
+    bool nonBlocking = false;
+
+    /**
+     * @brief The socket options that are applied when the socket is created.
+     */
+    SockOptions options;
+
+    /**
+     * @brief The way that the timed read functions wait for data.
+     */
+    TimeoutMode timeoutMode = TimeoutMode::Poll;
+
+    /**
+     * @brief Receive data once, waiting at most timeoutMs for it according 
+     * to the timeout mode. On errors the stream is closed and an exception is
+     * thrown.
+     * 
+     * @param timedOut Set to true if -1 is returned because the timeout was 
+     * reached. If -1 is returned and this is false, the socket was reported 
+     * as readable without data being available.
+     * 
+     * @return The number of bytes received, or -1.
+     */
+    ssize_t readTimed(void *data, size_t len, int timeoutMs, bool &timedOut);
+
+    /**
+     * @brief Block until the socket is ready for the given poll events. This is used to keep 
+     * the "All" functions working in non-blocking mode.
+     * 
+     * @return False if polling failed, errno is set in that case.
+     */
+    bool waitReady(short events) noexcept;
+
+    /**
+     * @brief Block until the socket is ready for the given poll events, or until the deadline
+     * is reached.
+     * 
+     * @return 1 if the socket is ready, 0 if the deadline was reached, -1 if polling failed.
+     */
+    int waitReady(short events, Deadline deadline) noexcept;
+
+    /**
+     * @brief Create the socket and connect it to the remote. If nonBlockingConnect is set, the
+     * socket is created in non-blocking mode and the connect is not awaited.
+     * 
+     * @return True if the connection is established, false if the connect is still in progress.
+     */
+    bool connectSocket(bool nonBlockingConnect);
+
     /**
      * @brief Check if the underlying socket filedescriptor is set to non-zero. This is currently
      * the same as !isClosed(), but the isClosed() function might be extended to verify that the
@@ -118,12 +189,141 @@ public:
 
     /**
      * @brief Connect to the remote socket address specified in the constructor.
+     * 
+     * If SockOptions::setFastOpenConnect is set and a fast open cookie is 
+     * cached for the remote, this returns without waiting for the handshake
+     * and the first sent data is attached to the SYN.
+     * 
+     * In non-blocking mode this does not wait for the connection to be 
+     * established. The connect is completed once the socket becomes writable,
+     * which can be checked with TcpStream::finishConnect.
      */
     void connect();
 
+    /**
+     * @brief Connect to the remote socket address specified in the 
+     * constructor, but fail if the connection is not established within the
+     * timeout. This prevents blocking for the full SYN retry period of the 
+     * kernel if the remote is unreachable.
+     * 
+     * If connecting fails or the timeout is reached, the socket is closed 
+     * and an exception is thrown. For timeouts the exception is a 
+     * std::system_error with the code std::errc::timed_out.
+     * 
+     * @param timeoutMs The number of milliseconds before a timeout occurs. 
+     * If this is 0 or negative, this is the same as TcpStream::connect().
+     */
+    void connect(int timeoutMs);
+
+    /**
+     * @brief Same as TcpStream::connect(int) but the connection must be 
+     * established before the given deadline.
+     * 
+     * @param deadline The point in time when a timeout occurs.
+     */
+    void connectDeadline(Deadline deadline);
+
+    /**
+     * @brief Start connecting to the remote socket address specified in the 
+     * constructor without waiting for the connection to be established. This
+     * works in blocking and non-blocking mode. The socket becomes writable 
+     * once the connect is done, which can then be completed with 
+     * TcpStream::finishConnect.
+     * 
+     * If the connect fails immediately, an exception is thrown.
+     * 
+     * @return True if the connection was established immediately, false if 
+     * the connect is still in progress.
+     */
+    bool startConnect();
+
+    /**
+     * @brief Check if a connect that was started in non-blocking mode or by 
+     * TcpStream::startConnect has completed. This does not block. After the 
+     * connect has completed, the configured blocking mode is restored.
+     * 
+     * If the connect failed, the socket is closed and an exception is thrown.
+     * 
+     * @return True if the connection is established, false if the connect is
+     * still in progress.
+     */
+    bool finishConnect();
+
+    /**
+     * @brief Enable or disable the non-blocking mode. This can be set before
+     * connecting or on an open connection.
+     * 
+     * In non-blocking mode, TcpStream::send, TcpStream::read and 
+     * TcpStream::readv return -1 instead of blocking, if the operation can't
+     * be completed immediately. The connection stays open in that case. 
+     * Functions that have to transfer all data, like TcpStream::sendAll or 
+     * TcpStream::readAll, still wait until they are done.
+     * 
+     * @param nonBlocking Enable or disable the non-blocking mode.
+     */
+    void setNonBlocking(bool nonBlocking);
+
+    /**
+     * @brief Check if the non-blocking mode is enabled.
+     */
+    bool isNonBlocking() const;
+
+    /**
+     * @brief Set the socket options of this stream. The options are applied 
+     * immediately if the stream is connected, and every time a new socket is
+     * created by connecting. This replaces the previously set options.
+     * 
+     * If an option can't be applied, an exception is thrown.
+     * 
+     * @param options The socket options that will be applied.
+     */
+    void setOptions(const SockOptions &options);
+
+    /**
+     * @brief Get the socket options that are applied to this stream.
+     */
+    const SockOptions & getOptions() const;
+
+    /**
+     * @brief Set the way that TcpStream::readTimeout and 
+     * TcpStream::readAllTimeout wait for data. The default is 
+     * TimeoutMode::Poll.
+     * 
+     * With TimeoutMode::Kernel, the receive timeout stays set on the socket
+     * after a timed read. Reads without timeout still block until data is 
+     * available.
+     * 
+     * @param mode The timeout mode that will be used.
+     */
+    void setTimeoutMode(TimeoutMode mode);
+
+    /**
+     * @brief Get the way that the timed read functions wait for data.
+     */
+    TimeoutMode getTimeoutMode() const;
+
+    /**
+     * @brief Get the raw file descriptor of the socket, for example to 
+     * register it in an event loop. The file descriptor is still owned by 
+     * the TcpStream and must not be closed.
+     * 
+     * @return The socket file descriptor, or 0 if the socket is closed.
+     */
+    int getSocketFd() const;
+
+    /**
+     * @brief Get the number of I/O calls and bytes of this socket so far. 
+     * The counters are only updated if netlib is built with 
+     * NETLIB_INSTRUMENT, otherwise they are always 0.
+     * 
+     * @see IoStats
+     */
+    IoCounters getIoCounters() const;
+
 #ifdef NETLIB_SSL
     /**
      * @brief Connect to the remote socket address specified in the constructor using TLS.
+     * The TLS handshake is always blocking, so this can't be used in non-blocking mode.
      */
     void connect(SSL_CTX *ctx);
 #endif // NETLIB_SSL
@@ -147,10 +347,22 @@ public:
      * connection.
      *  
      * @return The number of bytes that were actually sent over the connection.
-     * This can be less than len.
+     * This can be less than len. In non-blocking mode -1 is returned if no 
+     * data can be sent without blocking.
      */
     ssize_t send(const void *data, size_t len);
 
+    /**
+     * @brief Same as TcpStream::send but errors are reported through ec 
+     * instead of exceptions. In non-blocking mode, ec is set to 
+     * std::errc::operation_would_block if no data can be sent without 
+     * blocking. On all other errors the connection is closed.
+     * 
+     * @return The number of bytes that were actually sent over the connection,
+     * or -1 if ec is set.
+     */
+    ssize_t send(const void *data, size_t len, std::error_code &ec) noexcept;
+
     /**
      * @brief Send exactly len bytes of data into the tcp connection.
      * 
@@ -164,6 +376,12 @@ public:
      */
     void sendAll(const void *data, size_t len);
 
+    /**
+     * @brief Same as TcpStream::sendAll but errors are reported through ec 
+     * instead of exceptions. On errors the connection is closed.
+     */
+    void sendAll(const void *data, size_t len, std::error_code &ec) noexcept;
+
     /**
      * @brief Send the given string data over the tcp connection. The function 
      * send all chars of the given string.
@@ -174,6 +392,141 @@ public:
      */
     void sendAllString(const std::string &str);
 
+    /**
+     * @brief Same as TcpStream::sendAll but the data must be sent before the 
+     * given deadline. A peer that does not read can't block the caller for
+     * longer than that.
+     * 
+     * If sending fails, an exception is thrown.
+     * 
+     * @param data Pointer to at least len bytes that will be sent over the 
+     * tcp connection.
+     * @param len The number of bytes that will be sent over the tcp connection.
+     * @param deadline The point in time when a timeout occurs.
+     * 
+     * @return len if all data was sent. If the deadline is reached, the number
+     * of bytes sent until then is returned as negative.
+     */
+    ssize_t sendAllDeadline(const void *data, size_t len, Deadline deadline);
+
+    /**
+     * @brief Send all bytes of count buffers over the tcp connection, in the 
+     * order in which they are given. This uses a single vectored write for 
+     * all buffers whenever possible, so that multiple buffers don't need to 
+     * be concatenated or sent with multiple calls to sendAll.
+     * 
+     * If sending fails, an exception is thrown.
+     * 
+     * @param buffers Pointer to count iovec structs that describe the data 
+     * that will be sent.
+     * @param count The number of iovec structs in buffers.
+     */
+    void sendAllv(const iovec *buffers, size_t count);
+
+    /**
+     * @brief Send exactly length bytes of the file fd, starting at offset, 
+     * over the tcp connection. On plain tcp connections this uses sendfile, 
+     * so the file data is never copied into user space. For TLS connections 
+     * the file is read in chunks and sent with sendAll.
+     * 
+     * The file offset of fd is not changed.
+     * 
+     * If sending fails or the file ends before length bytes are sent, an 
+     * exception is thrown.
+     * 
+     * @param fd The file descriptor of the file that will be sent.
+     * @param offset The position in the file from which sending starts.
+     * @param length The number of bytes that will be sent.
+     */
+    void sendFile(int fd, off_t offset, size_t length);
+
+    /**
+     * @brief Receive up to length bytes from the tcp connection and write 
+     * them to the file fd at its current file offset. On plain tcp 
+     * connections the data is moved with splice through a pipe, so it is 
+     * never copied into user space. For TLS connections the data is read 
+     * into a buffer and written from there.
+     * 
+     * Like TcpStream::readAll, this blocks until length bytes are received 
+     * or the connection is closed. 
+     * 
+     * If receiving or writing to the file fails, the connection is closed 
+     * and an exception is thrown.
+     * 
+     * @param fd The file descriptor of the file that the data is written to.
+     * @param length The number of bytes that will be received.
+     * 
+     * @return The number of bytes that were written to the file. This can be
+     * less than length if the connection is closed.
+     */
+    size_t receiveToFile(int fd, size_t length);
+
+    /**
+     * @brief Enable sending with MSG_ZEROCOPY for TcpStream::sendAllZerocopy. 
+     * The kernel then sends the data directly from the user buffer, instead 
+     * of copying it into the socket buffer. Since the page pinning and the 
+     * completion notifications are more expensive than copying small 
+     * buffers, writes smaller than minSize are still copied.
+     * 
+     * Zerocopy can't be used on TLS connections or if the kernel does not 
+     * support SO_ZEROCOPY. In that case false is returned and 
+     * sendAllZerocopy will always copy.
+     * 
+     * @param minSize The minimum number of bytes for a write to use zerocopy.
+     * 
+     * @return True if zerocopy was enabled.
+     */
+    bool enableZerocopy(size_t minSize = 16 * 1024);
+
+    /**
+     * @brief Send exactly len bytes of data into the tcp connection, using 
+     * MSG_ZEROCOPY if it is enabled and len is at least the configured 
+     * minimum size.
+     * 
+     * The data must not be modified or freed until the returned id is 
+     * reported as complete by TcpStream::isZerocopyComplete or 
+     * TcpStream::waitZerocopy. If the data was copied, the returned id is 
+     * always complete.
+     * 
+     * If sending fails, an exception is thrown.
+     * 
+     * @param data Pointer to at least len bytes that will be sent over the 
+     * tcp connection.
+     * @param len The number of bytes that will be sent over the tcp connection.
+     * 
+     * @return The completion id for the data buffer.
+     */
+    uint64_t sendAllZerocopy(const void *data, size_t len);
+
+    /**
+     * @brief Check if the kernel has released the buffer of the zerocopy 
+     * send with the given id. This reads the pending completion 
+     * notifications but does not block.
+     * 
+     * @param id The completion id returned by TcpStream::sendAllZerocopy.
+     * 
+     * @return True if the buffer may be reused.
+     */
+    bool isZerocopyComplete(uint64_t id);
+
+    /**
+     * @brief Block until the kernel has released the buffer of the zerocopy 
+     * send with the given id, or until the timeout is reached.
+     * 
+     * After the connection was shut down in both directions or reported an 
+     * error, the notifications are checked periodically instead, since the 
+     * socket no longer blocks in poll.
+     * 
+     * If reading the completion notifications fails, an exception is thrown.
+     * 
+     * @param id The completion id returned by TcpStream::sendAllZerocopy.
+     * @param timeoutMs The total number of milliseconds before a timeout 
+     * occurs. A negative value waits without timeout.
+     * 
+     * @return True if the buffer may be reused, false if a timeout occured.
+     */
+    bool waitZerocopy(uint64_t id, int timeoutMs = -1);
+
     /**
      * @brief Receive a maximum of len bytes of data from the tcp connection. It 
      * is possible that less than len bytes are received. This call will block 
@@ -187,10 +540,22 @@ public:
      * tcp connection.
      *  
      * @return The number of bytes that were actually received over the 
-     * connection. This can be less than len.
+     * connection. This can be less than len. In non-blocking mode -1 is 
+     * returned if no data is available.
      */
     ssize_t read(void *data, size_t len);
 
+    /**
+     * @brief Same as TcpStream::read but errors are reported through ec 
+     * instead of exceptions. In non-blocking mode, ec is set to 
+     * std::errc::operation_would_block if no data is available. On all other
+     * errors the connection is closed.
+     * 
+     * @return The number of bytes that were actually received over the 
+     * connection, or -1 if ec is set.
+     */
+    ssize_t read(void *data, size_t len, std::error_code &ec) noexcept;
+
     /**
      * @brief Read exactly len bytes from the tcp stream. If the connection is
      * closed before len bytes are read, the number of bytes actually read is 
@@ -210,10 +575,102 @@ public:
      */
     ssize_t readAll(void *data, size_t len);
 
+    /**
+     * @brief Same as TcpStream::readAll but errors are reported through ec 
+     * instead of exceptions. On errors the connection is closed.
+     * 
+     * @return The number of bytes that were actually received over the 
+     * connection, or -1 if ec is set.
+     */
+    ssize_t readAll(void *data, size_t len, std::error_code &ec) noexcept;
+
+    /**
+     * @brief Receive exactly len bytes from the tcp connection. On plain 
+     * sockets this uses MSG_WAITALL, so the kernel only wakes the caller once
+     * all data is there instead of returning every partial segment. This is
+     * intended for messages with a known length.
+     * 
+     * If receiving fails or the connection is closed before len bytes were 
+     * received, an exception is thrown.
+     * 
+     * @param data Pointer to at least len bytes where the data received over  
+     * the tcp connection will be stored.
+     * @param len The number of bytes that will be received over the tcp 
+     * connection.
+     */
+    void readExact(void *data, size_t len);
+
+    /**
+     * @brief Receive data from the tcp connection until it is closed and 
+     * append it to buffer. The buffer grows geometrically, starting at 
+     * initialCapacity free bytes, and the new space is not zero-initialized.
+     * 
+     * If receiving fails, an exception is thrown. The data received until 
+     * then stays in the buffer.
+     * 
+     * @param buffer The buffer that the received data is appended to.
+     * @param initialCapacity The number of free bytes reserved for the first
+     * read if the buffer has no unused capacity.
+     * 
+     * @return The number of bytes that were appended to buffer.
+     */
+    size_t readToEnd(ByteBuffer &buffer, size_t initialCapacity = 4096);
+
+    /**
+     * @brief Receive data from the tcp connection into count buffers, filling
+     * them in order. This has the same semantics as TcpStream::read but 
+     * scatters the data over multiple buffers with a single vectored read.
+     * 
+     * A single read uses at most the first 64 iovec structs. The remaining 
+     * buffers are not filled by this call, so pass them to another call if 
+     * all of the first 64 buffers were filled.
+     * 
+     * If receiving fails, an exception is thrown.
+     * 
+     * @param buffers Pointer to count iovec structs that describe where the 
+     * received data will be stored.
+     * @param count The number of iovec structs in buffers. Only the first 64
+     * are used.
+     * 
+     * @return The total number of bytes that were actually received over the 
+     * connection. This can be less than the total size of all buffers. In 
+     * non-blocking mode -1 is returned if no data is available.
+     */
+    ssize_t readv(const iovec *buffers, size_t count);
+
+    /**
+     * @brief Receive data from the tcp connection like TcpStream::read, but 
+     * leave it in the receive queue, so that the next read returns it again.
+     * 
+     * If receiving fails, an exception is thrown.
+     * 
+     * @param data Pointer to at least len bytes where the data will be 
+     * stored.
+     * @param len The maxiumum number of bytes that will be peeked.
+     * 
+     * @return The number of bytes that were copied into data. In non-blocking
+     * mode, -1 is returned if no data is available.
+     */
+    ssize_t peek(void *data, size_t len);
+
+    /**
+     * @brief Get the number of bytes that can be read without blocking 
+     * (FIONREAD). This can be used to size the buffer of the next read. With
+     * TLS, the raw socket bytes are included, so the value overestimates the
+     * payload by the record overhead.
+     * 
+     * If the socket is closed or the query fails, an exception is thrown.
+     * 
+     * @return The number of bytes that are available.
+     */
+    size_t available() const;
+
     /**
      * @brief Same as TcpStream::read but with a millisecond timeout. If the 
      * timeout is reached without receiving data, 0 is returned.
      * 
+     * How the data is awaited depends on the TimeoutMode of the stream.
+     * 
      * If receiving fails, an exception is thrown.
      * 
      * @param data Pointer to at least len bytes where the data received over  
@@ -250,6 +707,45 @@ public:
      */
     ssize_t readAllTimeout(void *data, size_t len, int timeoutMs);
 
+    /**
+     * @brief Same as TcpStream::read but with an absolute deadline. If the 
+     * deadline is reached without receiving data, 0 is returned. If data is 
+     * already available, no poll is needed.
+     * 
+     * If receiving fails, an exception is thrown.
+     * 
+     * @param data Pointer to at least len bytes where the data received over  
+     * the tcp connection will be stored.
+     * @param len The maxiumum number of bytes that will be received over the 
+     * tcp connection.
+     * @param deadline The point in time when a timeout occurs.
+     * 
+     * @return The number of bytes that were actually received over the 
+     * connection. If a timeout occurs 0 is returned.
+     */
+    ssize_t readDeadline(void *data, size_t len, Deadline deadline);
+
+    /**
+     * @brief Same as TcpStream::readAllTimeout but with an absolute deadline
+     * for the whole operation. Unlike the timeout of readAllTimeout, the 
+     * deadline is not extended when partial data is received, so a slowly 
+     * sending peer can't block the caller for longer than intended.
+     * 
+     * If receiving fails, an exception is thrown.
+     * 
+     * @param data Pointer to at least len bytes where the data received over  
+     * the tcp connection will be stored.
+     * @param len The number of bytes that will be received over the tcp 
+     * connection.
+     * @param deadline The point in time when a timeout occurs.
+     * 
+     * @return The number of bytes that were actually received over the 
+     * connection. This can be less than len if the connection is closed.
+     * If the deadline is reached, the number of bytes received until then 
+     * is returned as negative.
+     */
+    ssize_t readAllDeadline(void *data, size_t len, Deadline deadline);
+
     /**
      * @brief Get the socket address of the connection target.
      * 
@@ -257,6 +753,18 @@ public:
      */
     const SockAddr & getRemoteAddr() const;
 
+    /**
+     * @brief Get a snapshot of the kernel transport statistics of the 
+     * connection, like round trip time, congestion window, retransmissions 
+     * and delivery rate.
+     * 
+     * If the socket is closed or querying the statistics fails, an exception 
+     * is thrown.
+     * 
+     * @return The parsed TCP_INFO of the connection.
+     */
+    TransportInfo transportInfo() const;
+
 #ifdef NETLIB_SSL
 
     /**
@@ -292,11 +800,49 @@ public:
      * socket operations will just fail. Due to this, it might be a good idea to  
      * disabel autoclose and manually close the socket.
      * 
+     * @note Until the first clone, the socket state is stored inline without a heap allocation.
+     * The first clone moves it into a shared block, so it must not run concurrently with I/O 
+     * on this stream. Clone the stream before handing it to other threads.
+     * 
      * @return A clone of this TcpStream that shares the same underlying socket.
      */
     TcpStream clone() const;
 
+    /**
+     * @brief Read like TcpStream::read from a coroutine, with 
+     * `co_await stream.asyncRead(data, len)`. If no data is available, the 
+     * coroutine is suspended and resumed by the current EventLoop once the
+     * socket is readable. This requires C++20 and async.hpp.
+     * 
+     * If reading fails, the socket is closed and an exception is thrown.
+     * 
+     * @return The number of bytes read, or 0 if the connection was closed.
+     */
+    ReadAwaitable asyncRead(void *data, size_t len);
+
+    /**
+     * @brief Send all data like TcpStream::sendAll from a coroutine, with
+     * `co_await stream.asyncSendAll(data, len)`. The coroutine is suspended
+     * whenever the send buffer is full.
+     * 
+     * If sending fails, the socket is closed and an exception is thrown.
+     */
+    SendAllAwaitable asyncSendAll(const void *data, size_t len);
+
+    /**
+     * @brief Connect like TcpStream::connect from a coroutine, with
+     * `co_await stream.asyncConnect()`. The coroutine is suspended until the
+     * connection is established.
+     * 
+     * If connecting fails, the socket is closed and an exception is thrown.
+     */
+    ConnectAwaitable asyncConnect();
+
     friend class TcpListener;
+    friend class BufferedWriter;
+    friend class Relay;
+    friend class AsyncIo;
+    friend class ZerocopyReceiver;
 
 };
 
@@ -0,0 +1,98 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#ifndef _TIMEOUTMODE_HPP
+#define _TIMEOUTMODE_HPP
+
+#include <atomic>
+#include <system_error>
+
+namespace netlib
+{
+
+
+/**
+ * @brief The way that timed receive functions like TcpStream::readTimeout 
+ * and UdpSocket::receiveTimeout wait for data.
+ */
+enum class TimeoutMode
+{
+    /**
+     * @brief Poll before every receive call. This always costs two syscalls.
+     */
+    Poll,
+
+    /**
+     * @brief Try a non-blocking receive first and only poll if no data is 
+     * available. If data is already available, this costs a single syscall.
+     */
+    Optimistic,
+
+    /**
+     * @brief Set the timeout on the socket with SO_RCVTIMEO and use a 
+     * blocking receive. The socket option is only changed if the timeout 
+     * differs from the previous one, so repeated calls with the same timeout
+     * cost a single syscall. In non-blocking mode, Optimistic is used 
+     * instead.
+     */
+    Kernel,
+};
+
+
+/**
+ * @brief The SO_RCVTIMEO of a socket that is used by TimeoutMode::Kernel. 
+ * The last value that was set is cached, so that setsockopt is only called 
+ * when the timeout changes. All objects that share a socket file descriptor 
+ * must also share the same RecvTimeout, otherwise the cache gets stale.
+ */
+class RecvTimeout
+{
+private:
+
+    /**
+     * @brief The timeout in milliseconds that is currently set on the 
+     * socket, or 0 if none is set.
+     */
+    std::atomic<int> currentMs{0};
+
+public:
+
+    RecvTimeout() = default;
+    RecvTimeout(const RecvTimeout &other) : currentMs{other.get()} { }
+    RecvTimeout & operator=(const RecvTimeout &other) { currentMs = other.get(); return *this; }
+
+    /**
+     * @brief Set SO_RCVTIMEO on the socket sockfd, unless it is already set 
+     * to timeoutMs.
+     * 
+     * @param ec Set to the error of setsockopt, or cleared on success.
+     */
+    void set(int sockfd, int timeoutMs, std::error_code &ec) noexcept;
+
+    /**
+     * @brief Same as set(int, int, std::error_code&) but an exception is 
+     * thrown if the option can't be set.
+     */
+    void set(int sockfd, int timeoutMs);
+
+    /**
+     * @brief Get the timeout in milliseconds that is currently set, or 0 if 
+     * none is set.
+     */
+    int get() const;
+
+    /**
+     * @brief Forget the cached timeout. This must be called when a new 
+     * socket is created, since new sockets have no timeout set.
+     */
+    void reset();
+
+};
+
+
+} // namespace netlib
+
+#endif // _TIMEOUTMODE_HPP
@@ -0,0 +1,164 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#ifndef _TRANSPORTINFO_HPP
+#define _TRANSPORTINFO_HPP
+
+#include <cstdint>
+
+namespace netlib
+{
+
+
+/**
+ * @brief A snapshot of the kernel transport statistics of a tcp connection, 
+ * parsed from TCP_INFO.
+ * 
+ * Fields that are not reported by the running kernel are 0. Times are in 
+ * microseconds, rates in bytes per second.
+ */
+struct TransportInfo
+{
+    /**
+     * @brief The tcp state of the connection, e.g. TCP_ESTABLISHED.
+     */
+    uint8_t state = 0;
+
+    /**
+     * @brief The congestion avoidance state, e.g. TCP_CA_Loss.
+     */
+    uint8_t caState = 0;
+
+    /**
+     * @brief The smoothed round trip time.
+     */
+    uint32_t rttUs = 0;
+
+    /**
+     * @brief The round trip time variance.
+     */
+    uint32_t rttVarUs = 0;
+
+    /**
+     * @brief The minimum round trip time that was observed.
+     */
+    uint32_t minRttUs = 0;
+
+    /**
+     * @brief The current retransmission timeout.
+     */
+    uint32_t rtoUs = 0;
+
+    /**
+     * @brief The congestion window in segments.
+     */
+    uint32_t sendCwnd = 0;
+
+    /**
+     * @brief The slow start threshold in segments.
+     */
+    uint32_t sendSsthresh = 0;
+
+    /**
+     * @brief The maximum segment size used for sending.
+     */
+    uint32_t sendMss = 0;
+
+    /**
+     * @brief The path MTU.
+     */
+    uint32_t pmtu = 0;
+
+    /**
+     * @brief The number of segments that are in flight and not acknowledged.
+     */
+    uint32_t unacked = 0;
+
+    /**
+     * @brief The number of segments that are considered lost.
+     */
+    uint32_t lost = 0;
+
+    /**
+     * @brief The total number of retransmitted segments.
+     */
+    uint32_t totalRetrans = 0;
+
+    /**
+     * @brief The number of bytes in the send buffer that were not sent yet.
+     */
+    uint32_t notSentBytes = 0;
+
+    /**
+     * @brief The receive window advertised by the peer.
+     */
+    uint32_t peerReceiveWindow = 0;
+
+    /**
+     * @brief The most recent measured delivery rate.
+     */
+    uint64_t deliveryRate = 0;
+
+    /**
+     * @brief True if the delivery rate was limited by the application, not 
+     * by the network.
+     */
+    bool deliveryRateAppLimited = false;
+
+    /**
+     * @brief The current pacing rate.
+     */
+    uint64_t pacingRate = 0;
+
+    /**
+     * @brief The number of bytes that were sent, including retransmissions.
+     */
+    uint64_t bytesSent = 0;
+
+    /**
+     * @brief The number of bytes that were retransmitted.
+     */
+    uint64_t bytesRetrans = 0;
+
+    /**
+     * @brief The number of bytes that were acknowledged by the peer.
+     */
+    uint64_t bytesAcked = 0;
+
+    /**
+     * @brief The number of bytes that were received.
+     */
+    uint64_t bytesReceived = 0;
+
+    /**
+     * @brief The time that was spent sending data.
+     */
+    uint64_t busyTimeUs = 0;
+
+    /**
+     * @brief The time that sending was limited by the peers receive window.
+     */
+    uint64_t receiveWindowLimitedUs = 0;
+
+    /**
+     * @brief The time that sending was limited by the local send buffer.
+     */
+    uint64_t sendBufferLimitedUs = 0;
+
+    /**
+     * @brief Query TCP_INFO for the given socket and parse it. 
+     * 
+     * If the query fails, a std::system_error is thrown.
+     * 
+     * @param sockfd A tcp socket file descriptor.
+     */
+    static TransportInfo fromSocket(int sockfd);
+};
+
+
+} // namespace netlib
+
+#endif // _TRANSPORTINFO_HPP
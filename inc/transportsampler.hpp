@@ -0,0 +1,150 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#ifndef _TRANSPORTSAMPLER_HPP
+#define _TRANSPORTSAMPLER_HPP
+
+#include <vector>
+#include <deque>
+#include <chrono>
+
+#include "tcpstream.hpp"
+#include "transportinfo.hpp"
+
+namespace netlib
+{
+
+
+/**
+ * @brief A TransportInfo snapshot of one connection at one point in time.
+ */
+struct TransportSample
+{
+    /**
+     * @brief The time at which the sample was taken.
+     */
+    std::chrono::steady_clock::time_point time;
+
+    /**
+     * @brief The remote address of the sampled connection.
+     */
+    SockAddr remote;
+
+    /**
+     * @brief The socket file descriptor of the sampled connection.
+     */
+    int sockfd = 0;
+
+    /**
+     * @brief The transport statistics of the connection.
+     */
+    TransportInfo info;
+};
+
+/**
+ * @brief The TransportSampler periodically records the TransportInfo of all 
+ * tracked TcpStreams, to find lossy paths or buffer-bloated peers in 
+ * production.
+ * 
+ * The sampler does not start a thread. Instead sampleIfDue is called from an
+ * existing loop, which only costs a clock read unless the interval has 
+ * passed. The recorded samples are kept in a bounded queue, where the oldest
+ * samples are dropped first.
+ * 
+ * The TransportSampler is not thread safe.
+ */
+class TransportSampler
+{
+private:
+
+    /**
+     * @brief The time between two samples.
+     */
+    std::chrono::milliseconds interval;
+
+    /**
+     * @brief The maximum number of samples that are kept.
+     */
+    size_t maxSamples;
+
+    /**
+     * @brief Clones of the tracked streams. The clones share the socket with
+     * the tracked streams but never close it.
+     */
+    std::vector<TcpStream> streams;
+
+    /**
+     * @brief The recorded samples, from oldest to newest.
+     */
+    std::deque<TransportSample> samples;
+
+    /**
+     * @brief The time when the next sample is due.
+     */
+    std::chrono::steady_clock::time_point nextSample;
+
+public:
+
+    /**
+     * @brief Create a TransportSampler.
+     * 
+     * @param interval The time between two samples.
+     * @param maxSamples The maximum number of samples that are kept until they
+     * are taken with takeSamples.
+     */
+    TransportSampler(std::chrono::milliseconds interval = std::chrono::seconds(1), size_t maxSamples = 4096);
+
+    /**
+     * @brief Start sampling the given stream. The sampler keeps a clone of 
+     * the stream, so the stream may be moved or destroyed while it is 
+     * tracked. Streams that are closed are untracked automatically on the 
+     * next sample.
+     * 
+     * @note The clone does not close the socket, but it keeps the socket 
+     * open until it is untracked if the stream is destroyed without 
+     * autoclose.
+     * 
+     * @param stream The stream that will be sampled.
+     */
+    void track(const TcpStream &stream);
+
+    /**
+     * @brief Stop sampling the given stream.
+     * 
+     * @param stream The stream that will no longer be sampled.
+     */
+    void untrack(const TcpStream &stream);
+
+    /**
+     * @brief Get the number of tracked streams.
+     */
+    size_t getTracked() const;
+
+    /**
+     * @brief Take a sample of all tracked streams if the sampling interval 
+     * has passed since the last sample.
+     * 
+     * @return True if a sample was taken.
+     */
+    bool sampleIfDue();
+
+    /**
+     * @brief Take a sample of all tracked streams now. Closed streams are 
+     * untracked and are not sampled.
+     */
+    void sample();
+
+    /**
+     * @brief Remove and return all recorded samples, from oldest to newest.
+     */
+    std::vector<TransportSample> takeSamples();
+
+};
+
+
+} // namespace netlib
+
+#endif // _TRANSPORTSAMPLER_HPP
@@ -7,11 +7,22 @@
 #ifndef _UDPSOCKET_HPP
 #define _UDPSOCKET_HPP
 
+#include <system_error>
+#include <memory>
+#include <vector>
+#include <string_view>
+
 #include "sockaddr.hpp"
+#include "sockoptions.hpp"
+#include "iostats.hpp"
+#include "timeoutmode.hpp"
 
 namespace netlib
 {
 
+class ReceiveAwaitable;
+class SendToAwaitable;
+
 
 /**
  * @brief The UdpSocket can be used to receive UDP packets from and send UDP
@@ -48,6 +59,33 @@ private:
      */
     bool autoclose = true;
 
+    /**
+     * @brief If set to true, the socket is in non-blocking mode.
+     */
+    bool nonBlocking = false;
+
+    /**
+     * @brief The socket options that are applied when the socket is created.
+     */
+    SockOptions options;
+
+    /**
+     * @brief The I/O counters of the socket, only updated if 
+     * NETLIB_INSTRUMENT is enabled.
+     */
+    SocketIoCounters ioCounters;
+
+    /**
+     * @brief The way that the timed receive functions wait for data.
+     */
+    TimeoutMode timeoutMode = TimeoutMode::Poll;
+
+    /**
+     * @brief The receive timeout that is currently set with SO_RCVTIMEO. 
+     * Clones share the socket and therefore also share this cache.
+     */
+    std::shared_ptr<RecvTimeout> recvTimeout;
+
 public:
 
     /**
@@ -130,10 +168,21 @@ public:
      * @param data Pointer to at least len bytes that will be sent as UDP packet.
      * @param len The number of bytes that will be sent.
      *  
-     * @return The number of bytes that were actually sent.
+     * @return The number of bytes that were actually sent. In non-blocking 
+     * mode -1 is returned if the packet can't be sent without blocking.
      */
     ssize_t sendTo(const SockAddr &remote, const void *data, size_t len);
 
+    /**
+     * @brief Same as sendTo(SockAddr, data, len) but errors are reported 
+     * through ec instead of exceptions. In non-blocking mode, ec is set to 
+     * std::errc::operation_would_block if the packet can't be sent without
+     * blocking.
+     * 
+     * @return The number of bytes that were actually sent, or -1 if ec is set.
+     */
+    ssize_t sendTo(const SockAddr &remote, const void *data, size_t len, std::error_code &ec) noexcept;
+
     /**
      * @brief Same as sendTo(SockAddr, data, len) but the SockAddr is created 
      * from the provided parameters.
@@ -161,7 +210,8 @@ public:
      * @param remote A reference to a SockAddr that is used to store the origin 
      * of the UDP packet.
      * 
-     * @return The number of bytes that were actually copied.
+     * @return The number of bytes that were actually copied. In non-blocking 
+     * mode -1 is returned if no packet is available.
      */
     ssize_t receive(void *data, size_t len, SockAddr &remote);
 
@@ -173,10 +223,29 @@ public:
      * will be copied.
      * @param len The maximum number of bytes that can be copied into data.
      * 
-     * @return The number of bytes that were actually copied.
+     * @return The number of bytes that were actually copied. In non-blocking 
+     * mode -1 is returned if no packet is available.
      */
     ssize_t receive(void *data, size_t len);
 
+    /**
+     * @brief Same as receive(data, len, remote) but errors are reported 
+     * through ec instead of exceptions. In non-blocking mode, ec is set to 
+     * std::errc::operation_would_block if no packet is available.
+     * 
+     * @return The number of bytes that were actually copied, or -1 if ec is 
+     * set.
+     */
+    ssize_t receive(void *data, size_t len, SockAddr &remote, std::error_code &ec) noexcept;
+
+    /**
+     * @brief Same as receive(data, len) but errors are reported through ec 
+     * instead of exceptions.
+     * 
+     * @see receive(void*, size_t, SockAddr&, std::error_code&)
+     */
+    ssize_t receive(void *data, size_t len, std::error_code &ec) noexcept;
+
     /**
      * @brief Receive a UDP packet and copy a maximum number of len bytes from 
      * the packet payload into data. Store the senders origin socket address 
@@ -209,6 +278,115 @@ public:
      */
     ssize_t receiveTimeout(void *data, size_t len, int timeoutMs);
 
+    /**
+     * @brief Receive a UDP packet like receive(data, len, remote), but leave
+     * it in the receive queue, so that the next receive returns it again.
+     * 
+     * If receiving fails, an exception is thrown.
+     * 
+     * @param data Pointer to at least len bytes of data in which the payload 
+     * will be copied.
+     * @param len The maximum number of bytes that can be copied into data.
+     * @param remote A reference to a SockAddr that is used to store the origin 
+     * of the UDP packet.
+     * 
+     * @return The number of bytes that were actually copied. In non-blocking
+     * mode, -1 is returned if no packet is available.
+     */
+    ssize_t peek(void *data, size_t len, SockAddr &remote);
+
+    /**
+     * @brief Get the size of the next pending UDP packet payload (FIONREAD). 
+     * This can be used to size the buffer for the next receive.
+     * 
+     * If the query fails, an exception is thrown.
+     * 
+     * @return The payload size of the next packet, or 0 if no packet is 
+     * pending. An empty packet is also reported as 0.
+     */
+    size_t available() const;
+
+    /**
+     * @brief Receive a UDP packet like receive(data, len, remote) and split 
+     * its payload into lines terminated by "\n" or "\r\n", as used by 
+     * line-based metric protocols. The payload is scanned once with the 
+     * LineScanner. A last line without terminator is also returned.
+     * 
+     * @param data Pointer to at least len bytes of data in which the payload 
+     * will be copied.
+     * @param len The maximum number of bytes that can be copied into data.
+     * @param remote A reference to a SockAddr that is used to store the origin 
+     * of the UDP packet.
+     * @param lines The vector that is filled with views of the lines. The 
+     * views point into data. Previous contents are removed.
+     * 
+     * @return The number of bytes that were actually copied. In non-blocking
+     * mode, -1 is returned if no packet is available.
+     */
+    ssize_t receiveLines(void *data, size_t len, SockAddr &remote, std::vector<std::string_view> &lines);
+
+    /**
+     * @brief Enable or disable the non-blocking mode. This can be set before
+     * binding or on an open socket.
+     * 
+     * @param nonBlocking Enable or disable the non-blocking mode.
+     */
+    void setNonBlocking(bool nonBlocking);
+
+    /**
+     * @brief Check if the non-blocking mode is enabled.
+     */
+    bool isNonBlocking() const;
+
+    /**
+     * @brief Set the socket options of this socket. The options are applied 
+     * immediately if the socket is open, and every time bind creates a new 
+     * socket. This replaces the previously set options.
+     * 
+     * If an option can't be applied, an exception is thrown.
+     * 
+     * @param options The socket options that will be applied. This must not 
+     * contain any TCP options.
+     */
+    void setOptions(const SockOptions &options);
+
+    /**
+     * @brief Set the way that UdpSocket::receiveTimeout waits for data. The 
+     * default is TimeoutMode::Poll.
+     * 
+     * With TimeoutMode::Kernel, the receive timeout stays set on the socket
+     * after a timed receive. Receives without timeout still block until a 
+     * packet is available. Clones share the socket, so they should use the
+     * same timeouts in this mode.
+     * 
+     * @param mode The timeout mode that will be used.
+     */
+    void setTimeoutMode(TimeoutMode mode);
+
+    /**
+     * @brief Get the way that the timed receive functions wait for data.
+     */
+    TimeoutMode getTimeoutMode() const;
+
+    /**
+     * @brief Get the raw file descriptor of the socket, for example to 
+     * register it in an event loop. The file descriptor is still owned by 
+     * the UdpSocket and must not be closed.
+     * 
+     * @return The socket file descriptor, or 0 if the socket is closed.
+     */
+    int getSocketFd() const;
+
+    /**
+     * @brief Get the number of I/O calls and bytes of this socket so far. 
+     * The counters are only updated if netlib is built with 
+     * NETLIB_INSTRUMENT, otherwise they are always 0.
+     * 
+     * @see IoStats
+     */
+    IoCounters getIoCounters() const;
+
+
     /**
      * @brief Check if the socket is closed or open. Open in this case means 
      * bound and ready to send / receive.
@@ -244,6 +422,38 @@ public:
      */
     UdpSocket clone() const;
 
+    /**
+     * @brief Receive a UDP packet like UdpSocket::receive from a coroutine, 
+     * with `co_await socket.asyncReceive(data, len, remote)`. The coroutine is
+     * suspended and resumed by the current EventLoop once a packet is 
+     * available. This requires C++20 and async.hpp.
+     * 
+     * If receiving fails, an exception is thrown.
+     * 
+     * @return The number of bytes received.
+     */
+    ReceiveAwaitable asyncReceive(void *data, size_t len, SockAddr &remote);
+
+    /**
+     * @brief Same as asyncReceive(data, len, remote), but the sender address
+     * is discarded.
+     */
+    ReceiveAwaitable asyncReceive(void *data, size_t len);
+
+    /**
+     * @brief Send a UDP packet like UdpSocket::sendTo from a coroutine, with
+     * `co_await socket.asyncSendTo(remote, data, len)`. The coroutine is 
+     * suspended while the send buffer is full. This requires C++20 and 
+     * async.hpp.
+     * 
+     * If sending fails, an exception is thrown.
+     * 
+     * @return The number of bytes sent.
+     */
+    SendToAwaitable asyncSendTo(const SockAddr &remote, const void *data, size_t len);
+
+    friend class AsyncIo;
+
 };
 
 
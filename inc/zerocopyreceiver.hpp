@@ -0,0 +1,168 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#ifndef _ZEROCOPYRECEIVER_HPP
+#define _ZEROCOPYRECEIVER_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include "tcpstream.hpp"
+#include "bytebuffer.hpp"
+
+namespace netlib
+{
+
+
+/**
+ * @brief A view into data received by a ZerocopyReceiver. The view must be 
+ * released with ZerocopyReceiver::release before the next receive.
+ */
+struct ZerocopyView
+{
+    /**
+     * @brief Pointer to the first received byte.
+     */
+    const uint8_t *data = nullptr;
+
+    /**
+     * @brief The number of received bytes.
+     */
+    size_t size = 0;
+
+    /**
+     * @brief True if the data is in pages that were mapped from the socket, 
+     * false if it was copied by an ordinary read.
+     */
+    bool mapped = false;
+};
+
+/**
+ * @brief The ZerocopyReceiver receives data from a plain TcpStream by mapping
+ * the received pages into user space with TCP_ZEROCOPY_RECEIVE, instead of 
+ * copying them.
+ * 
+ * Only full pages can be mapped. Data that does not fill a page (for example 
+ * the unaligned tail of a burst) is read with an ordinary read into a small 
+ * buffer instead. If the kernel, the socket or the connection (TLS) does not
+ * support zerocopy receive, all data is read with ordinary reads.
+ * 
+ * Zerocopy receive pays off for large transfers where the sender writes page
+ * sized payloads and the network interface splits headers from payloads. 
+ * On other paths, most data will arrive through the fallback.
+ */
+class ZerocopyReceiver
+{
+private:
+
+    /**
+     * @brief The stream that is received from.
+     */
+    TcpStream &stream;
+
+    /**
+     * @brief The address range that the received pages are mapped to.
+     */
+    void *region = nullptr;
+
+    /**
+     * @brief The size of region in bytes, a multiple of the page size.
+     */
+    size_t regionSize;
+
+    /**
+     * @brief The buffer for data that is read with ordinary reads.
+     */
+    ByteBuffer copyBuffer;
+
+    /**
+     * @brief The number of mapped bytes that were not released yet.
+     */
+    size_t mappedSize = 0;
+
+    /**
+     * @brief True if a view was returned that was not released yet.
+     */
+    bool outstanding = false;
+
+    /**
+     * @brief The number of bytes that were received by mapping pages.
+     */
+    uint64_t bytesMapped = 0;
+
+    /**
+     * @brief The number of bytes that were received by ordinary reads.
+     */
+    uint64_t bytesCopied = 0;
+
+    /**
+     * @brief Read data with an ordinary read into copyBuffer.
+     */
+    ssize_t receiveCopy(ZerocopyView &view, size_t len);
+
+public:
+
+    /**
+     * @brief Create a ZerocopyReceiver for the given stream. The stream must 
+     * be connected and must outlive the ZerocopyReceiver. If the mapping 
+     * region can't be reserved, ordinary reads are used.
+     * 
+     * @param stream The connected TcpStream that is received from.
+     * @param chunkSize The maximum number of bytes that are mapped at once. 
+     * This is rounded up to a multiple of the page size.
+     * @param copySize The size of the buffer for ordinary reads.
+     */
+    ZerocopyReceiver(TcpStream &stream, size_t chunkSize = 2 * 1024 * 1024, size_t copySize = 64 * 1024);
+
+    ~ZerocopyReceiver();
+
+    ZerocopyReceiver(const ZerocopyReceiver &other) = delete;
+    ZerocopyReceiver& operator=(const ZerocopyReceiver &other) = delete;
+
+    /**
+     * @brief Receive the next chunk of data. This blocks until data is 
+     * available, like TcpStream::read.
+     * 
+     * If receiving fails or the previous view was not released, an 
+     * exception is thrown.
+     * 
+     * @param view Set to the received data.
+     * 
+     * @return The number of bytes that were received. 0 if the connection 
+     * was closed, -1 if no data is available in non-blocking mode.
+     */
+    ssize_t receive(ZerocopyView &view);
+
+    /**
+     * @brief Release the data of the given view. Mapped pages are returned to
+     * the kernel. The view must not be used afterwards.
+     * 
+     * @param view The view that was returned by the last receive.
+     */
+    void release(ZerocopyView &view);
+
+    /**
+     * @brief Check if the data is received by mapping pages. If this is 
+     * false, all data is received with ordinary reads.
+     */
+    bool isZerocopyEnabled() const;
+
+    /**
+     * @brief Get the number of bytes that were received by mapping pages.
+     */
+    uint64_t getBytesMapped() const;
+
+    /**
+     * @brief Get the number of bytes that were received by ordinary reads.
+     */
+    uint64_t getBytesCopied() const;
+
+};
+
+
+} // namespace netlib
+
+#endif // _ZEROCOPYRECEIVER_HPP
@@ -0,0 +1,96 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#include "adaptivereader.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+
+using namespace netlib;
+
+/**
+ * @brief The number of reads in a row that need less than half of the 
+ * allocated buffer before its memory is released.
+ */
+static constexpr unsigned SHRINK_AFTER_READS = 8;
+
+AdaptiveReader::AdaptiveReader(TcpStream &_stream, size_t _minSize, size_t initialSize, size_t _maxSize)
+    : stream{_stream}, minSize{_minSize}, maxSize{_maxSize}
+{
+    if (minSize == 0 || minSize > maxSize)
+        throw std::runtime_error("Invalid AdaptiveReader size limits");
+
+    nextSize = std::clamp(initialSize, minSize, maxSize);
+}
+
+void AdaptiveReader::record(size_t bufferSize, size_t bytesRead)
+{
+    if (bytesRead >= bufferSize)
+    {
+        nextSize = std::min(bufferSize * 2, maxSize);
+        decreaseNow = false;
+    }
+    else if (bytesRead <= nextSize / 2)
+    {
+        // Only shrink after two small reads in a row, single small reads
+        // are common in between bursts
+        if (decreaseNow)
+        {
+            nextSize = std::max(nextSize / 2, minSize);
+            decreaseNow = false;
+        }
+        else
+        {
+            decreaseNow = true;
+        }
+    }
+    else
+    {
+        decreaseNow = false;
+    }
+}
+
+ssize_t AdaptiveReader::read(const uint8_t *&data)
+{
+    size_t size = nextSize;
+
+    // The rest of a burst that is already queued is read completely. This 
+    // costs a syscall, so it is only checked if the last read was too small
+    if (lastFilled && !stream.isClosed())
+    {
+        size_t available = stream.available();
+        if (available > size) size = std::min(available, maxSize);
+    }
+
+    // Release memory only if the prediction stays small
+    if (buffer.capacity() > size * 2)
+    {
+        if (++oversizedReads >= SHRINK_AFTER_READS)
+        {
+            ByteBuffer{}.swap(buffer);
+            oversizedReads = 0;
+        }
+    }
+    else
+    {
+        oversizedReads = 0;
+    }
+    if (buffer.size() < size) buffer.resize(size);
+
+    ssize_t bytesRead = stream.read(buffer.data(), size);
+    if (bytesRead < 0) return bytesRead;
+
+    record(size, bytesRead);
+    lastFilled = (size_t)bytesRead >= size;
+
+    data = buffer.data();
+    return bytesRead;
+}
+
+size_t AdaptiveReader::getNextSize() const
+{
+    return nextSize;
+}
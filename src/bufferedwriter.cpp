@@ -0,0 +1,113 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#include "bufferedwriter.hpp"
+
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+using namespace netlib;
+
+BufferedWriter::BufferedWriter(TcpStream &_stream, size_t _capacity, bool _cork)
+    : stream{_stream}, capacity{_capacity}, cork{_cork}
+{
+    if (capacity == 0)
+        throw std::runtime_error("BufferedWriter capacity must not be 0");
+
+    buffer.reserve(capacity);
+}
+
+BufferedWriter::~BufferedWriter()
+{
+    try
+    {
+        flush();
+    }
+    catch (const std::exception &)
+    {
+        // Nothing can be done about the error at this point
+    }
+}
+
+void BufferedWriter::setCorked(bool _corked)
+{
+    if (!cork || corked == _corked || stream.isClosed()) return;
+
+    int value = _corked ? 1 : 0;
+    if (setsockopt(stream.socket->sockfd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value)) != 0)
+    {
+        throw std::runtime_error("Setting TCP_CORK failed");
+    }
+
+    corked = _corked;
+}
+
+void BufferedWriter::sendBuffer()
+{
+    if (buffer.empty()) return;
+
+    // Clear the buffer even if sending fails, the stream is closed in that
+    // case anyways
+    try
+    {
+        stream.sendAll(buffer.data(), buffer.size());
+    }
+    catch (const std::exception &)
+    {
+        buffer.clear();
+        throw;
+    }
+    buffer.clear();
+}
+
+void BufferedWriter::write(const void *data, size_t len)
+{
+    if (len == 0) return;
+
+    // Start a new batch
+    setCorked(true);
+
+    if (buffer.size() + len > capacity)
+    {
+        sendBuffer();
+    }
+
+    // Big writes would only be split up by the buffer, so they are sent
+    // directly
+    if (len >= capacity)
+    {
+        stream.sendAll(data, len);
+        return;
+    }
+
+    buffer.insert(buffer.end(), (const uint8_t*)data, (const uint8_t*)data + len);
+}
+
+void BufferedWriter::writeString(const std::string &str)
+{
+    write(str.c_str(), str.size());
+}
+
+void BufferedWriter::flush()
+{
+    sendBuffer();
+
+    // Removing the cork pushes out the last partial segment
+    setCorked(false);
+}
+
+size_t BufferedWriter::getBuffered() const
+{
+    return buffer.size();
+}
+
+size_t BufferedWriter::getCapacity() const
+{
+    return capacity;
+}
@@ -0,0 +1,117 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#include "bufferring.hpp"
+
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+
+#include <sys/mman.h>
+
+using namespace netlib;
+
+BufferRing::BufferRing(IoUring *_ring, unsigned _entries, size_t _bufferSize)
+    : ring{_ring}, entries{_entries}, bufferSize{_bufferSize}
+{
+    if (entries == 0 || entries > 32768 || (entries & (entries - 1)) != 0)
+        throw std::runtime_error("BufferRing entries must be a power of 2 up to 32768");
+    if (bufferSize == 0 || bufferSize > UINT32_MAX)
+        throw std::runtime_error("Invalid BufferRing buffer size");
+
+    storage.resize(entries * bufferSize);
+
+    if (ring == nullptr)
+    {
+        freeIds.reserve(entries);
+        for (unsigned i = entries; i > 0; i--) freeIds.push_back((uint16_t)(i - 1));
+        return;
+    }
+
+    // The descriptor ring has to be page aligned, which mmap guarantees
+    bufRingSize = entries * sizeof(io_uring_buf);
+    void *mem = mmap(nullptr, bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        throw std::system_error(errno, std::system_category(), "Allocating buffer ring failed");
+    bufRing = (io_uring_buf_ring*)mem;
+
+    groupId = ring->allocateBufferGroup();
+
+    try
+    {
+        ring->registerBufferRing(bufRing, entries, groupId);
+    }
+    catch (const std::exception &)
+    {
+        munmap(bufRing, bufRingSize);
+        throw;
+    }
+
+    for (unsigned i = 0; i < entries; i++) recycle((uint16_t)i);
+}
+
+BufferRing::~BufferRing()
+{
+    if (bufRing != nullptr)
+    {
+        ring->unregisterBufferRing(groupId);
+        munmap(bufRing, bufRingSize);
+    }
+}
+
+bool BufferRing::isRegistered() const
+{
+    return bufRing != nullptr;
+}
+
+uint16_t BufferRing::getGroupId() const
+{
+    return groupId;
+}
+
+unsigned BufferRing::getEntries() const
+{
+    return entries;
+}
+
+size_t BufferRing::getBufferSize() const
+{
+    return bufferSize;
+}
+
+uint8_t * BufferRing::getBuffer(uint16_t id)
+{
+    return storage.data() + (size_t)id * bufferSize;
+}
+
+void BufferRing::recycle(uint16_t id)
+{
+    if (bufRing == nullptr)
+    {
+        freeIds.push_back(id);
+        return;
+    }
+
+    // Index from the start of the ring instead of using bufs, which the uapi
+    // header declares with an empty struct in front of it in C++
+    io_uring_buf *buf = (io_uring_buf*)bufRing + (tail & (entries - 1));
+    buf->addr = (uint64_t)(uintptr_t)getBuffer(id);
+    buf->len = (uint32_t)bufferSize;
+    buf->bid = id;
+    tail++;
+
+    // The kernel must see the descriptor before the new tail
+    __atomic_store_n(&bufRing->tail, tail, __ATOMIC_RELEASE);
+}
+
+bool BufferRing::take(uint16_t &id)
+{
+    if (freeIds.empty()) return false;
+
+    id = freeIds.back();
+    freeIds.pop_back();
+    return true;
+}
@@ -0,0 +1,517 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#include "eventloop.hpp"
+#include "iouring.hpp"
+
+#include <stdexcept>
+#include <system_error>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+using namespace netlib;
+
+/**
+ * @brief The EventLoop that is running on this thread.
+ */
+static thread_local EventLoop *currentLoop = nullptr;
+
+EventLoop::CurrentGuard::CurrentGuard(EventLoop &loop) : previous{currentLoop}
+{
+    currentLoop = &loop;
+}
+
+EventLoop::CurrentGuard::~CurrentGuard()
+{
+    currentLoop = previous;
+}
+
+EventLoop::Handler::Handler(int _fd, IoCallback _callback) : fd{_fd}, callback{std::move(_callback)}
+{ }
+
+void EventLoop::Handler::notify(uint32_t events)
+{
+    // The handler was removed by an earlier callback
+    if (fd < 0) return;
+
+    callback(events);
+}
+
+EventLoop * EventLoop::current()
+{
+    return currentLoop;
+}
+
+/**
+ * @brief The user_data of the poll on the epoll file descriptor.
+ */
+static constexpr uint64_t EPOLL_USER_DATA = 0;
+
+/**
+ * @brief The user_data of cancel operations, their results are not needed.
+ */
+static constexpr uint64_t CANCEL_USER_DATA = 1;
+
+EventLoop::EventLoop(bool useIoUring)
+{
+    epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollfd < 0)
+        throw std::system_error(errno, std::system_category(), "Creating epoll instance failed");
+
+    wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakefd < 0)
+    {
+        int error = errno;
+        ::close(epollfd);
+        throw std::system_error(error, std::system_category(), "Creating eventfd failed");
+    }
+
+    // The wakeup only interrupts epoll_wait, the posted functions are run
+    // after every wait anyways
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = this;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, wakefd, &ev) != 0)
+    {
+        int error = errno;
+        ::close(wakefd);
+        ::close(epollfd);
+        throw std::system_error(error, std::system_category(), "Registering eventfd failed");
+    }
+
+    // Waiting with a timeout needs IORING_FEAT_EXT_ARG (5.11), otherwise the
+    // ring is not used at all
+    if (useIoUring && IoUring::isSupported())
+    {
+        try
+        {
+            ring = std::make_unique<IoUring>();
+            if (!ring->hasFeature(IORING_FEAT_EXT_ARG | IORING_FEAT_NODROP)) ring.reset();
+        }
+        catch (const std::exception &)
+        {
+            ring.reset();
+        }
+    }
+}
+
+EventLoop::~EventLoop()
+{
+    // Closing the ring cancels all operations that are still queued
+    ring.reset();
+
+    ::close(wakefd);
+    ::close(epollfd);
+}
+
+uint32_t EventLoop::toEpoll(uint32_t events)
+{
+    uint32_t result = EPOLLRDHUP;
+    if (events & READABLE) result |= EPOLLIN;
+    if (events & WRITABLE) result |= EPOLLOUT;
+    if (events & EDGE_TRIGGERED) result |= EPOLLET;
+    return result;
+}
+
+void EventLoop::add(int fd, uint32_t events, IoCallback callback)
+{
+    if (fd <= 0)
+        throw std::runtime_error("Can't add closed socket to EventLoop");
+    if (handlers.count(fd) > 0)
+        throw std::runtime_error("File descriptor is already registered in EventLoop");
+
+    auto handler = std::make_unique<Handler>(fd, std::move(callback));
+
+    epoll_event ev{};
+    ev.events = toEpoll(events);
+    ev.data.ptr = static_cast<Waiter*>(handler.get());
+
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        throw std::system_error(errno, std::system_category(), "Adding file descriptor to EventLoop failed");
+
+    handlers.emplace(fd, std::move(handler));
+}
+
+void EventLoop::add(const TcpStream &stream, uint32_t events, IoCallback callback)
+{
+    add(stream.getSocketFd(), events, std::move(callback));
+}
+
+void EventLoop::add(const TcpListener &listener, uint32_t events, IoCallback callback)
+{
+    add(listener.getSocketFd(), events, std::move(callback));
+}
+
+void EventLoop::add(const UdpSocket &socket, uint32_t events, IoCallback callback)
+{
+    add(socket.getSocketFd(), events, std::move(callback));
+}
+
+void EventLoop::modify(int fd, uint32_t events)
+{
+    auto it = handlers.find(fd);
+    if (it == handlers.end())
+        throw std::runtime_error("File descriptor is not registered in EventLoop");
+
+    epoll_event ev{};
+    ev.events = toEpoll(events);
+    ev.data.ptr = static_cast<Waiter*>(it->second.get());
+
+    if (epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &ev) != 0)
+        throw std::system_error(errno, std::system_category(), "Modifying file descriptor in EventLoop failed");
+}
+
+void EventLoop::remove(int fd)
+{
+    auto it = handlers.find(fd);
+    if (it == handlers.end()) return;
+
+    // This fails if the fd was already closed, which removes it anyways
+    epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, nullptr);
+
+    // Pending events of this dispatch must not call the handler anymore
+    it->second->fd = -1;
+    removed.push_back(std::move(it->second));
+    handlers.erase(it);
+}
+
+void EventLoop::waitOnce(int fd, uint32_t events, Waiter &waiter)
+{
+    epoll_event ev{};
+    ev.events = toEpoll(events & ~EDGE_TRIGGERED) | EPOLLONESHOT;
+    ev.data.ptr = &waiter;
+
+    // The file descriptor stays in the epoll set after a one-shot wait
+    if (epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &ev) == 0) return;
+
+    if (errno != ENOENT || epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        throw std::system_error(errno, std::system_category(), "Waiting for file descriptor failed");
+}
+
+void EventLoop::cancelWait(int fd, Waiter &waiter)
+{
+    // This fails if the fd was already closed, which removes it anyways
+    epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, nullptr);
+
+    // Drop the events that were already received for the waiter
+    for (int i = 0; i < batchCount; i++)
+    {
+        if (batch[i].data.ptr == &waiter) batch[i].data.ptr = nullptr;
+    }
+    unschedule(waiter);
+}
+
+void EventLoop::schedule(Waiter &waiter)
+{
+    scheduled.push_back(&waiter);
+}
+
+void EventLoop::unschedule(Waiter &waiter)
+{
+    std::replace(scheduled.begin(), scheduled.end(), &waiter, (Waiter*)nullptr);
+}
+
+IoUring * EventLoop::getIoUring()
+{
+    return ring.get();
+}
+
+io_uring_sqe * EventLoop::prepare(Waiter &waiter)
+{
+    io_uring_sqe *sqe = ring->getSqe();
+    sqe->user_data = (uint64_t)(uintptr_t)&waiter;
+    return sqe;
+}
+
+void EventLoop::cancelOperation(Waiter &waiter)
+{
+    io_uring_sqe *sqe = ring->getSqe();
+    IoUring::prepCancel(sqe, (uint64_t)(uintptr_t)&waiter);
+    sqe->user_data = CANCEL_USER_DATA;
+
+    // The operation always completes after it was canceled. Other 
+    // completions that arrive in the meantime are dispatched as usual.
+    bool done = false;
+    reapCompletions(&waiter, done);
+    while (!done)
+    {
+        ring->submit(1);
+        reapCompletions(&waiter, done);
+    }
+
+    unschedule(waiter);
+}
+
+bool EventLoop::contains(int fd) const
+{
+    return handlers.count(fd) > 0;
+}
+
+size_t EventLoop::size() const
+{
+    return handlers.size();
+}
+
+EventLoop::TimerId EventLoop::addTimer(std::chrono::milliseconds delay, Callback callback, 
+    std::chrono::milliseconds interval)
+{
+    TimerId id = nextTimerId++;
+    auto deadline = std::chrono::steady_clock::now() + delay;
+
+    timers.emplace(id, Timer{deadline, interval, std::move(callback)});
+    timerQueue.emplace(deadline, id);
+
+    return id;
+}
+
+void EventLoop::cancelTimer(TimerId id)
+{
+    // The queue entry is skipped when it comes up
+    timers.erase(id);
+}
+
+void EventLoop::post(Callback task)
+{
+    {
+        std::lock_guard<std::mutex> lock(postMutex);
+        posted.push_back(std::move(task));
+    }
+
+    uint64_t one = 1;
+    ssize_t res = ::write(wakefd, &one, sizeof(one));
+    (void)res;
+}
+
+void EventLoop::stop()
+{
+    stopped.store(true);
+
+    uint64_t one = 1;
+    ssize_t res = ::write(wakefd, &one, sizeof(one));
+    (void)res;
+}
+
+size_t EventLoop::runTimers()
+{
+    size_t count = 0;
+    auto now = std::chrono::steady_clock::now();
+
+    while (!timerQueue.empty() && timerQueue.top().first <= now)
+    {
+        auto [deadline, id] = timerQueue.top();
+        timerQueue.pop();
+
+        auto it = timers.find(id);
+
+        // The timer was canceled or rescheduled
+        if (it == timers.end() || it->second.deadline != deadline) continue;
+
+        // Copy the callback, since the timer can cancel itself
+        Callback callback = it->second.callback;
+
+        if (it->second.interval.count() > 0)
+        {
+            it->second.deadline = deadline + it->second.interval;
+
+            // Don't run a late periodic timer multiple times in a row
+            if (it->second.deadline <= now) it->second.deadline = now + it->second.interval;
+
+            timerQueue.emplace(it->second.deadline, id);
+        }
+        else
+        {
+            timers.erase(it);
+        }
+
+        callback();
+        count++;
+    }
+
+    return count;
+}
+
+size_t EventLoop::runPosted()
+{
+    std::vector<Callback> tasks;
+    {
+        std::lock_guard<std::mutex> lock(postMutex);
+        tasks.swap(posted);
+    }
+
+    for (Callback &task : tasks) task();
+
+    return tasks.size();
+}
+
+int EventLoop::nextTimeout(int timeoutMs)
+{
+    // Drop canceled timers from the front, so they don't cause wakeups
+    while (!timerQueue.empty())
+    {
+        auto it = timers.find(timerQueue.top().second);
+        if (it != timers.end() && it->second.deadline == timerQueue.top().first) break;
+        timerQueue.pop();
+    }
+
+    if (timerQueue.empty()) return timeoutMs;
+
+    // Round up, so that the timer is due when epoll_wait returns
+    auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+        timerQueue.top().first - std::chrono::steady_clock::now()).count();
+    // The wait only takes an int timeout. A far timer wakes the loop early, which then simply
+    // waits again
+    int timerMs = (int)std::clamp<decltype(remaining)>(remaining, 0, INT_MAX);
+
+    if (timeoutMs < 0) return timerMs;
+    return std::min(timeoutMs, timerMs);
+}
+
+size_t EventLoop::dispatchEpoll(int timeoutMs)
+{
+    batchCount = epoll_wait(epollfd, batch, MAX_EVENTS, timeoutMs);
+
+    if (batchCount < 0)
+    {
+        int error = errno;
+        batchCount = 0;
+        if (error != EINTR)
+            throw std::system_error(error, std::system_category(), "Waiting for events failed");
+    }
+
+    size_t dispatched = 0;
+
+    for (int i = 0; i < batchCount; i++)
+    {
+        void *ptr = batch[i].data.ptr;
+
+        // The waiter was canceled by an earlier callback
+        if (ptr == nullptr) continue;
+
+        // The wakeup eventfd
+        if (ptr == this)
+        {
+            uint64_t value;
+            ssize_t res = ::read(wakefd, &value, sizeof(value));
+            (void)res;
+            continue;
+        }
+
+        uint32_t ready = 0;
+        if (batch[i].events & EPOLLIN) ready |= READABLE;
+        if (batch[i].events & EPOLLOUT) ready |= WRITABLE;
+        if (batch[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) ready |= CLOSED;
+
+        ((Waiter*)ptr)->notify(ready);
+        dispatched++;
+    }
+
+    batchCount = 0;
+    removed.clear();
+
+    return dispatched;
+}
+
+size_t EventLoop::reapCompletions(Waiter *ignored, bool &ignoredDone)
+{
+    size_t dispatched = 0;
+
+    io_uring_cqe cqe;
+    while (ring->popCompletion(cqe))
+    {
+        if (cqe.user_data == EPOLL_USER_DATA)
+        {
+            epollArmed = false;
+            epollReady = true;
+            continue;
+        }
+
+        if (cqe.user_data == CANCEL_USER_DATA) continue;
+
+        Waiter *waiter = (Waiter*)(uintptr_t)cqe.user_data;
+        // Multishot operations are only done with their last completion
+        if (waiter == ignored)
+        {
+            if (!(cqe.flags & IORING_CQE_F_MORE)) ignoredDone = true;
+            continue;
+        }
+
+        waiter->complete(cqe.res, cqe.flags);
+        dispatched++;
+    }
+
+    return dispatched;
+}
+
+size_t EventLoop::dispatchIoUring(int timeoutMs)
+{
+    // The sockets that are registered in epoll are watched through the ring
+    if (!epollArmed && !epollReady)
+    {
+        io_uring_sqe *sqe = ring->getSqe();
+        IoUring::prepPollAdd(sqe, epollfd, POLLIN);
+        sqe->user_data = EPOLL_USER_DATA;
+        epollArmed = true;
+    }
+
+    // Completions that were reaped by EventLoop::cancelOperation must not 
+    // block the wait
+    if (epollReady || !scheduled.empty()) timeoutMs = 0;
+
+    // All queued operations are submitted with the same call that waits
+    ring->submit(timeoutMs == 0 ? 0 : 1, timeoutMs);
+
+    bool unused = false;
+    size_t dispatched = reapCompletions(nullptr, unused);
+
+    if (epollReady)
+    {
+        epollReady = false;
+        dispatched += dispatchEpoll(0);
+    }
+
+    return dispatched;
+}
+
+size_t EventLoop::runOnce(int timeoutMs)
+{
+    CurrentGuard guard(*this);
+
+    {
+        std::lock_guard<std::mutex> lock(postMutex);
+        if (!posted.empty()) timeoutMs = 0;
+    }
+
+    size_t dispatched = ring ? dispatchIoUring(nextTimeout(timeoutMs)) : dispatchEpoll(nextTimeout(timeoutMs));
+
+    // Waiters that are canceled by an earlier resume are set to nullptr. The
+    // list is cleared without releasing its memory.
+    for (size_t i = 0; i < scheduled.size(); i++)
+    {
+        if (scheduled[i] != nullptr) scheduled[i]->resume();
+    }
+    scheduled.clear();
+
+    dispatched += runTimers();
+    dispatched += runPosted();
+
+    return dispatched;
+}
+
+void EventLoop::run()
+{
+    while (!stopped.load())
+    {
+        runOnce();
+    }
+
+    // Allow running the loop again
+    stopped.store(false);
+}
@@ -0,0 +1,162 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#include "framecodec.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+#include <arpa/inet.h>
+
+using namespace netlib;
+
+// Frames per vectored write. Two iovecs per frame fill the window that 
+// sendAllv passes to a single writev.
+static constexpr size_t FRAME_WINDOW = 32;
+
+FrameCodec::FrameCodec(TcpStream &_stream, size_t _maxFrameSize, size_t bufferSize)
+    : stream{_stream}, maxFrameSize{_maxFrameSize}
+{
+    if (maxFrameSize > UINT32_MAX)
+        throw std::runtime_error("Maximum frame size can't be represented in the length prefix");
+
+    buffer.resize(std::max(bufferSize, HEADER_SIZE));
+}
+
+void FrameCodec::sendFrame(const void *data, size_t len)
+{
+    if (len > maxFrameSize)
+        throw std::runtime_error("Frame exceeds the maximum frame size");
+
+    uint32_t header = htonl((uint32_t)len);
+
+    iovec buffers[2];
+    buffers[0].iov_base = &header;
+    buffers[0].iov_len = HEADER_SIZE;
+    buffers[1].iov_base = (void*)data;
+    buffers[1].iov_len = len;
+
+    stream.sendAllv(buffers, len > 0 ? 2 : 1);
+}
+
+void FrameCodec::sendFrames(const iovec *payloads, size_t count)
+{
+    // Check all frames first so that an oversized frame does not leave the
+    // preceding ones sent
+    for (size_t i = 0; i < count; i++)
+    {
+        if (payloads[i].iov_len > maxFrameSize)
+            throw std::runtime_error("Frame exceeds the maximum frame size");
+    }
+
+    uint32_t headers[FRAME_WINDOW];
+    iovec buffers[FRAME_WINDOW * 2];
+
+    for (size_t index = 0; index < count; index += FRAME_WINDOW)
+    {
+        size_t windowLen = std::min(count - index, FRAME_WINDOW);
+
+        for (size_t i = 0; i < windowLen; i++)
+        {
+            headers[i] = htonl((uint32_t)payloads[index + i].iov_len);
+
+            buffers[i*2].iov_base = &headers[i];
+            buffers[i*2].iov_len = HEADER_SIZE;
+            buffers[i*2 + 1] = payloads[index + i];
+        }
+
+        stream.sendAllv(buffers, windowLen * 2);
+    }
+}
+
+bool FrameCodec::fill(size_t needed)
+{
+    if (eof) return false;
+
+    // Move the unparsed data to the front if the next frame would not fit 
+    // behind it
+    if (readPos + needed > buffer.size())
+    {
+        std::memmove(buffer.data(), buffer.data() + readPos, writePos - readPos);
+        writePos -= readPos;
+        readPos = 0;
+
+        if (needed > buffer.size()) buffer.resize(needed);
+    }
+
+    ssize_t bytesRead = stream.read(buffer.data() + writePos, buffer.size() - writePos);
+
+    // Would block in non-blocking mode
+    if (bytesRead < 0) return false;
+
+    if (bytesRead == 0)
+    {
+        eof = true;
+        if (writePos != readPos)
+            throw std::runtime_error("Connection closed in the middle of a frame");
+        return false;
+    }
+
+    writePos += bytesRead;
+    return true;
+}
+
+bool FrameCodec::receiveFrame(FrameView &frame)
+{
+    // Release the previously returned frame
+    readPos += consumed;
+    consumed = 0;
+
+    if (readPos == writePos)
+    {
+        readPos = 0;
+        writePos = 0;
+    }
+
+    while (true)
+    {
+        size_t available = writePos - readPos;
+        size_t needed = HEADER_SIZE;
+
+        if (available >= HEADER_SIZE)
+        {
+            uint32_t header;
+            std::memcpy(&header, buffer.data() + readPos, HEADER_SIZE);
+            size_t len = ntohl(header);
+
+            if (len > maxFrameSize)
+                throw std::runtime_error("Frame exceeds the maximum frame size");
+
+            needed += len;
+
+            if (available >= needed)
+            {
+                frame.data = buffer.data() + readPos + HEADER_SIZE;
+                frame.size = len;
+                consumed = needed;
+                return true;
+            }
+        }
+
+        if (!fill(needed)) return false;
+    }
+}
+
+bool FrameCodec::isEof() const
+{
+    return eof;
+}
+
+size_t FrameCodec::getBuffered() const
+{
+    return writePos - readPos - consumed;
+}
+
+size_t FrameCodec::getMaxFrameSize() const
+{
+    return maxFrameSize;
+}
@@ -0,0 +1,186 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#include "iostats.hpp"
+
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+using namespace netlib;
+
+namespace
+{
+
+/**
+ * @brief Add a value to an atomic that only the calling thread writes to. 
+ * This avoids the cost of an atomic read-modify-write.
+ */
+inline void bump(std::atomic<uint64_t> &counter, uint64_t value) noexcept
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+/**
+ * @brief The statistics of a single operation type in a single thread.
+ */
+struct ThreadOpStats
+{
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> totalNs{0};
+    std::atomic<uint64_t> latency[IO_LATENCY_BUCKETS] = {};
+
+    void addTo(IoOpStats &stats) const
+    {
+        stats.calls += calls.load(std::memory_order_relaxed);
+        stats.errors += errors.load(std::memory_order_relaxed);
+        stats.bytes += bytes.load(std::memory_order_relaxed);
+        stats.totalNs += totalNs.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < IO_LATENCY_BUCKETS; i++)
+            stats.latency[i] += latency[i].load(std::memory_order_relaxed);
+    }
+};
+
+struct ThreadStats
+{
+    ThreadOpStats ops[IO_OP_COUNT];
+
+    void addTo(IoStatsSnapshot &snapshot) const
+    {
+        for (size_t i = 0; i < IO_OP_COUNT; i++) ops[i].addTo(snapshot.ops[i]);
+    }
+};
+
+/**
+ * @brief All live thread aggregates and the merged aggregates of threads that
+ * already exited.
+ */
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<const ThreadStats*> threads;
+    IoStatsSnapshot retired;
+};
+
+Registry & registry()
+{
+    // Never destroyed, so that threads exiting after main can still retire
+    static Registry *instance = new Registry();
+    return *instance;
+}
+
+/**
+ * @brief Registers the aggregate of the current thread on first use and 
+ * retires it when the thread exits.
+ */
+struct ThreadSlot
+{
+    ThreadStats stats;
+
+    ThreadSlot()
+    {
+        Registry &reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.threads.push_back(&stats);
+    }
+
+    ~ThreadSlot()
+    {
+        Registry &reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        stats.addTo(reg.retired);
+        reg.threads.erase(std::remove(reg.threads.begin(), reg.threads.end(), &stats), reg.threads.end());
+    }
+};
+
+} // namespace
+
+uint64_t IoOpStats::percentileNs(double percentile) const
+{
+    if (calls == 0) return 0;
+
+    uint64_t target = std::max<uint64_t>(1, percentile * calls + 0.5);
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < IO_LATENCY_BUCKETS; i++)
+    {
+        seen += latency[i];
+        if (seen >= target) return (uint64_t)2 << i;
+    }
+    return (uint64_t)2 << (IO_LATENCY_BUCKETS - 1);
+}
+
+IoStatsSnapshot IoStats::snapshot()
+{
+    IoStatsSnapshot snapshot;
+
+    Registry &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    snapshot = reg.retired;
+    for (const ThreadStats *stats : reg.threads) stats->addTo(snapshot);
+
+    return snapshot;
+}
+
+#ifdef NETLIB_INSTRUMENT
+
+SocketIoCounters& SocketIoCounters::operator=(const SocketIoCounters &other)
+{
+    IoCounters values = other.load();
+    readCalls.store(values.readCalls, std::memory_order_relaxed);
+    readBytes.store(values.readBytes, std::memory_order_relaxed);
+    writeCalls.store(values.writeCalls, std::memory_order_relaxed);
+    writeBytes.store(values.writeBytes, std::memory_order_relaxed);
+    errors.store(values.errors, std::memory_order_relaxed);
+    return *this;
+}
+
+void SocketIoCounters::record(bool write, ssize_t res) noexcept
+{
+    if (write)
+    {
+        writeCalls.fetch_add(1, std::memory_order_relaxed);
+        if (res > 0) writeBytes.fetch_add(res, std::memory_order_relaxed);
+    }
+    else
+    {
+        readCalls.fetch_add(1, std::memory_order_relaxed);
+        if (res > 0) readBytes.fetch_add(res, std::memory_order_relaxed);
+    }
+    if (res < 0) errors.fetch_add(1, std::memory_order_relaxed);
+}
+
+IoCounters SocketIoCounters::load() const noexcept
+{
+    IoCounters values;
+    values.readCalls = readCalls.load(std::memory_order_relaxed);
+    values.readBytes = readBytes.load(std::memory_order_relaxed);
+    values.writeCalls = writeCalls.load(std::memory_order_relaxed);
+    values.writeBytes = writeBytes.load(std::memory_order_relaxed);
+    values.errors = errors.load(std::memory_order_relaxed);
+    return values;
+}
+
+void IoStats::record(IoOp op, uint64_t ns, ssize_t res) noexcept
+{
+    thread_local ThreadSlot slot;
+    ThreadOpStats &stats = slot.stats.ops[(size_t)op];
+
+    // Bucket by the position of the highest set bit
+    size_t bucket = std::min<size_t>(63 - __builtin_clzll(ns | 1), IO_LATENCY_BUCKETS - 1);
+
+    bump(stats.calls, 1);
+    bump(stats.totalNs, ns);
+    bump(stats.latency[bucket], 1);
+
+    if (res < 0) bump(stats.errors, 1);
+    else bump(stats.bytes, res);
+}
+
+#endif // NETLIB_INSTRUMENT
@@ -0,0 +1,391 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#include "iouring.hpp"
+
+#include <stdexcept>
+#include <system_error>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+using namespace netlib;
+
+static int sysSetup(unsigned entries, io_uring_params *params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sysEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void *arg, size_t argSize)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize);
+}
+
+static int sysRegister(int fd, unsigned opcode, const void *arg, unsigned count)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+IoUring::IoUring(unsigned entries)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    ringfd = sysSetup(entries, &params);
+    if (ringfd < 0)
+        throw std::system_error(errno, std::system_category(), "Creating io_uring failed");
+
+    features = params.features;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    // Since 5.4 both rings can be mapped with a single mmap
+    if (features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (cqRingSize > sqRingSize) sqRingSize = cqRingSize;
+        cqRingSize = sqRingSize;
+    }
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED)
+    {
+        int error = errno;
+        sqRing = nullptr;
+        release();
+        throw std::system_error(error, std::system_category(), "Mapping io_uring failed");
+    }
+
+    if (features & IORING_FEAT_SINGLE_MMAP)
+    {
+        cqRing = sqRing;
+    }
+    else
+    {
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED)
+        {
+            int error = errno;
+            cqRing = nullptr;
+            release();
+            throw std::system_error(error, std::system_category(), "Mapping io_uring failed");
+        }
+    }
+
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqesMap = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQES);
+    if (sqesMap == MAP_FAILED)
+    {
+        int error = errno;
+        release();
+        throw std::system_error(error, std::system_category(), "Mapping io_uring failed");
+    }
+    sqes = (io_uring_sqe*)sqesMap;
+
+    uint8_t *sq = (uint8_t*)sqRing;
+    sqHead = (unsigned*)(sq + params.sq_off.head);
+    sqTail = (unsigned*)(sq + params.sq_off.tail);
+    sqArray = (unsigned*)(sq + params.sq_off.array);
+    sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    sqEntries = params.sq_entries;
+
+    uint8_t *cq = (uint8_t*)cqRing;
+    cqHead = (unsigned*)(cq + params.cq_off.head);
+    cqTail = (unsigned*)(cq + params.cq_off.tail);
+    cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+    cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+
+    sqLocalTail = *sqTail;
+}
+
+IoUring::~IoUring()
+{
+    release();
+}
+
+void IoUring::release()
+{
+    if (sqes != nullptr) munmap(sqes, sqesSize);
+    if (cqRing != nullptr && cqRing != sqRing) munmap(cqRing, cqRingSize);
+    if (sqRing != nullptr) munmap(sqRing, sqRingSize);
+    if (ringfd >= 0) ::close(ringfd);
+
+    sqes = nullptr;
+    cqRing = nullptr;
+    sqRing = nullptr;
+    ringfd = -1;
+}
+
+bool IoUring::isSupported()
+{
+    static const bool supported = []() {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+
+        int fd = sysSetup(1, &params);
+        if (fd < 0) return false;
+
+        ::close(fd);
+        return true;
+    }();
+
+    return supported;
+}
+
+bool IoUring::hasFeature(uint32_t feature) const
+{
+    return (features & feature) == feature;
+}
+
+int IoUring::getFd() const
+{
+    return ringfd;
+}
+
+io_uring_sqe * IoUring::getSqe()
+{
+    unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+
+    if (sqLocalTail - head >= sqEntries)
+    {
+        submit();
+        head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+
+        if (sqLocalTail - head >= sqEntries)
+            throw std::runtime_error("io_uring submission queue is full");
+    }
+
+    io_uring_sqe *sqe = &sqes[sqLocalTail & sqMask];
+    sqArray[sqLocalTail & sqMask] = sqLocalTail & sqMask;
+    sqLocalTail++;
+
+    std::memset(sqe, 0, sizeof(io_uring_sqe));
+    return sqe;
+}
+
+unsigned IoUring::getPending() const
+{
+    return toSubmit + (sqLocalTail - *sqTail);
+}
+
+void IoUring::flush()
+{
+    unsigned tail = *sqTail;
+    if (tail == sqLocalTail) return;
+
+    toSubmit += sqLocalTail - tail;
+
+    // The kernel must see the SQE contents before the new tail
+    __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+}
+
+unsigned IoUring::submit(unsigned minComplete, int timeoutMs)
+{
+    flush();
+
+    unsigned flags = 0;
+    void *arg = nullptr;
+    size_t argSize = 0;
+
+    __kernel_timespec ts;
+    io_uring_getevents_arg eventsArg;
+
+    if (minComplete > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS;
+
+        if (timeoutMs >= 0)
+        {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+
+            std::memset(&eventsArg, 0, sizeof(eventsArg));
+            eventsArg.ts = (uint64_t)(uintptr_t)&ts;
+
+            flags |= IORING_ENTER_EXT_ARG;
+            arg = &eventsArg;
+            argSize = sizeof(eventsArg);
+        }
+    }
+
+    int res = sysEnter(ringfd, toSubmit, minComplete, flags, arg, argSize);
+
+    if (res < 0)
+    {
+        // A timeout or signal only ends the waiting, the entries are still
+        // submitted. EBUSY means that completions have to be reaped first.
+        if (errno == ETIME || errno == EINTR || errno == EBUSY || errno == EAGAIN) return 0;
+
+        throw std::system_error(errno, std::system_category(), "Submitting to io_uring failed");
+    }
+
+    toSubmit -= (unsigned)res;
+    return (unsigned)res;
+}
+
+bool IoUring::popCompletion(io_uring_cqe &cqe)
+{
+    unsigned head = *cqHead;
+    if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) return false;
+
+    cqe = cqes[head & cqMask];
+
+    // The kernel may reuse the entry after the head was advanced
+    __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+void IoUring::registerFiles(const int *fds, unsigned count)
+{
+    if (sysRegister(ringfd, IORING_REGISTER_FILES, fds, count) < 0)
+        throw std::system_error(errno, std::system_category(), "Registering files in io_uring failed");
+}
+
+void IoUring::updateFiles(unsigned offset, const int *fds, unsigned count)
+{
+    io_uring_files_update update;
+    std::memset(&update, 0, sizeof(update));
+    update.offset = offset;
+    update.fds = (uint64_t)(uintptr_t)fds;
+
+    if (sysRegister(ringfd, IORING_REGISTER_FILES_UPDATE, &update, count) < 0)
+        throw std::system_error(errno, std::system_category(), "Updating files in io_uring failed");
+}
+
+void IoUring::unregisterFiles()
+{
+    sysRegister(ringfd, IORING_UNREGISTER_FILES, nullptr, 0);
+}
+
+void IoUring::registerBuffers(const iovec *buffers, unsigned count)
+{
+    if (sysRegister(ringfd, IORING_REGISTER_BUFFERS, buffers, count) < 0)
+        throw std::system_error(errno, std::system_category(), "Registering buffers in io_uring failed");
+}
+
+void IoUring::unregisterBuffers()
+{
+    sysRegister(ringfd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+}
+
+void IoUring::registerBufferRing(void *ringAddr, unsigned entries, uint16_t groupId)
+{
+    io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ringAddr;
+    reg.ring_entries = entries;
+    reg.bgid = groupId;
+
+    if (sysRegister(ringfd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        throw std::system_error(errno, std::system_category(), "Registering buffer ring in io_uring failed");
+}
+
+void IoUring::unregisterBufferRing(uint16_t groupId)
+{
+    io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.bgid = groupId;
+
+    sysRegister(ringfd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+}
+
+uint16_t IoUring::allocateBufferGroup()
+{
+    return nextBufferGroup++;
+}
+
+/**
+ * @brief Fill the fields that are shared by most operations.
+ */
+static void prepRw(io_uring_sqe *sqe, uint8_t opcode, int fd, const void *addr, uint32_t len, uint64_t offset)
+{
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)addr;
+    sqe->len = len;
+    sqe->off = offset;
+}
+
+void IoUring::prepRecv(io_uring_sqe *sqe, int fd, void *data, size_t len, int flags)
+{
+    prepRw(sqe, IORING_OP_RECV, fd, data, (uint32_t)len, 0);
+    sqe->msg_flags = (uint32_t)flags;
+}
+
+void IoUring::prepSend(io_uring_sqe *sqe, int fd, const void *data, size_t len, int flags)
+{
+    prepRw(sqe, IORING_OP_SEND, fd, data, (uint32_t)len, 0);
+    sqe->msg_flags = (uint32_t)flags;
+}
+
+void IoUring::prepRecvmsg(io_uring_sqe *sqe, int fd, msghdr *msg, int flags)
+{
+    prepRw(sqe, IORING_OP_RECVMSG, fd, msg, 1, 0);
+    sqe->msg_flags = (uint32_t)flags;
+}
+
+void IoUring::prepSendmsg(io_uring_sqe *sqe, int fd, const msghdr *msg, int flags)
+{
+    prepRw(sqe, IORING_OP_SENDMSG, fd, msg, 1, 0);
+    sqe->msg_flags = (uint32_t)flags;
+}
+
+void IoUring::prepAccept(io_uring_sqe *sqe, int fd, sockaddr *addr, socklen_t *addrlen, int flags)
+{
+    prepRw(sqe, IORING_OP_ACCEPT, fd, addr, 0, (uint64_t)(uintptr_t)addrlen);
+    sqe->accept_flags = (uint32_t)flags;
+}
+
+void IoUring::prepReadFixed(io_uring_sqe *sqe, int fd, void *data, size_t len, uint16_t bufIndex)
+{
+    prepRw(sqe, IORING_OP_READ_FIXED, fd, data, (uint32_t)len, 0);
+    sqe->buf_index = bufIndex;
+}
+
+void IoUring::prepWriteFixed(io_uring_sqe *sqe, int fd, const void *data, size_t len, uint16_t bufIndex)
+{
+    prepRw(sqe, IORING_OP_WRITE_FIXED, fd, data, (uint32_t)len, 0);
+    sqe->buf_index = bufIndex;
+}
+
+void IoUring::prepPollAdd(io_uring_sqe *sqe, int fd, uint32_t pollMask)
+{
+    prepRw(sqe, IORING_OP_POLL_ADD, fd, nullptr, 0, 0);
+    sqe->poll32_events = pollMask;
+}
+
+void IoUring::prepCancel(io_uring_sqe *sqe, uint64_t userData)
+{
+    prepRw(sqe, IORING_OP_ASYNC_CANCEL, -1, nullptr, 0, 0);
+    sqe->addr = userData;
+}
+
+void IoUring::prepMultishotAccept(io_uring_sqe *sqe, int fd, int flags)
+{
+    // The address would be overwritten by every accept, it can be queried
+    // with getpeername instead
+    prepAccept(sqe, fd, nullptr, nullptr, flags);
+    sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+}
+
+void IoUring::prepRecvMultishot(io_uring_sqe *sqe, int fd, uint16_t groupId, int flags)
+{
+    prepRecv(sqe, fd, nullptr, 0, flags);
+    sqe->ioprio |= IORING_RECV_MULTISHOT;
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = groupId;
+}
+
+void IoUring::prepRecvmsgMultishot(io_uring_sqe *sqe, int fd, msghdr *msg, uint16_t groupId, int flags)
+{
+    prepRecvmsg(sqe, fd, msg, flags);
+    sqe->ioprio |= IORING_RECV_MULTISHOT;
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = groupId;
+}
@@ -0,0 +1,115 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#include "linereader.hpp"
+#include "linescanner.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+using namespace netlib;
+
+LineReader::LineReader(TcpStream &_stream, size_t _maxLineLength, size_t bufferSize)
+    : stream{_stream}, maxLineLength{_maxLineLength}
+{
+    buffer.resize(std::max<size_t>(bufferSize, 1));
+}
+
+bool LineReader::fill()
+{
+    if (eof) return false;
+
+    // The queue is empty at this point, so no view points into the buffer
+    // anymore and the incomplete line can be moved to the front
+    lines.clear();
+    nextLine = 0;
+
+    if (readPos > 0)
+    {
+        std::memmove(buffer.data(), buffer.data() + readPos, writePos - readPos);
+        scanPos -= readPos;
+        writePos -= readPos;
+        readPos = 0;
+    }
+
+    // Leave room for the terminator of the longest allowed line
+    if (writePos == buffer.size())
+    {
+        if (writePos > maxLineLength + 1)
+            throw std::runtime_error("Line exceeds the maximum line length");
+        buffer.resize(std::min(buffer.size() * 2, maxLineLength + 2));
+    }
+
+    ssize_t bytesRead = stream.read(buffer.data() + writePos, buffer.size() - writePos);
+
+    // Would block in non-blocking mode
+    if (bytesRead < 0) return false;
+
+    if (bytesRead == 0)
+    {
+        eof = true;
+
+        // The rest of the data is the last line
+        if (writePos > readPos)
+        {
+            lines.emplace_back((const char*)buffer.data() + readPos, writePos - readPos);
+            readPos = writePos;
+            scanPos = writePos;
+            return true;
+        }
+        return false;
+    }
+
+    writePos += bytesRead;
+
+    const char *data = (const char*)buffer.data();
+    size_t consumed = LineScanner::split(data, writePos, lines, scanPos);
+
+    readPos = consumed;
+    scanPos = writePos;
+
+    if (writePos - readPos > maxLineLength + 1)
+        throw std::runtime_error("Line exceeds the maximum line length");
+
+    for (const auto &line : lines)
+    {
+        if (line.size() > maxLineLength)
+            throw std::runtime_error("Line exceeds the maximum line length");
+    }
+
+    return true;
+}
+
+bool LineReader::readLine(std::string_view &line)
+{
+    while (nextLine >= lines.size())
+    {
+        if (!fill()) return false;
+    }
+
+    line = lines[nextLine++];
+    return true;
+}
+
+size_t LineReader::readLines(std::vector<std::string_view> &out)
+{
+    while (nextLine >= lines.size())
+    {
+        if (!fill()) return 0;
+    }
+
+    size_t count = lines.size() - nextLine;
+    out.insert(out.end(), lines.begin() + nextLine, lines.end());
+    nextLine = lines.size();
+
+    return count;
+}
+
+bool LineReader::isEof() const
+{
+    return eof;
+}
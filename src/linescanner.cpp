@@ -0,0 +1,122 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#include "linescanner.hpp"
+
+#include <cstring>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+using namespace netlib;
+
+namespace
+{
+
+/**
+ * @brief Append the line that ends with the line feed at pos and return the 
+ * start of the next line.
+ */
+inline __attribute__((always_inline)) size_t emitLine(const char *data, size_t lineStart, size_t pos, std::vector<std::string_view> &lines)
+{
+    size_t end = pos;
+    if (end > lineStart && data[end - 1] == '\r') end--;
+
+    lines.emplace_back(data + lineStart, end - lineStart);
+    return pos + 1;
+}
+
+/**
+ * @brief Emit a line for every set bit in mask, where bit 0 corresponds to 
+ * the byte at offset.
+ */
+inline __attribute__((always_inline)) size_t emitMask(const char *data, size_t lineStart, size_t offset, uint32_t mask, std::vector<std::string_view> &lines)
+{
+    while (mask != 0)
+    {
+        lineStart = emitLine(data, lineStart, offset + __builtin_ctz(mask), lines);
+        mask &= mask - 1;
+    }
+    return lineStart;
+}
+
+} // namespace
+
+size_t LineScanner::splitScalar(const char *data, size_t len, std::vector<std::string_view> &lines, size_t scanFrom)
+{
+    size_t lineStart = 0;
+    size_t pos = scanFrom;
+
+    while (pos < len)
+    {
+        const char *lf = (const char*)std::memchr(data + pos, '\n', len - pos);
+        if (lf == nullptr) break;
+
+        pos = emitLine(data, lineStart, lf - data, lines);
+        lineStart = pos;
+    }
+
+    return lineStart;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("sse2")))
+size_t LineScanner::splitSse2(const char *data, size_t len, std::vector<std::string_view> &lines, size_t scanFrom)
+{
+    const __m128i lf = _mm_set1_epi8('\n');
+
+    size_t lineStart = 0;
+    size_t pos = scanFrom;
+
+    for (; pos + 16 <= len; pos += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)(data + pos));
+        uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, lf));
+
+        lineStart = emitMask(data, lineStart, pos, mask, lines);
+    }
+
+    // The remaining bytes are scanned without SIMD
+    return lineStart + splitScalar(data + lineStart, len - lineStart, lines, pos - lineStart);
+}
+
+__attribute__((target("avx2")))
+size_t LineScanner::splitAvx2(const char *data, size_t len, std::vector<std::string_view> &lines, size_t scanFrom)
+{
+    const __m256i lf = _mm256_set1_epi8('\n');
+
+    size_t lineStart = 0;
+    size_t pos = scanFrom;
+
+    for (; pos + 32 <= len; pos += 32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(data + pos));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, lf));
+
+        lineStart = emitMask(data, lineStart, pos, mask, lines);
+    }
+
+    // The remaining bytes are scanned without SIMD
+    return lineStart + splitScalar(data + lineStart, len - lineStart, lines, pos - lineStart);
+}
+
+#endif
+
+size_t LineScanner::split(const char *data, size_t len, std::vector<std::string_view> &lines, size_t scanFrom)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    static const bool hasSse2 = __builtin_cpu_supports("sse2");
+
+    if (hasAvx2) return splitAvx2(data, len, lines, scanFrom);
+    if (hasSse2) return splitSse2(data, len, lines, scanFrom);
+#endif
+
+    return splitScalar(data, len, lines, scanFrom);
+}
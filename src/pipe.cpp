@@ -0,0 +1,41 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#include "pipe.hpp"
+
+#include <stdexcept>
+
+#include <fcntl.h>
+
+using namespace netlib;
+
+Pipe::Pipe()
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0)
+    {
+        throw std::runtime_error("Creating pipe failed");
+    }
+
+    readfd = fds[0];
+    writefd = fds[1];
+}
+
+Pipe::~Pipe()
+{
+    ::close(readfd);
+    ::close(writefd);
+}
+
+ssize_t Pipe::spliceFrom(int fd, size_t len, unsigned int flags)
+{
+    return splice(fd, nullptr, writefd, nullptr, len, flags);
+}
+
+ssize_t Pipe::spliceTo(int fd, size_t len, unsigned int flags)
+{
+    return splice(readfd, nullptr, fd, nullptr, len, flags);
+}
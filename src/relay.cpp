@@ -0,0 +1,267 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#include "relay.hpp"
+#include "pipe.hpp"
+
+#include <stdexcept>
+#include <memory>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+using namespace netlib;
+
+/**
+ * @brief The maximum number of bytes that are moved with a single splice or
+ * copied with a single read.
+ */
+static constexpr size_t RELAY_CHUNK = 64 * 1024;
+
+/**
+ * @brief The state of one relay direction.
+ */
+struct Direction
+{
+    /** @brief The socket that is read from */
+    TcpSocketHandle &src;
+    /** @brief The socket that is written to */
+    TcpSocketHandle &dst;
+    /** @brief The byte counter of this direction */
+    std::atomic<uint64_t> &counter;
+    /** @brief The in-kernel buffer, only used for plain connections */
+    std::unique_ptr<Pipe> pipe;
+    /** @brief The user space buffer, only used if TLS is involved */
+    std::unique_ptr<uint8_t[]> buffer;
+    /** @brief The offset of the pending bytes in the user space buffer */
+    size_t offset = 0;
+    /** @brief The number of bytes that are read, but not yet written */
+    size_t pending = 0;
+    /** @brief True after src reached EOF and the half-close was propagated */
+    bool done = false;
+
+    Direction(TcpSocketHandle &src, TcpSocketHandle &dst, std::atomic<uint64_t> &counter)
+        : src{src}, dst{dst}, counter{counter}
+    { }
+};
+
+/**
+ * @brief Check if the socket has an active TLS connection.
+ */
+static bool usesTls(const TcpSocketWrapper &socket)
+{
+#ifdef NETLIB_SSL
+    return socket.ssl != nullptr;
+#endif // NETLIB_SSL
+
+    (void)socket;
+    return false;
+}
+
+/**
+ * @brief Check if decrypted data is buffered in the SSL object. In that case 
+ * poll will not report the socket as readable.
+ */
+static bool hasBufferedData(const TcpSocketWrapper &socket)
+{
+#ifdef NETLIB_SSL
+    if (socket.ssl != nullptr) return SSL_pending(socket.ssl) > 0;
+#endif // NETLIB_SSL
+
+    (void)socket;
+    return false;
+}
+
+/**
+ * @brief Move the next chunk of data for the direction using splice.
+ */
+static void transferSplice(Direction &dir)
+{
+    if (dir.pending == 0)
+    {
+        ssize_t moved = measureIo(IoOp::TcpRead, dir.src->ioCounters, [&]() {
+            return dir.pipe->spliceFrom(dir.src->sockfd, RELAY_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        });
+
+        if (moved < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            throw std::runtime_error("Error while reading from socket");
+        }
+
+        if (moved == 0)
+        {
+            shutdown(dir.dst->sockfd, SHUT_WR);
+            dir.done = true;
+            return;
+        }
+
+        dir.pending = moved;
+    }
+
+    ssize_t moved = measureIo(IoOp::TcpWrite, dir.dst->ioCounters, [&]() {
+        return dir.pipe->spliceTo(dir.dst->sockfd, dir.pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    });
+
+    if (moved < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+        throw std::runtime_error("Error while writing to socket");
+    }
+
+    dir.pending -= moved;
+    dir.counter += moved;
+}
+
+/**
+ * @brief Copy the next chunk of data for the direction through a user space 
+ * buffer. Like with splice, the data that the destination doesn't take is 
+ * kept until it is writable again, so a stalled direction can't block the 
+ * other one.
+ */
+static void transferCopy(Direction &dir)
+{
+    if (dir.pending == 0)
+    {
+        ssize_t bytesRead = dir.src->readNonBlocking(dir.buffer.get(), RELAY_CHUNK);
+
+        if (bytesRead < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            throw std::runtime_error("Error while reading from socket");
+        }
+
+        if (bytesRead == 0)
+        {
+            shutdown(dir.dst->sockfd, SHUT_WR);
+            dir.done = true;
+            return;
+        }
+
+        dir.offset = 0;
+        dir.pending = bytesRead;
+    }
+
+    while (dir.pending > 0)
+    {
+        // A failed SSL_write is repeated with the same arguments
+        ssize_t bytesSent = dir.dst->writeNonBlocking(dir.buffer.get() + dir.offset, dir.pending);
+
+        if (bytesSent < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            throw std::runtime_error("Error while writing to socket");
+        }
+
+        dir.offset += bytesSent;
+        dir.pending -= bytesSent;
+        dir.counter += bytesSent;
+    }
+}
+
+/**
+ * @brief Switches a stream to non-blocking mode and restores the previous 
+ * mode when it goes out of scope.
+ */
+class NonBlockingScope
+{
+private:
+    TcpStream &stream;
+    bool wasNonBlocking;
+
+public:
+    NonBlockingScope(TcpStream &_stream) : stream{_stream}, wasNonBlocking{_stream.isNonBlocking()}
+    {
+        if (!wasNonBlocking) stream.setNonBlocking(true);
+    }
+
+    ~NonBlockingScope()
+    {
+        if (wasNonBlocking || stream.isClosed()) return;
+
+        // The stream stays usable in non-blocking mode, so a failure is ignored
+        try { stream.setNonBlocking(false); }
+        catch (const std::exception &) { }
+    }
+
+    NonBlockingScope(const NonBlockingScope &other) = delete;
+    NonBlockingScope& operator=(const NonBlockingScope &other) = delete;
+};
+
+Relay::Relay(TcpStream &_a, TcpStream &_b)
+    : a{_a}, b{_b}
+{ }
+
+void Relay::run()
+{
+    if (a.isClosed() || b.isClosed())
+        throw std::runtime_error("Can't relay between closed sockets");
+
+    Direction dirs[2] = {
+        Direction{ a.socket, b.socket, bytesAToB },
+        Direction{ b.socket, a.socket, bytesBToA },
+    };
+
+    // Splicing needs the raw socket on both ends
+    bool useSplice = !usesTls(*a.socket) && !usesTls(*b.socket);
+
+    for (Direction &dir : dirs)
+    {
+        if (useSplice) dir.pipe = std::make_unique<Pipe>();
+        else dir.buffer = std::make_unique<uint8_t[]>(RELAY_CHUNK);
+    }
+
+    // No read or write may block, otherwise one stalled direction would stop the other one
+    NonBlockingScope nonBlockingA(a);
+    NonBlockingScope nonBlockingB(b);
+
+    while (!dirs[0].done || !dirs[1].done)
+    {
+        pollfd pfds[2];
+        int timeoutMs = -1;
+
+        for (int i = 0; i < 2; i++)
+        {
+            Direction &dir = dirs[i];
+
+            // Wait for the destination if data is stuck in the pipe or 
+            // buffer, otherwise wait for new data from the source
+            pfds[i].fd = dir.done ? -1 : (dir.pending > 0 ? dir.dst->sockfd : dir.src->sockfd);
+            pfds[i].events = dir.pending > 0 ? POLLOUT : POLLIN;
+            pfds[i].revents = 0;
+
+            if (!dir.done && dir.pending == 0 && hasBufferedData(*dir.src)) timeoutMs = 0;
+        }
+
+        if (poll(pfds, 2, timeoutMs) < 0)
+        {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Error while waiting for sockets");
+        }
+
+        for (int i = 0; i < 2; i++)
+        {
+            Direction &dir = dirs[i];
+            if (dir.done) continue;
+            if (pfds[i].revents == 0 && !(dir.pending == 0 && hasBufferedData(*dir.src))) continue;
+
+            if (useSplice) transferSplice(dir);
+            else transferCopy(dir);
+        }
+    }
+}
+
+uint64_t Relay::getBytesAToB() const
+{
+    return bytesAToB;
+}
+
+uint64_t Relay::getBytesBToA() const
+{
+    return bytesBToA;
+}
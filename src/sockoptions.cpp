@@ -0,0 +1,133 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#include "sockoptions.hpp"
+
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+using namespace netlib;
+
+/**
+ * @brief Set a single int socket option, if the value is present.
+ * 
+ * @return False if setting the option failed.
+ */
+template <class T>
+static bool applyOption(int sockfd, int level, int name, const std::optional<T> &value)
+{
+    if (!value.has_value()) return true;
+
+    int raw = *value;
+    return setsockopt(sockfd, level, name, &raw, sizeof(raw)) == 0;
+}
+
+SockOptions & SockOptions::setNoDelay(bool _noDelay)
+{
+    noDelay = _noDelay;
+    return *this;
+}
+
+SockOptions & SockOptions::setQuickAck(bool _quickAck)
+{
+    quickAck = _quickAck;
+    return *this;
+}
+
+SockOptions & SockOptions::setNotSentLowat(int bytes)
+{
+    notSentLowat = bytes;
+    return *this;
+}
+
+SockOptions & SockOptions::setSendBufferSize(int bytes)
+{
+    sendBufferSize = bytes;
+    return *this;
+}
+
+SockOptions & SockOptions::setReceiveBufferSize(int bytes)
+{
+    receiveBufferSize = bytes;
+    return *this;
+}
+
+SockOptions & SockOptions::setKeepAlive(bool _keepAlive)
+{
+    keepAlive = _keepAlive;
+    return *this;
+}
+
+SockOptions & SockOptions::setKeepAlive(int idleSec, int intervalSec, int count)
+{
+    keepAlive = true;
+    keepAliveIdle = idleSec;
+    keepAliveInterval = intervalSec;
+    keepAliveCount = count;
+    return *this;
+}
+
+SockOptions & SockOptions::setBusyPoll(int microseconds)
+{
+    busyPoll = microseconds;
+    return *this;
+}
+
+SockOptions & SockOptions::setFastOpen(int queueLength)
+{
+    fastOpen = queueLength;
+    return *this;
+}
+
+SockOptions & SockOptions::setFastOpenConnect(bool _fastOpenConnect)
+{
+    fastOpenConnect = _fastOpenConnect;
+    return *this;
+}
+
+SockOptions & SockOptions::setReuseAddress(bool _reuseAddress)
+{
+    reuseAddress = _reuseAddress;
+    return *this;
+}
+
+SockOptions & SockOptions::setReusePort(bool _reusePort)
+{
+    reusePort = _reusePort;
+    return *this;
+}
+
+void SockOptions::apply(int sockfd, std::error_code &ec) const noexcept
+{
+    bool ok = applyOption(sockfd, SOL_SOCKET, SO_REUSEADDR, reuseAddress)
+        && applyOption(sockfd, SOL_SOCKET, SO_REUSEPORT, reusePort)
+        && applyOption(sockfd, SOL_SOCKET, SO_SNDBUF, sendBufferSize)
+        && applyOption(sockfd, SOL_SOCKET, SO_RCVBUF, receiveBufferSize)
+        && applyOption(sockfd, SOL_SOCKET, SO_KEEPALIVE, keepAlive)
+        && applyOption(sockfd, SOL_SOCKET, SO_BUSY_POLL, busyPoll)
+        && applyOption(sockfd, IPPROTO_TCP, TCP_NODELAY, noDelay)
+        && applyOption(sockfd, IPPROTO_TCP, TCP_QUICKACK, quickAck)
+        && applyOption(sockfd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, notSentLowat)
+        && applyOption(sockfd, IPPROTO_TCP, TCP_KEEPIDLE, keepAliveIdle)
+        && applyOption(sockfd, IPPROTO_TCP, TCP_KEEPINTVL, keepAliveInterval)
+        && applyOption(sockfd, IPPROTO_TCP, TCP_KEEPCNT, keepAliveCount)
+        && applyOption(sockfd, IPPROTO_TCP, TCP_FASTOPEN, fastOpen)
+        && applyOption(sockfd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, fastOpenConnect);
+
+    if (ok) ec.clear();
+    else ec = std::error_code{errno, std::system_category()};
+}
+
+void SockOptions::apply(int sockfd) const
+{
+    std::error_code ec;
+    apply(sockfd, ec);
+
+    if (ec) throw std::system_error(ec, "Setting socket option failed");
+}
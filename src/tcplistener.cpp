@@ -7,10 +7,13 @@
 #include "tcplistener.hpp"
 
 #include <stdexcept>
+#include <system_error>
 
 #include <unistd.h>
 #include <cstring>
 #include <sys/socket.h>
+#include <cerrno>
+#include <fcntl.h>
 
 using namespace netlib;
 
@@ -39,7 +42,9 @@ TcpListener::~TcpListener()
 }
 
 TcpListener::TcpListener(TcpListener &&other)
-    : local{other.local}, sockfd{other.sockfd}, autoclose{other.autoclose}
+    : local{other.local}, sockfd{other.sockfd}, autoclose{other.autoclose}, 
+        nonBlocking{other.nonBlocking}, options{other.options}, 
+        streamOptions{other.streamOptions}
 {
     // Invalidate other socket
     other.sockfd = 0;
@@ -50,6 +55,9 @@ TcpListener& TcpListener::operator=(TcpListener &&other)
     local = other.local;
     sockfd = other.sockfd;
     autoclose = other.autoclose;
+    nonBlocking = other.nonBlocking;
+    options = other.options;
+    streamOptions = other.streamOptions;
 
     // Invalidate other socket
     other.sockfd = 0;
@@ -81,13 +89,22 @@ void TcpListener::listen(int connectionQueue)
     }
 
     // Create the socket and get the socket file descriptor
-    sockfd = socket(af, SOCK_STREAM, 0);
+    sockfd = socket(af, SOCK_STREAM | (nonBlocking ? SOCK_NONBLOCK : 0), 0);
 
     if (sockfd <= 0)
     {
         throw std::runtime_error("Creating TCP Socket failed");
     }
 
+    // Options like SO_REUSEADDR must be set before binding
+    std::error_code ec;
+    options.apply(sockfd, ec);
+    if (ec)
+    {
+        close();
+        throw std::system_error(ec, "Setting socket option failed");
+    }
+
     // Bind the socket to the local address and port
     if (bind(sockfd, &local.raw_sockaddr.generic, sock_len) != 0)
     {
@@ -105,30 +122,94 @@ void TcpListener::listen(int connectionQueue)
 
 }
 
-TcpStream TcpListener::accept()
+TcpStream TcpListener::accept(std::error_code &ec) noexcept
 {
     SockAddr::RawSockAddr remote_raw_saddr;
     std::memset(&remote_raw_saddr, 0, sizeof(SockAddr::RawSockAddr));
     socklen_t remote_raw_saddr_len = sizeof(remote_raw_saddr);
 
-    int remote_sockfd = ::accept(sockfd, &remote_raw_saddr.generic, &remote_raw_saddr_len);
+    int remote_sockfd = ::accept4(sockfd, &remote_raw_saddr.generic, &remote_raw_saddr_len, 
+        nonBlocking ? SOCK_NONBLOCK : 0);
     if (remote_sockfd <= 0)
     {
-        throw std::runtime_error("Accepting TCP Connection failed");
+        ec = std::error_code{errno, std::system_category()};
+        return TcpStream{};
     }
 
+    return acceptedStream(remote_sockfd, remote_raw_saddr, ec);
+}
+
+TcpStream TcpListener::acceptedStream(int remote_sockfd, SockAddr::RawSockAddr &remote_raw_saddr, 
+    std::error_code &ec) noexcept
+{
     // Parse the raw remote sockaddr to a SockAddr
     SockAddr remote_saddr(&remote_raw_saddr.generic, local.address.type);
 
     // Create a TcpStream and set the remote SockAddr
     TcpStream stream(remote_saddr);
     // Transfer the socket filedescriptor
-    stream.socket->sockfd = remote_sockfd;
+    stream.socket = TcpSocketHandle{remote_sockfd};
+    stream.nonBlocking = nonBlocking;
+    stream.options = streamOptions;
+
+    streamOptions.apply(remote_sockfd, ec);
+    if (ec)
+    {
+        stream.close();
+        return TcpStream{};
+    }
 
     // TcpStream can't be copied, so this has to move
     return stream;
 }
 
+TcpStream TcpListener::accept()
+{
+    std::error_code ec;
+    TcpStream stream = accept(ec);
+
+    // No connection is pending, this is reported as closed stream
+    if (ec && !(nonBlocking && ec == std::errc::operation_would_block))
+        throw std::system_error(ec, "Accepting TCP Connection failed");
+
+    return stream;
+}
+
+void TcpListener::setNonBlocking(bool _nonBlocking)
+{
+    if (sockfd != 0)
+    {
+        int flags = fcntl(sockfd, F_GETFL);
+        flags = _nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+        if (flags < 0 || fcntl(sockfd, F_SETFL, flags) != 0)
+            throw std::runtime_error("Changing the blocking mode failed");
+    }
+
+    nonBlocking = _nonBlocking;
+}
+
+bool TcpListener::isNonBlocking() const
+{
+    return nonBlocking;
+}
+
+void TcpListener::setOptions(const SockOptions &_options)
+{
+    if (sockfd != 0) _options.apply(sockfd);
+
+    options = _options;
+}
+
+void TcpListener::setStreamOptions(const SockOptions &_options)
+{
+    streamOptions = _options;
+}
+
+int TcpListener::getSocketFd() const
+{
+    return sockfd;
+}
+
 void TcpListener::close()
 {
     if (sockfd != 0)
@@ -149,6 +230,9 @@ TcpListener TcpListener::clone() const
     TcpListener other{local};
     other.sockfd = sockfd;
     other.autoclose = autoclose;
+    other.nonBlocking = nonBlocking;
+    other.options = options;
+    other.streamOptions = streamOptions;
 
     return other;
 }
\ No newline at end of file
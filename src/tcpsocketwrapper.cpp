@@ -1,5 +1,17 @@
 #include "tcpsocketwrapper.hpp"
 
+#include <cstring>
+#include <mutex>
+#include <cstdint>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+
 using namespace netlib;
 
 TcpSocketWrapper::TcpSocketWrapper() : sockfd{0}
@@ -26,6 +38,14 @@ TcpSocketWrapper::TcpSocketWrapper(TcpSocketWrapper &&other)
     sockfd = other.sockfd;
     other.sockfd = 0;
 
+    zerocopy = other.zerocopy;
+    zerocopyThreshold = other.zerocopyThreshold;
+    zerocopyIssued = other.zerocopyIssued;
+    zerocopyCompleted = other.zerocopyCompleted;
+    zerocopyCopied = other.zerocopyCopied;
+    ioCounters = other.ioCounters;
+    recvTimeout = other.recvTimeout;
+
 #ifdef NETLIB_SSL
     ssl = other.ssl;
     other.ssl = nullptr;
@@ -40,6 +60,15 @@ TcpSocketWrapper& TcpSocketWrapper::operator=(TcpSocketWrapper &&other)
 
     sockfd = other.sockfd;
     other.sockfd = 0;
+
+    zerocopy = other.zerocopy;
+    zerocopyThreshold = other.zerocopyThreshold;
+    zerocopyIssued = other.zerocopyIssued;
+    zerocopyCompleted = other.zerocopyCompleted;
+    zerocopyCopied = other.zerocopyCopied;
+    ioCounters = other.ioCounters;
+    recvTimeout = other.recvTimeout;
+
 #ifdef NETLIB_SSL
     ssl = other.ssl;
     other.ssl = nullptr;
@@ -47,24 +76,276 @@ TcpSocketWrapper& TcpSocketWrapper::operator=(TcpSocketWrapper &&other)
     return *this;
 }
 
+#ifdef NETLIB_SSL
+
+/**
+ * @brief Translate the result of an SSL_read or SSL_write call. If the operation failed only 
+ * because the non-blocking socket was not ready, errno is set to EAGAIN like for plain sockets.
+ */
+static ssize_t translateSslResult(SSL *ssl, int res)
+{
+    if (res > 0) return res;
+
+    int error = SSL_get_error(ssl, res);
+    if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return res;
+}
+
+/**
+ * @brief Run an SSL_read or SSL_write with the socket in non-blocking mode, so that it can't 
+ * wait for the peer. A blocking socket is switched back afterwards.
+ */
+template <class Op>
+static ssize_t withoutBlocking(int sockfd, Op op)
+{
+    int flags = fcntl(sockfd, F_GETFL);
+    if (flags < 0) return -1;
+
+    bool switchMode = !(flags & O_NONBLOCK);
+    if (switchMode && fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) != 0) return -1;
+
+    ssize_t res = op();
+
+    if (switchMode)
+    {
+        int error = errno;
+        fcntl(sockfd, F_SETFL, flags);
+        errno = error;
+    }
+    return res;
+}
+
+#endif // NETLIB_SSL
+
 ssize_t TcpSocketWrapper::read(void *data, size_t len) const
 {
+    return measureIo(IoOp::TcpRead, ioCounters, [&]() -> ssize_t
+    {
 #ifdef NETLIB_SSL
-    if (ssl != nullptr)
-        return SSL_read(ssl, data, len);
+        if (ssl != nullptr)
+        {
+            // Unlike read, SSL_read doesn't return 0 for an empty buffer
+            if (len == 0) return 0;
+            return translateSslResult(ssl, SSL_read(ssl, data, len));
+        }
 #endif // NETLIB_SSL
 
-    return ::read(sockfd, data, len);
+        return ::read(sockfd, data, len);
+    });
 }
 
 ssize_t TcpSocketWrapper::write(const void *data, size_t len) const
+{
+    return measureIo(IoOp::TcpWrite, ioCounters, [&]() -> ssize_t
+    {
+#ifdef NETLIB_SSL
+        if (ssl != nullptr)
+            return translateSslResult(ssl, SSL_write(ssl, data, len));
+#endif // NETLIB_SSL
+
+        return ::write(sockfd, data, len);
+    });
+}
+
+ssize_t TcpSocketWrapper::writeNonBlocking(const void *data, size_t len) const
+{
+    return measureIo(IoOp::TcpWrite, ioCounters, [&]() -> ssize_t
+    {
+#ifdef NETLIB_SSL
+        if (ssl != nullptr)
+        {
+            return withoutBlocking(sockfd, [&]() {
+                return translateSslResult(ssl, SSL_write(ssl, data, len));
+            });
+        }
+#endif // NETLIB_SSL
+
+        return ::send(sockfd, data, len, MSG_DONTWAIT);
+    });
+}
+
+ssize_t TcpSocketWrapper::readNonBlocking(void *data, size_t len) const
+{
+    return measureIo(IoOp::TcpRead, ioCounters, [&]() -> ssize_t
+    {
+#ifdef NETLIB_SSL
+        if (ssl != nullptr)
+        {
+            if (len == 0) return 0;
+
+            // Decrypted data is returned without touching the socket
+            if (SSL_pending(ssl) > 0) return translateSslResult(ssl, SSL_read(ssl, data, len));
+
+            return withoutBlocking(sockfd, [&]() {
+                return translateSslResult(ssl, SSL_read(ssl, data, len));
+            });
+        }
+#endif // NETLIB_SSL
+
+        return ::recv(sockfd, data, len, MSG_DONTWAIT);
+    });
+}
+
+short TcpSocketWrapper::retryEvents(short events) const
+{
+#ifdef NETLIB_SSL
+    if (ssl != nullptr)
+    {
+        if (SSL_want_read(ssl)) return POLLIN;
+        if (SSL_want_write(ssl)) return POLLOUT;
+    }
+#endif // NETLIB_SSL
+
+    return events;
+}
+
+ssize_t TcpSocketWrapper::readWaitAll(void *data, size_t len) const
+{
+    return measureIo(IoOp::TcpRead, ioCounters, [&]() -> ssize_t
+    {
+#ifdef NETLIB_SSL
+        if (ssl != nullptr)
+            return translateSslResult(ssl, SSL_read(ssl, data, len));
+#endif // NETLIB_SSL
+
+        return ::recv(sockfd, data, len, MSG_WAITALL);
+    });
+}
+
+ssize_t TcpSocketWrapper::peek(void *data, size_t len) const
 {
 #ifdef NETLIB_SSL
     if (ssl != nullptr)
-        return SSL_write(ssl, data, len);
+        return translateSslResult(ssl, SSL_peek(ssl, data, len));
+#endif // NETLIB_SSL
+
+    return ::recv(sockfd, data, len, MSG_PEEK);
+}
+
+ssize_t TcpSocketWrapper::available() const
+{
+    int queued = 0;
+    if (ioctl(sockfd, FIONREAD, &queued) != 0) return -1;
+
+#ifdef NETLIB_SSL
+    if (ssl != nullptr)
+        return queued + SSL_pending(ssl);
+#endif // NETLIB_SSL
+
+    return queued;
+}
+
+ssize_t TcpSocketWrapper::writev(const iovec *buffers, int count) const
+{
+    return measureIo(IoOp::TcpWrite, ioCounters, [&]() -> ssize_t
+    {
+#ifdef NETLIB_SSL
+        if (ssl != nullptr)
+        {
+            // The maximum TLS record payload size
+            constexpr size_t GATHER_SIZE = 16 * 1024;
+
+            size_t total = 0;
+            for (int i = 0; i < count; i++) total += buffers[i].iov_len;
+
+            if (total > GATHER_SIZE)
+            {
+                for (int i = 0; i < count; i++)
+                {
+                    if (buffers[i].iov_len > 0)
+                        return translateSslResult(ssl, SSL_write(ssl, buffers[i].iov_base, buffers[i].iov_len));
+                }
+                return 0;
+            }
+
+            uint8_t gather[GATHER_SIZE];
+            size_t gathered = 0;
+            for (int i = 0; i < count; i++)
+            {
+                std::memcpy(gather + gathered, buffers[i].iov_base, buffers[i].iov_len);
+                gathered += buffers[i].iov_len;
+            }
+            return translateSslResult(ssl, SSL_write(ssl, gather, gathered));
+        }
 #endif // NETLIB_SSL
 
-    return ::write(sockfd, data, len);
+        return ::writev(sockfd, buffers, count);
+    });
+}
+
+ssize_t TcpSocketWrapper::readv(const iovec *buffers, int count) const
+{
+    return measureIo(IoOp::TcpRead, ioCounters, [&]() -> ssize_t
+    {
+#ifdef NETLIB_SSL
+        if (ssl != nullptr)
+        {
+            ssize_t total = 0;
+            for (int i = 0; i < count; i++)
+            {
+                if (buffers[i].iov_len == 0) continue;
+
+                // Only continue with the next entry if that won't block
+                if (total > 0 && SSL_pending(ssl) <= 0) break;
+
+                ssize_t res = translateSslResult(ssl, SSL_read(ssl, buffers[i].iov_base, buffers[i].iov_len));
+                if (res <= 0) return total > 0 ? total : res;
+
+                total += res;
+                if ((size_t)res < buffers[i].iov_len) break;
+            }
+            return total;
+        }
+#endif // NETLIB_SSL
+
+        return ::readv(sockfd, buffers, count);
+    });
+}
+
+bool TcpSocketWrapper::processZerocopyNotifications()
+{
+    while (true)
+    {
+        uint8_t control[128];
+
+        msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            // The error queue is empty
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            return false;
+        }
+
+        for (cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            bool isRecvErr = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) 
+                || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+            if (!isRecvErr) continue;
+
+            sock_extended_err err;
+            std::memcpy(&err, CMSG_DATA(cm), sizeof(err));
+            if (err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+
+            // The notification contains the inclusive range [ee_info, ee_data] of 32 bit ids.
+            // Extend the end of the range to the 64 bit counter. A range that ends before the
+            // completed counter is stale and must not wrap the counter forward.
+            uint32_t end = err.ee_data + 1;
+            int32_t advance = (int32_t)(end - (uint32_t)zerocopyCompleted);
+            if (advance > 0) zerocopyCompleted += advance;
+
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                zerocopyCopied += end - err.ee_info;
+        }
+    }
 }
 
 void TcpSocketWrapper::close()
@@ -89,3 +370,102 @@ bool TcpSocketWrapper::isValid() const
 {
     return sockfd != 0;
 }
+
+
+/**
+ * @brief Serializes moving the local wrappers into their shared blocks.
+ */
+static std::mutex shareMutex;
+
+TcpSocketHandle::TcpSocketHandle()
+{ }
+
+TcpSocketHandle::TcpSocketHandle(int sockfd) : local{sockfd}
+{ }
+
+TcpSocketHandle::~TcpSocketHandle()
+{
+    release();
+}
+
+TcpSocketHandle::TcpSocketHandle(TcpSocketHandle &&other)
+    : local{std::move(other.local)}, shared{other.shared.load(std::memory_order_relaxed)}
+{
+    other.shared.store(nullptr, std::memory_order_relaxed);
+}
+
+TcpSocketHandle& TcpSocketHandle::operator=(TcpSocketHandle &&other)
+{
+    if (this == &other) return *this;
+
+    release();
+
+    local = std::move(other.local);
+    shared.store(other.shared.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    other.shared.store(nullptr, std::memory_order_relaxed);
+
+    return *this;
+}
+
+void TcpSocketHandle::release()
+{
+    Shared *block = shared.load(std::memory_order_relaxed);
+    if (block == nullptr)
+    {
+        local.close();
+        return;
+    }
+
+    // The last owner destroys the wrapper, which closes the connection
+    if (block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        delete block;
+    }
+    shared.store(nullptr, std::memory_order_relaxed);
+}
+
+TcpSocketHandle TcpSocketHandle::share() const
+{
+    Shared *block = shared.load(std::memory_order_acquire);
+
+    // Move the local wrapper to the heap on the first share
+    if (block == nullptr)
+    {
+        std::lock_guard<std::mutex> lock(shareMutex);
+
+        block = shared.load(std::memory_order_acquire);
+        if (block == nullptr)
+        {
+            block = new Shared{std::move(local), {1}};
+            shared.store(block, std::memory_order_release);
+        }
+    }
+
+    block->refs.fetch_add(1, std::memory_order_relaxed);
+
+    TcpSocketHandle other;
+    other.shared.store(block, std::memory_order_relaxed);
+    return other;
+}
+
+TcpSocketWrapper * TcpSocketHandle::operator->()
+{
+    Shared *block = shared.load(std::memory_order_acquire);
+    return block == nullptr ? &local : &block->socket;
+}
+
+const TcpSocketWrapper * TcpSocketHandle::operator->() const
+{
+    Shared *block = shared.load(std::memory_order_acquire);
+    return block == nullptr ? &local : &block->socket;
+}
+
+TcpSocketWrapper & TcpSocketHandle::operator*()
+{
+    return *operator->();
+}
+
+const TcpSocketWrapper & TcpSocketHandle::operator*() const
+{
+    return *operator->();
+}
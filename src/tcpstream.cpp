@@ -5,23 +5,54 @@
  */
 
 #include "tcpstream.hpp"
+#include "pipe.hpp"
 
 #include <stdexcept>
+#include <system_error>
+#include <algorithm>
+#include <chrono>
+#include <climits>
 
 #include <unistd.h>
 #include <cstring>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <poll.h>
+#include <sys/sendfile.h>
+#include <cerrno>
+#include <fcntl.h>
 
 using namespace netlib;
 
+/**
+ * @brief The maximum number of iovec entries that are passed to a single 
+ * vectored read or write.
+ */
+static constexpr size_t IOV_WINDOW = 64;
+
+/**
+ * @brief Check if the last failed socket operation failed only because it 
+ * would have blocked on a non-blocking socket.
+ */
+static bool wouldBlock()
+{
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+/**
+ * @brief Get the error code for the current errno value.
+ */
+static std::error_code lastError()
+{
+    return std::error_code{errno, std::system_category()};
+}
+
 TcpStream::TcpStream()
-    : remote{SockAddr{IpAddr::V4("0.0.0.0"), 0}}, socket{nullptr}
+    : remote{SockAddr{IpAddr::V4("0.0.0.0"), 0}}
 { }
 
 TcpStream::TcpStream(SockAddr _remote)
-    : remote{_remote}, socket{nullptr}
+    : remote{_remote}
 { }
     
 TcpStream::TcpStream(IpAddr remoteAddress, uint16_t port)
@@ -42,7 +73,8 @@ TcpStream::~TcpStream()
 }
 
 TcpStream::TcpStream(TcpStream &&other)
-    : remote{other.remote}, socket{std::move(other.socket)}, autoclose{other.autoclose}
+    : remote{other.remote}, socket{std::move(other.socket)}, autoclose{other.autoclose}, 
+        nonBlocking{other.nonBlocking}, options{other.options}, timeoutMode{other.timeoutMode}
 { }
 
 TcpStream& TcpStream::operator=(TcpStream &&other)
@@ -50,6 +82,9 @@ TcpStream& TcpStream::operator=(TcpStream &&other)
     remote = other.remote;
     socket = std::move(other.socket);
     autoclose = other.autoclose;
+    nonBlocking = other.nonBlocking;
+    options = other.options;
+    timeoutMode = other.timeoutMode;
 
     return *this;
 }
@@ -63,10 +98,10 @@ void TcpStream::setRemote(SockAddr remote)
 
 bool TcpStream::isSocketValid() const
 {
-    return (socket != nullptr) && socket->isValid();
+    return socket->isValid();
 }
 
-void TcpStream::connect()
+bool TcpStream::connectSocket(bool nonBlockingConnect)
 {
     if (isSocketValid())
         throw std::runtime_error("Can't call connect on open socket");
@@ -90,26 +125,90 @@ void TcpStream::connect()
     }
 
     // Create the socket and get the socket file descriptor
-    int sockfd = ::socket(af, SOCK_STREAM, 0);
+    int sockfd = ::socket(af, SOCK_STREAM | (nonBlockingConnect ? SOCK_NONBLOCK : 0), 0);
     if (sockfd <= 0)
     {
         throw std::runtime_error("Creating TCP Socket failed");
     }
 
-    socket = std::make_shared<TcpSocketWrapper>(TcpSocketWrapper{sockfd});
+    socket = TcpSocketHandle{sockfd};
+
+    // Options like the buffer sizes must be set before connecting
+    std::error_code ec;
+    options.apply(sockfd, ec);
+    if (ec)
+    {
+        close();
+        throw std::system_error(ec, "Setting socket option failed");
+    }
 
     if (::connect(sockfd, &remote.raw_sockaddr.generic, sock_len) != 0)
+    {
+        // A non-blocking connect continues in the background
+        if (nonBlockingConnect && errno == EINPROGRESS) return false;
+
+        ec = lastError();
+        close();
+        throw std::system_error(ec, "Connecting TCP Socket failed");
+    }
+
+    return true;
+}
+
+void TcpStream::connect()
+{
+    connectSocket(nonBlocking);
+}
+
+void TcpStream::connect(int timeoutMs)
+{
+    if (timeoutMs <= 0)
+    {
+        connect();
+        return;
+    }
+
+    connectDeadline(std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs));
+}
+
+void TcpStream::connectDeadline(Deadline deadline)
+{
+    if (startConnect()) return;
+
+    // The socket becomes writable once the connect completed or failed
+    int res = waitReady(POLLOUT, deadline);
+
+    if (res == 0)
+    {
+        close();
+        throw std::system_error(std::make_error_code(std::errc::timed_out), 
+            "Connecting TCP Socket failed");
+    }
+    if (res < 0)
     {
         close();
         throw std::runtime_error("Connecting TCP Socket failed");
     }
 
+    finishConnect();
+}
+
+bool TcpStream::startConnect()
+{
+    if (!connectSocket(true)) return false;
+
+    // Restore the configured blocking mode
+    setNonBlocking(nonBlocking);
+    return true;
 }
 
 
 #ifdef NETLIB_SSL
 void TcpStream::connect(SSL_CTX *ctx)
 {
+    if (nonBlocking)
+        throw std::runtime_error("Can't connect using TLS in non-blocking mode");
+
     this->connect();
 
     SSL *ssl = SSL_new(ctx);
@@ -135,36 +234,174 @@ void TcpStream::connect(SSL_CTX *ctx)
 }
 #endif // NETLIB_SSL
 
-void TcpStream::close()
+bool TcpStream::finishConnect()
+{
+    if (!isSocketValid())
+        throw std::runtime_error("Can't finish connect on closed socket");
+
+    pollfd pfd;
+    std::memset(&pfd, 0, sizeof(pollfd));
+    pfd.fd = socket->sockfd;
+    pfd.events = POLLOUT;
+
+    // The socket becomes writable once the connect completed or failed
+    int res = poll(&pfd, 1, 0);
+    if (res == 0) return false;
+
+    int error = 0;
+    socklen_t errorLen = sizeof(error);
+    if (res < 0 || getsockopt(socket->sockfd, SOL_SOCKET, SO_ERROR, &error, &errorLen) != 0)
+    {
+        close();
+        throw std::runtime_error("Connecting TCP Socket failed");
+    }
+
+    if (error != 0)
+    {
+        close();
+        throw std::system_error(std::error_code{error, std::system_category()}, 
+            "Connecting TCP Socket failed");
+    }
+
+    // Restore the configured blocking mode, if the connect was started by
+    // startConnect
+    setNonBlocking(nonBlocking);
+    return true;
+}
+
+void TcpStream::setNonBlocking(bool _nonBlocking)
 {
-    if (socket == nullptr) return;
+    if (isSocketValid())
+    {
+        int flags = fcntl(socket->sockfd, F_GETFL);
+        flags = _nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+        if (flags < 0 || fcntl(socket->sockfd, F_SETFL, flags) != 0)
+            throw std::runtime_error("Changing the blocking mode failed");
+    }
+
+    nonBlocking = _nonBlocking;
+}
+
+bool TcpStream::isNonBlocking() const
+{
+    return nonBlocking;
+}
+
+void TcpStream::setOptions(const SockOptions &_options)
+{
+    if (isSocketValid()) _options.apply(socket->sockfd);
+
+    options = _options;
+}
+
+const SockOptions & TcpStream::getOptions() const
+{
+    return options;
+}
+
+void TcpStream::setTimeoutMode(TimeoutMode mode)
+{
+    timeoutMode = mode;
+}
+
+TimeoutMode TcpStream::getTimeoutMode() const
+{
+    return timeoutMode;
+}
+
+int TcpStream::getSocketFd() const
+{
+    return isSocketValid() ? socket->sockfd : 0;
+}
+
+IoCounters TcpStream::getIoCounters() const
+{
+    return socket->ioCounters.load();
+}
+
+bool TcpStream::waitReady(short events) noexcept
+{
+    pollfd pfd;
+    std::memset(&pfd, 0, sizeof(pollfd));
+    pfd.fd = socket->sockfd;
+    pfd.events = events;
 
+    while (poll(&pfd, 1, -1) < 0)
+    {
+        if (errno != EINTR) return false;
+    }
+    return true;
+}
+
+int TcpStream::waitReady(short events, Deadline deadline) noexcept
+{
+    pollfd pfd;
+    std::memset(&pfd, 0, sizeof(pollfd));
+    pfd.fd = socket->sockfd;
+    pfd.events = events;
+
+    while (true)
+    {
+        // Round up, so that poll does not return just before the deadline
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+
+        // poll only takes an int timeout, so far deadlines are waited for in steps
+        int res = poll(&pfd, 1, (int)std::clamp<decltype(remaining)>(remaining, 0, INT_MAX));
+
+        if (res == 0 && remaining > INT_MAX) continue;
+        if (res >= 0) return res;
+        if (errno != EINTR) return -1;
+    }
+}
+
+void TcpStream::close()
+{
     if (isSocketValid())
     {
         socket->close();
     }
 }
 
-ssize_t TcpStream::send(const void *data, size_t len)
+ssize_t TcpStream::send(const void *data, size_t len, std::error_code &ec) noexcept
 {
     if (!isSocketValid())
-        throw std::runtime_error("Can't write to closed socket");
+    {
+        ec = std::make_error_code(std::errc::not_connected);
+        return -1;
+    }
     
     ssize_t bytes_sent = socket->write(data, len);
 
     if (bytes_sent < 0)
     {
-        close();
-        throw std::runtime_error("Error while writing to socket");
+        ec = lastError();
+        if (!wouldBlock()) close();
+        return -1;
     }
 
+    ec.clear();
     return bytes_sent;
 }
 
-void TcpStream::sendAll(const void *data, size_t len)
+ssize_t TcpStream::send(const void *data, size_t len)
+{
+    std::error_code ec;
+    ssize_t bytes_sent = send(data, len, ec);
+
+    if (ec && ec != std::errc::operation_would_block)
+        throw std::system_error(ec, "Error while writing to socket");
+
+    return bytes_sent;
+}
+
+void TcpStream::sendAll(const void *data, size_t len, std::error_code &ec) noexcept
 {
     if (!isSocketValid())
-        throw std::runtime_error("Can't write to closed socket");
+    {
+        ec = std::make_error_code(std::errc::not_connected);
+        return;
+    }
     
     size_t bytesSentTotal = 0;
 
@@ -174,12 +411,26 @@ void TcpStream::sendAll(const void *data, size_t len)
 
         if (bytesSent < 0)
         {
+            // In non-blocking mode, wait until the socket can take more data
+            if (wouldBlock() && waitReady(POLLOUT)) continue;
+
+            ec = lastError();
             close();
-            throw std::runtime_error("Error while writing to socket");
+            return;
         }
 
         bytesSentTotal += bytesSent;
     }
+
+    ec.clear();
+}
+
+void TcpStream::sendAll(const void *data, size_t len)
+{
+    std::error_code ec;
+    sendAll(data, len, ec);
+
+    if (ec) throw std::system_error(ec, "Error while writing to socket");
 }
 
 void TcpStream::sendAllString(const std::string &str)
@@ -187,124 +438,780 @@ void TcpStream::sendAllString(const std::string &str)
     sendAll(str.c_str(), str.size());
 }
 
-ssize_t TcpStream::read(void *data, size_t len)
+void TcpStream::sendAllv(const iovec *buffers, size_t count)
 {
     if (!isSocketValid())
-        throw std::runtime_error("Can't read from closed socket");
+        throw std::runtime_error("Can't write to closed socket");
 
-    ssize_t bytes_read = socket->read(data, len);
-    if (bytes_read < 0)
-    {
-        close();
-        throw std::runtime_error("Error while reading from socket");
-    }
-    return bytes_read;
-}
+    // The given entries can't be modified, so a window of them is copied for
+    // each write. This allows advancing the first entry after partial writes.
+    iovec window[IOV_WINDOW];
+
+    size_t index = 0;
+    size_t offset = 0;
 
-ssize_t TcpStream::readAll(void *data, size_t len)
-{
-    if (!isSocketValid())
-        throw std::runtime_error("Can't read from closed socket");
-    
-    size_t bytesReadTotal = 0;
     while (true)
     {
-        ssize_t bytesRead = socket->read((uint8_t*)data + bytesReadTotal, len-bytesReadTotal);
+        // Skip all entries that are already sent completely
+        while (index < count && offset >= buffers[index].iov_len)
+        {
+            index++;
+            offset = 0;
+        }
 
-        if (bytesRead == 0) break;
-        if (bytesRead < 0)
+        if (index >= count) break;
+
+        size_t windowLen = std::min(count - index, IOV_WINDOW);
+        std::memcpy(window, buffers + index, windowLen * sizeof(iovec));
+        window[0].iov_base = (uint8_t*)window[0].iov_base + offset;
+        window[0].iov_len -= offset;
+
+        ssize_t bytesSent = socket->writev(window, windowLen);
+
+        if (bytesSent < 0)
         {
+            // In non-blocking mode, wait until the socket can take more data
+            if (wouldBlock() && waitReady(POLLOUT)) continue;
+
             close();
-            throw std::runtime_error("Error while reading from socket");
+            throw std::runtime_error("Error while writing to socket");
         }
 
-        bytesReadTotal += bytesRead;
+        // Advance across all entries that were sent by this write
+        size_t remaining = bytesSent;
+        while (remaining > 0)
+        {
+            size_t left = buffers[index].iov_len - offset;
+            if (remaining < left)
+            {
+                offset += remaining;
+                break;
+            }
+
+            remaining -= left;
+            index++;
+            offset = 0;
+        }
     }
-    return bytesReadTotal;
 }
 
-ssize_t TcpStream::readTimeout(void *data, size_t len, int timeoutMs)
+void TcpStream::sendFile(int fd, off_t offset, size_t length)
 {
-    if (timeoutMs <= 0) return read(data, len);
-
     if (!isSocketValid())
-        throw std::runtime_error("Can't read from closed socket");
+        throw std::runtime_error("Can't write to closed socket");
 
-    pollfd pfd;
-    std::memset(&pfd, 0, sizeof(pollfd));
+#ifdef NETLIB_SSL
+    // The data has to be encrypted in user space anyways
+    if (socket->ssl != nullptr)
+    {
+        uint8_t buffer[16 * 1024];
 
-    pfd.fd = socket->sockfd;
-    pfd.events = POLLIN;
-    
-    // block until data is available or the timeout is reached
-    int res = poll(&pfd, 1, timeoutMs);
+        while (length > 0)
+        {
+            ssize_t bytesRead = pread(fd, buffer, std::min(length, sizeof(buffer)), offset);
 
-    // a timout occured
-    if (res == 0) return 0;
+            if (bytesRead < 0)
+                throw std::runtime_error("Error while reading from file");
+            if (bytesRead == 0)
+                throw std::runtime_error("Unexpected end of file");
 
-    // a poll error occured
-    if (res < 0)
-    {
-        close();
-        throw std::runtime_error("Error while reading from socket");
+            sendAll(buffer, bytesRead);
+
+            offset += bytesRead;
+            length -= bytesRead;
+        }
+        return;
     }
+#endif // NETLIB_SSL
 
-    ssize_t bytes_read = socket->read(data, len);
-    if (bytes_read < 0)
+    while (length > 0)
     {
-        close();
-        throw std::runtime_error("Error while reading from socket");
+        // sendfile advances the offset by the number of bytes sent
+        ssize_t bytesSent = measureIo(IoOp::TcpWrite, socket->ioCounters, [&]() {
+            return ::sendfile(socket->sockfd, fd, &offset, length);
+        });
+
+        if (bytesSent < 0)
+        {
+            // In non-blocking mode, wait until the socket can take more data
+            if (wouldBlock() && waitReady(POLLOUT)) continue;
+
+            close();
+            throw std::runtime_error("Error while writing to socket");
+        }
+        if (bytesSent == 0)
+            throw std::runtime_error("Unexpected end of file");
+
+        length -= bytesSent;
     }
-    return bytes_read;
 }
 
-ssize_t TcpStream::readAllTimeout(void *data, size_t len, int timeoutMs)
+#ifdef NETLIB_SSL
+
+/**
+ * @brief Write all len bytes of data to the file fd at its current offset.
+ * 
+ * @return False if writing failed.
+ */
+static bool writeAllToFile(int fd, const uint8_t *data, size_t len)
 {
-    if (timeoutMs <= 0) return readAll(data, len);
+    while (len > 0)
+    {
+        ssize_t written = ::write(fd, data, len);
+        if (written < 0)
+        {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        data += written;
+        len -= written;
+    }
+    return true;
+}
+
+#endif // NETLIB_SSL
 
+size_t TcpStream::receiveToFile(int fd, size_t length)
+{
     if (!isSocketValid())
         throw std::runtime_error("Can't read from closed socket");
-    
-    pollfd pfd;
-    std::memset(&pfd, 0, sizeof(pollfd));
 
-    pfd.fd = socket->sockfd;
-    pfd.events = POLLIN;
-    
-    
     size_t bytesReadTotal = 0;
-    while (true)
-    {
-        // block until data is available or the timeout is reached
-        int res = poll(&pfd, 1, timeoutMs);
 
-        // a timout occured
-        if (res == 0) return -1 * bytesReadTotal;
+#ifdef NETLIB_SSL
+    // The data has to be decrypted in user space anyways
+    if (socket->ssl != nullptr)
+    {
+        uint8_t buffer[16 * 1024];
 
-        // a poll error occured
-        if (res < 0)
+        while (bytesReadTotal < length)
         {
-            close();
-            throw std::runtime_error("Error while reading from socket");
+            ssize_t bytesRead = socket->read(buffer, std::min(length - bytesReadTotal, sizeof(buffer)));
+
+            if (bytesRead == 0) break;
+            if (bytesRead < 0)
+            {
+                // In non-blocking mode, wait until more data is available
+                if (wouldBlock() && waitReady(POLLIN)) continue;
+
+                close();
+                throw std::runtime_error("Error while reading from socket");
+            }
+
+            if (!writeAllToFile(fd, buffer, bytesRead))
+            {
+                close();
+                throw std::runtime_error("Error while writing to file");
+            }
+
+            bytesReadTotal += bytesRead;
         }
+        return bytesReadTotal;
+    }
+#endif // NETLIB_SSL
 
-        ssize_t bytesRead = socket->read((uint8_t*)data + bytesReadTotal, len-bytesReadTotal);
+    Pipe pipe;
+
+    while (bytesReadTotal < length)
+    {
+        ssize_t bytesRead = measureIo(IoOp::TcpRead, socket->ioCounters, [&]() {
+            return pipe.spliceFrom(socket->sockfd, length - bytesReadTotal, SPLICE_F_MOVE | SPLICE_F_MORE);
+        });
 
         if (bytesRead == 0) break;
         if (bytesRead < 0)
         {
+            if (errno == EINTR) continue;
+            // In non-blocking mode, wait until more data is available
+            if (wouldBlock() && waitReady(POLLIN)) continue;
+
             close();
             throw std::runtime_error("Error while reading from socket");
         }
 
+        // Drain the pipe completely, so the next splice has its full capacity
+        ssize_t pending = bytesRead;
+        while (pending > 0)
+        {
+            ssize_t bytesWritten = pipe.spliceTo(fd, pending, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (bytesWritten < 0 && errno == EINTR) continue;
+            if (bytesWritten <= 0)
+            {
+                close();
+                throw std::runtime_error("Error while writing to file");
+            }
+            pending -= bytesWritten;
+        }
+
         bytesReadTotal += bytesRead;
     }
     return bytesReadTotal;
 }
 
-const SockAddr & TcpStream::getRemoteAddr() const
+bool TcpStream::enableZerocopy(size_t minSize)
 {
-    return remote;
+    if (!isSocketValid())
+        throw std::runtime_error("Can't enable zerocopy on closed socket");
+
+#ifdef NETLIB_SSL
+    if (socket->ssl != nullptr) return false;
+#endif // NETLIB_SSL
+
+    int value = 1;
+    if (setsockopt(socket->sockfd, SOL_SOCKET, SO_ZEROCOPY, &value, sizeof(value)) != 0)
+    {
+        return false;
+    }
+
+    socket->zerocopy = true;
+    socket->zerocopyThreshold = minSize;
+    return true;
+}
+
+uint64_t TcpStream::sendAllZerocopy(const void *data, size_t len)
+{
+    if (!isSocketValid())
+        throw std::runtime_error("Can't write to closed socket");
+
+    if (!socket->zerocopy || len < socket->zerocopyThreshold)
+    {
+        sendAll(data, len);
+        return 0;
+    }
+
+    size_t bytesSentTotal = 0;
+
+    while (bytesSentTotal < len)
+    {
+        const uint8_t *chunk = (const uint8_t*)data + bytesSentTotal;
+        size_t chunkLen = len - bytesSentTotal;
+
+        ssize_t bytesSent = measureIo(IoOp::TcpWrite, socket->ioCounters, [&]() {
+            return ::send(socket->sockfd, chunk, chunkLen, MSG_ZEROCOPY);
+        });
+
+        if (bytesSent >= 0)
+        {
+            socket->zerocopyIssued++;
+        }
+        else if (errno == ENOBUFS)
+        {
+            // The pinned page limit is reached, so this part is copied
+            bytesSent = socket->write(chunk, chunkLen);
+        }
+
+        if (bytesSent < 0)
+        {
+            // In non-blocking mode, wait until the socket can take more data
+            if (wouldBlock() && waitReady(POLLOUT)) continue;
+
+            close();
+            throw std::runtime_error("Error while writing to socket");
+        }
+
+        bytesSentTotal += bytesSent;
+    }
+
+    return socket->zerocopyIssued;
+}
+
+bool TcpStream::isZerocopyComplete(uint64_t id)
+{
+    if (!isSocketValid())
+        throw std::runtime_error("Can't check zerocopy on closed socket");
+
+    if (socket->zerocopyCompleted >= id) return true;
+
+    if (!socket->processZerocopyNotifications())
+        throw std::runtime_error("Error while reading zerocopy notifications");
+
+    return socket->zerocopyCompleted >= id;
+}
+
+bool TcpStream::waitZerocopy(uint64_t id, int timeoutMs)
+{
+    // The timeout applies to the whole wait, not to every single poll
+    Deadline deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    int pauseMs = 1;
+
+    while (!isZerocopyComplete(id))
+    {
+        int waitMs = -1;
+        if (timeoutMs >= 0)
+        {
+            // Round up, so that poll does not return just before the deadline
+            auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0) return false;
+            waitMs = (int)remaining;
+        }
+
+        uint64_t completed = socket->zerocopyCompleted;
+
+        // Pending notifications in the error queue are reported as POLLERR
+        pollfd pfd;
+        std::memset(&pfd, 0, sizeof(pollfd));
+        pfd.fd = socket->sockfd;
+
+        int res = poll(&pfd, 1, waitMs);
+        if (res < 0 && errno == EINTR) continue;
+
+        if (res == 0) return false;
+        if (res < 0)
+            throw std::runtime_error("Error while waiting for zerocopy notifications");
+
+        if (isZerocopyComplete(id)) return true;
+
+        // A hang-up or a socket error is reported until the socket is closed, so poll returns 
+        // immediately even if no notification arrived. Wait with an increasing pause instead 
+        // of spinning until the kernel releases the buffers.
+        if (socket->zerocopyCompleted == completed && (pfd.revents & (POLLHUP | POLLERR)))
+        {
+            poll(nullptr, 0, waitMs < 0 ? pauseMs : std::min(pauseMs, waitMs));
+            pauseMs = std::min(pauseMs * 2, 64);
+        }
+        else
+        {
+            pauseMs = 1;
+        }
+    }
+
+    return true;
+}
+
+ssize_t TcpStream::read(void *data, size_t len, std::error_code &ec) noexcept
+{
+    if (!isSocketValid())
+    {
+        ec = std::make_error_code(std::errc::not_connected);
+        return -1;
+    }
+
+    ssize_t bytes_read = socket->read(data, len);
+
+    // A blocking socket only reports EAGAIN if a kernel receive timeout is set
+    while (bytes_read < 0 && wouldBlock() && !nonBlocking && waitReady(POLLIN))
+        bytes_read = socket->read(data, len);
+
+    if (bytes_read < 0)
+    {
+        ec = lastError();
+        if (!wouldBlock()) close();
+        return -1;
+    }
+
+    ec.clear();
+    return bytes_read;
+}
+
+ssize_t TcpStream::read(void *data, size_t len)
+{
+    std::error_code ec;
+    ssize_t bytes_read = read(data, len, ec);
+
+    if (ec && ec != std::errc::operation_would_block)
+        throw std::system_error(ec, "Error while reading from socket");
+
+    return bytes_read;
+}
+
+ssize_t TcpStream::readAll(void *data, size_t len, std::error_code &ec) noexcept
+{
+    if (!isSocketValid())
+    {
+        ec = std::make_error_code(std::errc::not_connected);
+        return -1;
+    }
+    
+    size_t bytesReadTotal = 0;
+    while (true)
+    {
+        ssize_t bytesRead = socket->read((uint8_t*)data + bytesReadTotal, len-bytesReadTotal);
+
+        if (bytesRead == 0) break;
+        if (bytesRead < 0)
+        {
+            // In non-blocking mode, wait until more data is available
+            if (wouldBlock() && waitReady(POLLIN)) continue;
+
+            ec = lastError();
+            close();
+            return -1;
+        }
+
+        bytesReadTotal += bytesRead;
+    }
+
+    ec.clear();
+    return bytesReadTotal;
+}
+
+ssize_t TcpStream::readAll(void *data, size_t len)
+{
+    std::error_code ec;
+    ssize_t bytesReadTotal = readAll(data, len, ec);
+
+    if (ec) throw std::system_error(ec, "Error while reading from socket");
+
+    return bytesReadTotal;
+}
+
+void TcpStream::readExact(void *data, size_t len)
+{
+    if (!isSocketValid())
+        throw std::runtime_error("Can't read from closed socket");
+
+    size_t bytesReadTotal = 0;
+    while (bytesReadTotal < len)
+    {
+        // A single call is enough unless a signal interrupts it or TLS returns
+        // a single record
+        ssize_t bytesRead = socket->readWaitAll((uint8_t*)data + bytesReadTotal, len-bytesReadTotal);
+
+        if (bytesRead == 0)
+            throw std::runtime_error("Connection closed before all data was received");
+        if (bytesRead < 0)
+        {
+            if (errno == EINTR) continue;
+            // In non-blocking mode, wait until more data is available
+            if (wouldBlock() && waitReady(POLLIN)) continue;
+
+            std::error_code ec = lastError();
+            close();
+            throw std::system_error(ec, "Error while reading from socket");
+        }
+
+        bytesReadTotal += bytesRead;
+    }
+}
+
+size_t TcpStream::readToEnd(ByteBuffer &buffer, size_t initialCapacity)
+{
+    if (!isSocketValid())
+        throw std::runtime_error("Can't read from closed socket");
+
+    size_t start = buffer.size();
+
+    if (buffer.capacity() == buffer.size())
+        buffer.reserve(buffer.size() + std::max<size_t>(initialCapacity, 1));
+
+    while (true)
+    {
+        // Double the capacity once it is used up
+        if (buffer.capacity() == buffer.size())
+            buffer.reserve(buffer.capacity() * 2);
+
+        size_t used = buffer.size();
+        buffer.resize(buffer.capacity());
+
+        ssize_t bytesRead = socket->read(buffer.data() + used, buffer.size() - used);
+
+        buffer.resize(used + std::max<ssize_t>(bytesRead, 0));
+
+        if (bytesRead == 0) break;
+        if (bytesRead < 0)
+        {
+            // In non-blocking mode, wait until more data is available
+            if (wouldBlock() && waitReady(POLLIN)) continue;
+
+            std::error_code ec = lastError();
+            close();
+            throw std::system_error(ec, "Error while reading from socket");
+        }
+    }
+
+    return buffer.size() - start;
+}
+
+ssize_t TcpStream::readv(const iovec *buffers, size_t count)
+{
+    if (!isSocketValid())
+        throw std::runtime_error("Can't read from closed socket");
+
+    ssize_t bytes_read = socket->readv(buffers, std::min(count, IOV_WINDOW));
+
+    // A blocking socket only reports EAGAIN if a kernel receive timeout is set
+    while (bytes_read < 0 && wouldBlock() && !nonBlocking && waitReady(POLLIN))
+        bytes_read = socket->readv(buffers, std::min(count, IOV_WINDOW));
+
+    if (bytes_read < 0)
+    {
+        if (wouldBlock()) return -1;
+
+        close();
+        throw std::runtime_error("Error while reading from socket");
+    }
+    return bytes_read;
+}
+
+ssize_t TcpStream::peek(void *data, size_t len)
+{
+    if (!isSocketValid())
+        throw std::runtime_error("Can't read from closed socket");
+
+    ssize_t bytes_read = socket->peek(data, len);
+
+    // A blocking socket only reports EAGAIN if a kernel receive timeout is set
+    while (bytes_read < 0 && wouldBlock() && !nonBlocking && waitReady(POLLIN))
+        bytes_read = socket->peek(data, len);
+
+    if (bytes_read < 0)
+    {
+        if (wouldBlock() && nonBlocking) return -1;
+
+        std::error_code ec = lastError();
+        close();
+        throw std::system_error(ec, "Error while reading from socket");
+    }
+    return bytes_read;
+}
+
+size_t TcpStream::available() const
+{
+    if (!isSocketValid())
+        throw std::runtime_error("Can't query closed socket");
+
+    ssize_t bytes = socket->available();
+    if (bytes < 0)
+        throw std::system_error(errno, std::system_category(), "Querying available bytes failed");
+
+    return bytes;
+}
+
+ssize_t TcpStream::readTimed(void *data, size_t len, int timeoutMs, bool &timedOut)
+{
+    timedOut = false;
+
+    ssize_t bytes_read;
+
+    if (timeoutMode == TimeoutMode::Kernel && !nonBlocking)
+    {
+        std::error_code ec;
+        socket->recvTimeout.set(socket->sockfd, timeoutMs, ec);
+        if (ec)
+        {
+            close();
+            throw std::system_error(ec, "Setting the receive timeout failed");
+        }
+
+        bytes_read = socket->read(data, len);
+
+        // The kernel reports the timeout as EAGAIN
+        if (bytes_read < 0 && wouldBlock())
+        {
+            timedOut = true;
+            return -1;
+        }
+    }
+    else
+    {
+        // Only poll if no data is available yet
+        if (timeoutMode != TimeoutMode::Poll)
+        {
+            bytes_read = socket->readNonBlocking(data, len);
+            if (bytes_read >= 0) return bytes_read;
+            if (!wouldBlock())
+            {
+                close();
+                throw std::runtime_error("Error while reading from socket");
+            }
+        }
+
+        pollfd pfd;
+        std::memset(&pfd, 0, sizeof(pollfd));
+
+        pfd.fd = socket->sockfd;
+        pfd.events = POLLIN;
+
+        // block until data is available or the timeout is reached
+        int res = poll(&pfd, 1, timeoutMs);
+
+        // a timout occured
+        if (res == 0)
+        {
+            timedOut = true;
+            return -1;
+        }
+
+        // a poll error occured
+        if (res < 0)
+        {
+            close();
+            throw std::runtime_error("Error while reading from socket");
+        }
+
+        bytes_read = socket->read(data, len);
+
+        // The readiness was spurious
+        if (bytes_read < 0 && wouldBlock()) return -1;
+    }
+
+    if (bytes_read < 0)
+    {
+        close();
+        throw std::runtime_error("Error while reading from socket");
+    }
+    return bytes_read;
+}
+
+ssize_t TcpStream::readTimeout(void *data, size_t len, int timeoutMs)
+{
+    if (timeoutMs <= 0) return read(data, len);
+
+    if (!isSocketValid())
+        throw std::runtime_error("Can't read from closed socket");
+
+    bool timedOut;
+    ssize_t bytes_read = readTimed(data, len, timeoutMs, timedOut);
+
+    // A spurious readiness is reported like a timeout
+    if (bytes_read < 0) return 0;
+
+    return bytes_read;
+}
+
+ssize_t TcpStream::readAllTimeout(void *data, size_t len, int timeoutMs)
+{
+    if (timeoutMs <= 0) return readAll(data, len);
+
+    if (!isSocketValid())
+        throw std::runtime_error("Can't read from closed socket");
+    
+    size_t bytesReadTotal = 0;
+    while (bytesReadTotal < len)
+    {
+        bool timedOut;
+        ssize_t bytesRead = readTimed((uint8_t*)data + bytesReadTotal, len-bytesReadTotal, timeoutMs, timedOut);
+
+        // a timout occured
+        if (timedOut) return -1 * bytesReadTotal;
+
+        if (bytesRead == 0) break;
+        if (bytesRead < 0) continue;
+
+        bytesReadTotal += bytesRead;
+    }
+    return bytesReadTotal;
+}
+
+ssize_t TcpStream::readDeadline(void *data, size_t len, Deadline deadline)
+{
+    if (!isSocketValid())
+        throw std::runtime_error("Can't read from closed socket");
+
+    // Only wait if no data is available yet. The reads never block, so TLS records that 
+    // arrive in parts can't hold the caller past the deadline.
+    ssize_t bytes_read = socket->readNonBlocking(data, len);
+
+    while (bytes_read < 0 && wouldBlock())
+    {
+        int res = waitReady(socket->retryEvents(POLLIN), deadline);
+
+        // a timout occured
+        if (res == 0) return 0;
+        if (res < 0) break;
+
+        bytes_read = socket->readNonBlocking(data, len);
+    }
+
+    if (bytes_read < 0)
+    {
+        close();
+        throw std::runtime_error("Error while reading from socket");
+    }
+    return bytes_read;
+}
+
+ssize_t TcpStream::readAllDeadline(void *data, size_t len, Deadline deadline)
+{
+    if (!isSocketValid())
+        throw std::runtime_error("Can't read from closed socket");
+
+    size_t bytesReadTotal = 0;
+
+    while (bytesReadTotal < len)
+    {
+        uint8_t *chunk = (uint8_t*)data + bytesReadTotal;
+        size_t chunkLen = len - bytesReadTotal;
+
+        ssize_t bytesRead = socket->readNonBlocking(chunk, chunkLen);
+
+        if (bytesRead == 0) break;
+        if (bytesRead < 0)
+        {
+            if (!wouldBlock())
+            {
+                close();
+                throw std::runtime_error("Error while reading from socket");
+            }
+
+            int res = waitReady(socket->retryEvents(POLLIN), deadline);
+
+            // a timout occured
+            if (res == 0) return -1 * bytesReadTotal;
+            if (res < 0)
+            {
+                close();
+                throw std::runtime_error("Error while reading from socket");
+            }
+            continue;
+        }
+
+        bytesReadTotal += bytesRead;
+    }
+    return bytesReadTotal;
+}
+
+ssize_t TcpStream::sendAllDeadline(const void *data, size_t len, Deadline deadline)
+{
+    if (!isSocketValid())
+        throw std::runtime_error("Can't write to closed socket");
+
+    size_t bytesSentTotal = 0;
+
+    while (bytesSentTotal < len)
+    {
+        ssize_t bytesSent = socket->writeNonBlocking((uint8_t*)data + bytesSentTotal, len-bytesSentTotal);
+
+        if (bytesSent < 0)
+        {
+            if (!wouldBlock())
+            {
+                close();
+                throw std::runtime_error("Error while writing to socket");
+            }
+
+            // A failed SSL_write is repeated with the same arguments
+            int res = waitReady(socket->retryEvents(POLLOUT), deadline);
+
+            // a timout occured
+            if (res == 0) return -1 * bytesSentTotal;
+            if (res < 0)
+            {
+                close();
+                throw std::runtime_error("Error while writing to socket");
+            }
+            continue;
+        }
+
+        bytesSentTotal += bytesSent;
+    }
+    return bytesSentTotal;
+}
+
+const SockAddr & TcpStream::getRemoteAddr() const
+{
+    return remote;
+}
+
+TransportInfo TcpStream::transportInfo() const
+{
+    if (!isSocketValid())
+        throw std::runtime_error("Can't get transport info of closed socket");
+
+    return TransportInfo::fromSocket(socket->sockfd);
 }
 
 #ifdef NETLIB_SSL
@@ -332,8 +1239,11 @@ void TcpStream::setAutoclose(bool _autoclose)
 TcpStream TcpStream::clone() const
 {
     TcpStream other{remote};
-    other.socket = socket;
+    other.socket = socket.share();
     other.autoclose = autoclose;
+    other.nonBlocking = nonBlocking;
+    other.options = options;
+    other.timeoutMode = timeoutMode;
 
     return other;
 }
\ No newline at end of file
@@ -0,0 +1,51 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#include "timeoutmode.hpp"
+
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+
+using namespace netlib;
+
+void RecvTimeout::set(int sockfd, int timeoutMs, std::error_code &ec) noexcept
+{
+    ec.clear();
+
+    if (timeoutMs == currentMs.load(std::memory_order_relaxed)) return;
+
+    timeval tv;
+    tv.tv_sec = timeoutMs / 1000;
+    tv.tv_usec = (timeoutMs % 1000) * 1000;
+
+    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != 0)
+    {
+        ec = std::error_code{errno, std::system_category()};
+        return;
+    }
+
+    currentMs.store(timeoutMs, std::memory_order_relaxed);
+}
+
+void RecvTimeout::set(int sockfd, int timeoutMs)
+{
+    std::error_code ec;
+    set(sockfd, timeoutMs, ec);
+
+    if (ec) throw std::system_error(ec, "Setting the receive timeout failed");
+}
+
+int RecvTimeout::get() const
+{
+    return currentMs.load(std::memory_order_relaxed);
+}
+
+void RecvTimeout::reset()
+{
+    currentMs.store(0, std::memory_order_relaxed);
+}
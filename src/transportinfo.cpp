@@ -0,0 +1,57 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#include "transportinfo.hpp"
+
+#include <system_error>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+
+using namespace netlib;
+
+TransportInfo TransportInfo::fromSocket(int sockfd)
+{
+    // Older kernels fill less of the struct, the rest stays 0
+    tcp_info raw;
+    std::memset(&raw, 0, sizeof(raw));
+    socklen_t len = sizeof(raw);
+
+    if (getsockopt(sockfd, IPPROTO_TCP, TCP_INFO, &raw, &len) != 0)
+        throw std::system_error(errno, std::system_category(), "Querying TCP_INFO failed");
+
+    TransportInfo info;
+    info.state = raw.tcpi_state;
+    info.caState = raw.tcpi_ca_state;
+    info.rttUs = raw.tcpi_rtt;
+    info.rttVarUs = raw.tcpi_rttvar;
+    info.minRttUs = raw.tcpi_min_rtt;
+    info.rtoUs = raw.tcpi_rto;
+    info.sendCwnd = raw.tcpi_snd_cwnd;
+    info.sendSsthresh = raw.tcpi_snd_ssthresh;
+    info.sendMss = raw.tcpi_snd_mss;
+    info.pmtu = raw.tcpi_pmtu;
+    info.unacked = raw.tcpi_unacked;
+    info.lost = raw.tcpi_lost;
+    info.totalRetrans = raw.tcpi_total_retrans;
+    info.notSentBytes = raw.tcpi_notsent_bytes;
+    info.peerReceiveWindow = raw.tcpi_snd_wnd;
+    info.deliveryRate = raw.tcpi_delivery_rate;
+    info.deliveryRateAppLimited = raw.tcpi_delivery_rate_app_limited;
+    info.pacingRate = raw.tcpi_pacing_rate;
+    info.bytesSent = raw.tcpi_bytes_sent;
+    info.bytesRetrans = raw.tcpi_bytes_retrans;
+    info.bytesAcked = raw.tcpi_bytes_acked;
+    info.bytesReceived = raw.tcpi_bytes_received;
+    info.busyTimeUs = raw.tcpi_busy_time;
+    info.receiveWindowLimitedUs = raw.tcpi_rwnd_limited;
+    info.sendBufferLimitedUs = raw.tcpi_sndbuf_limited;
+
+    return info;
+}
@@ -0,0 +1,98 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#include "transportsampler.hpp"
+
+#include <algorithm>
+#include <system_error>
+
+using namespace netlib;
+
+TransportSampler::TransportSampler(std::chrono::milliseconds _interval, size_t _maxSamples)
+    : interval{_interval}, maxSamples{_maxSamples}, nextSample{std::chrono::steady_clock::now()}
+{ }
+
+/**
+ * @brief Check if the tracked clone refers to the same open socket as the stream.
+ */
+static bool isSameSocket(const TcpStream &tracked, const TcpStream &stream)
+{
+    return !tracked.isClosed() && tracked.getSocketFd() == stream.getSocketFd();
+}
+
+void TransportSampler::track(const TcpStream &stream)
+{
+    if (stream.isClosed()) return;
+
+    auto it = std::find_if(streams.begin(), streams.end(), 
+        [&stream](const TcpStream &tracked) { return isSameSocket(tracked, stream); });
+    if (it != streams.end()) return;
+
+    streams.push_back(stream.clone());
+    streams.back().setAutoclose(false);
+}
+
+void TransportSampler::untrack(const TcpStream &stream)
+{
+    // Closed streams are removed as well, their file descriptor can't be compared anymore
+    streams.erase(std::remove_if(streams.begin(), streams.end(), 
+        [&stream](const TcpStream &tracked) { return tracked.isClosed() || isSameSocket(tracked, stream); }), 
+        streams.end());
+}
+
+size_t TransportSampler::getTracked() const
+{
+    return streams.size();
+}
+
+bool TransportSampler::sampleIfDue()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now < nextSample) return false;
+
+    sample();
+    return true;
+}
+
+void TransportSampler::sample()
+{
+    auto now = std::chrono::steady_clock::now();
+    nextSample = now + interval;
+
+    // Closed streams are untracked
+    streams.erase(std::remove_if(streams.begin(), streams.end(), 
+        [](const TcpStream &stream) { return stream.isClosed(); }), streams.end());
+
+    for (const TcpStream &stream : streams)
+    {
+        TransportSample s;
+        s.time = now;
+        s.remote = stream.getRemoteAddr();
+        s.sockfd = stream.getSocketFd();
+
+        try
+        {
+            s.info = TransportInfo::fromSocket(s.sockfd);
+        }
+        catch (const std::system_error &)
+        {
+            // The connection can fail at any time, that is not an error of 
+            // the sampler
+            continue;
+        }
+
+        if (maxSamples == 0) continue;
+        if (samples.size() >= maxSamples) samples.pop_front();
+        samples.push_back(s);
+    }
+}
+
+std::vector<TransportSample> TransportSampler::takeSamples()
+{
+    std::vector<TransportSample> result(samples.begin(), samples.end());
+    samples.clear();
+    return result;
+}
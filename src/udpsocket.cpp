@@ -5,16 +5,40 @@
  */
 
 #include "udpsocket.hpp"
+#include "linescanner.hpp"
 
 #include <stdexcept>
+#include <system_error>
 
 #include <unistd.h>
 #include <cstring>
 #include <sys/socket.h>
+#include <sys/ioctl.h>
 #include <poll.h>
+#include <cerrno>
+#include <fcntl.h>
 
 using namespace netlib;
 
+/**
+ * @brief Block until the socket is readable.
+ * 
+ * @return False if polling failed.
+ */
+static bool waitReadable(int sockfd) noexcept
+{
+    pollfd pfd;
+    std::memset(&pfd, 0, sizeof(pollfd));
+    pfd.fd = sockfd;
+    pfd.events = POLLIN;
+
+    while (poll(&pfd, 1, -1) < 0)
+    {
+        if (errno != EINTR) return false;
+    }
+    return true;
+}
+
 UdpSocket::UdpSocket()
     : UdpSocket{"0.0.0.0", 0}
 { }
@@ -57,7 +81,9 @@ UdpSocket::~UdpSocket()
 
 UdpSocket::UdpSocket(UdpSocket &&other)
     : local{other.local}, sockfd{other.sockfd}, raw_socklen{other.raw_socklen}, 
-        address_family{other.address_family}, autoclose{other.autoclose}
+        address_family{other.address_family}, autoclose{other.autoclose}, 
+        nonBlocking{other.nonBlocking}, options{other.options}, ioCounters{other.ioCounters}, 
+        timeoutMode{other.timeoutMode}, recvTimeout{std::move(other.recvTimeout)}
 {
     // Invalidate the moved from socket
     other.sockfd = 0;
@@ -70,6 +96,11 @@ UdpSocket& UdpSocket::operator=(UdpSocket &&other)
     raw_socklen = other.raw_socklen;
     address_family = other.address_family;
     autoclose = other.autoclose;
+    nonBlocking = other.nonBlocking;
+    options = other.options;
+    ioCounters = other.ioCounters;
+    timeoutMode = other.timeoutMode;
+    recvTimeout = std::move(other.recvTimeout);
 
     // Invalidate the moved from socket
     other.sockfd = 0;
@@ -82,13 +113,23 @@ void UdpSocket::bind()
     if (sockfd > 0)
             throw std::runtime_error("Can't call bind on open socket");
 
-    sockfd = socket(address_family, SOCK_DGRAM, 0);
+    sockfd = socket(address_family, SOCK_DGRAM | (nonBlocking ? SOCK_NONBLOCK : 0), 0);
+    recvTimeout = std::make_shared<RecvTimeout>();
 
     if (sockfd <= 0)
     {
         throw std::runtime_error("Creating UDP Socket failed");
     }
 
+    // Options like SO_REUSEADDR must be set before binding
+    std::error_code ec;
+    options.apply(sockfd, ec);
+    if (ec)
+    {
+        close();
+        throw std::system_error(ec, "Setting socket option failed");
+    }
+
     if (::bind(sockfd, &local.raw_sockaddr.generic, raw_socklen) != 0)
     {
         close();
@@ -97,21 +138,39 @@ void UdpSocket::bind()
 
 }
 
-ssize_t UdpSocket::sendTo(const SockAddr &remote, const void *data, size_t len)
+ssize_t UdpSocket::sendTo(const SockAddr &remote, const void *data, size_t len, 
+    std::error_code &ec) noexcept
 {
+    // Can only send to remote addresses with the same ip type
     if (remote.address.type != local.address.type)
     {
-        throw std::runtime_error("Can only send to remote addresses with the same ip type");
+        ec = std::make_error_code(std::errc::address_family_not_supported);
+        return -1;
     }
     
     // TODO: Lookup flags
-    ssize_t bytes_sent = ::sendto(sockfd, data, len, 0, &remote.raw_sockaddr.generic, raw_socklen);
+    ssize_t bytes_sent = measureIo(IoOp::UdpSend, ioCounters, [&]() {
+        return ::sendto(sockfd, data, len, 0, &remote.raw_sockaddr.generic, raw_socklen);
+    });
 
     if (bytes_sent < 0)
     {
-        throw std::runtime_error("Error while writing to socket");
+        ec = std::error_code{errno, std::system_category()};
+        return -1;
     }
 
+    ec.clear();
+    return bytes_sent;
+}
+
+ssize_t UdpSocket::sendTo(const SockAddr &remote, const void *data, size_t len)
+{
+    std::error_code ec;
+    ssize_t bytes_sent = sendTo(remote, data, len, ec);
+
+    if (ec && !(nonBlocking && ec == std::errc::operation_would_block))
+        throw std::system_error(ec, "Error while writing to socket");
+
     return bytes_sent;
 }
 
@@ -125,22 +184,51 @@ ssize_t UdpSocket::sendTo(const std::string &remoteAddrPort, const void *data, s
     return sendTo(SockAddr(remoteAddrPort), data, len);
 }
 
-ssize_t UdpSocket::receive(void *data, size_t len, SockAddr &remote)
+ssize_t UdpSocket::receive(void *data, size_t len, SockAddr &remote, std::error_code &ec) noexcept
 {
     SockAddr::RawSockAddr remote_raw_saddr;
     std::memset(&remote_raw_saddr, 0, sizeof(SockAddr::RawSockAddr));
     socklen_t remote_raw_socklen = raw_socklen;
 
     // TODO: Lookup flags
-    ssize_t bytes_read = ::recvfrom(sockfd, data, len, 0, &remote_raw_saddr.generic, &remote_raw_socklen);
+    ssize_t bytes_read = measureIo(IoOp::UdpReceive, ioCounters, [&]() {
+        return ::recvfrom(sockfd, data, len, 0, &remote_raw_saddr.generic, &remote_raw_socklen);
+    });
+
+    // A blocking socket only reports EAGAIN if a kernel receive timeout is set
+    while (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && !nonBlocking && waitReadable(sockfd))
+    {
+        bytes_read = measureIo(IoOp::UdpReceive, ioCounters, [&]() {
+            return ::recvfrom(sockfd, data, len, 0, &remote_raw_saddr.generic, &remote_raw_socklen);
+        });
+    }
 
     if (bytes_read < 0)
     {
-        throw std::runtime_error("Error while reading from socket");
+        ec = std::error_code{errno, std::system_category()};
+        return -1;
     }
 
     remote = SockAddr(&remote_raw_saddr.generic, local.address.type);
 
+    ec.clear();
+    return bytes_read;
+}
+
+ssize_t UdpSocket::receive(void *data, size_t len, std::error_code &ec) noexcept
+{
+    SockAddr saddr;
+    return receive(data, len, saddr, ec);
+}
+
+ssize_t UdpSocket::receive(void *data, size_t len, SockAddr &remote)
+{
+    std::error_code ec;
+    ssize_t bytes_read = receive(data, len, remote, ec);
+
+    if (ec && !(nonBlocking && ec == std::errc::operation_would_block))
+        throw std::system_error(ec, "Error while reading from socket");
+
     return bytes_read;
 }
 
@@ -156,32 +244,63 @@ ssize_t UdpSocket::receiveTimeout(void *data, size_t len, SockAddr &remote, int
     std::memset(&remote_raw_saddr, 0, sizeof(SockAddr::RawSockAddr));
     socklen_t remote_raw_socklen = raw_socklen;
 
-    pollfd pfd;
-    std::memset(&pfd, 0, sizeof(pollfd));
+    auto receiveFrom = [&](int flags) {
+        return measureIo(IoOp::UdpReceive, ioCounters, [&]() {
+            return ::recvfrom(sockfd, data, len, flags, &remote_raw_saddr.generic, &remote_raw_socklen);
+        });
+    };
 
-    pfd.fd = sockfd;
-    pfd.events = POLLIN;
-    
-    // block until data is available or the timeout is reached
-    int res = poll(&pfd, 1, timeoutMs);
+    ssize_t bytes_read;
+
+    if (timeoutMode == TimeoutMode::Kernel && !nonBlocking)
+    {
+        // Moved from sockets have no cache, the receive will fail on them anyways
+        if (!recvTimeout) recvTimeout = std::make_shared<RecvTimeout>();
+        recvTimeout->set(sockfd, timeoutMs);
 
-    // a timout occured
-    if (res == 0) return 0;
+        bytes_read = receiveFrom(0);
 
-    // a poll error occured
-    if (res < 0)
+        // The kernel reports the timeout as EAGAIN
+        if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+    }
+    else
     {
-        close();
-        throw std::runtime_error("Error while reading from socket");
+        // Only poll if no packet is available yet
+        bytes_read = -1;
+        errno = EAGAIN;
+        if (timeoutMode != TimeoutMode::Poll) bytes_read = receiveFrom(MSG_DONTWAIT);
+
+        if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            pollfd pfd;
+            std::memset(&pfd, 0, sizeof(pollfd));
+
+            pfd.fd = sockfd;
+            pfd.events = POLLIN;
+            
+            // block until data is available or the timeout is reached
+            int res = poll(&pfd, 1, timeoutMs);
+
+            // a timout occured
+            if (res == 0) return 0;
+
+            // a poll error occured
+            if (res < 0)
+            {
+                close();
+                throw std::runtime_error("Error while reading from socket");
+            }
+
+            // TODO: Lookup flags
+            bytes_read = receiveFrom(0);
+
+            // The readiness was spurious, which is reported like a timeout
+            if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        }
     }
 
-    // TODO: Lookup flags
-    ssize_t bytes_read = ::recvfrom(sockfd, data, len, 0, &remote_raw_saddr.generic, &remote_raw_socklen);
-
     if (bytes_read < 0)
-    {
         throw std::runtime_error("Error while reading from socket");
-    }
 
     remote = SockAddr(&remote_raw_saddr.generic, local.address.type);
 
@@ -194,6 +313,101 @@ ssize_t UdpSocket::receiveTimeout(void *data, size_t len, int timeoutMs)
     return receiveTimeout(data, len, saddr, timeoutMs);
 }
 
+ssize_t UdpSocket::peek(void *data, size_t len, SockAddr &remote)
+{
+    SockAddr::RawSockAddr remote_raw_saddr;
+    std::memset(&remote_raw_saddr, 0, sizeof(SockAddr::RawSockAddr));
+    socklen_t remote_raw_socklen = raw_socklen;
+
+    ssize_t bytes_read = ::recvfrom(sockfd, data, len, MSG_PEEK, &remote_raw_saddr.generic, &remote_raw_socklen);
+
+    // A blocking socket only reports EAGAIN if a kernel receive timeout is set
+    while (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && !nonBlocking && waitReadable(sockfd))
+    {
+        bytes_read = ::recvfrom(sockfd, data, len, MSG_PEEK, &remote_raw_saddr.generic, &remote_raw_socklen);
+    }
+
+    if (bytes_read < 0)
+    {
+        if (nonBlocking && (errno == EAGAIN || errno == EWOULDBLOCK)) return -1;
+        throw std::system_error(errno, std::system_category(), "Error while reading from socket");
+    }
+
+    remote = SockAddr(&remote_raw_saddr.generic, local.address.type);
+    return bytes_read;
+}
+
+size_t UdpSocket::available() const
+{
+    int bytes = 0;
+    if (ioctl(sockfd, FIONREAD, &bytes) != 0)
+        throw std::system_error(errno, std::system_category(), "Querying available bytes failed");
+
+    return bytes;
+}
+
+ssize_t UdpSocket::receiveLines(void *data, size_t len, SockAddr &remote, std::vector<std::string_view> &lines)
+{
+    lines.clear();
+
+    ssize_t bytes_read = receive(data, len, remote);
+    if (bytes_read <= 0) return bytes_read;
+
+    const char *text = (const char*)data;
+    size_t consumed = LineScanner::split(text, bytes_read, lines);
+
+    // A datagram is complete, so the rest is the last line
+    if (consumed < (size_t)bytes_read)
+        lines.emplace_back(text + consumed, bytes_read - consumed);
+
+    return bytes_read;
+}
+
+void UdpSocket::setNonBlocking(bool _nonBlocking)
+{
+    if (sockfd != 0)
+    {
+        int flags = fcntl(sockfd, F_GETFL);
+        flags = _nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+        if (flags < 0 || fcntl(sockfd, F_SETFL, flags) != 0)
+            throw std::runtime_error("Changing the blocking mode failed");
+    }
+
+    nonBlocking = _nonBlocking;
+}
+
+bool UdpSocket::isNonBlocking() const
+{
+    return nonBlocking;
+}
+
+void UdpSocket::setTimeoutMode(TimeoutMode mode)
+{
+    timeoutMode = mode;
+}
+
+TimeoutMode UdpSocket::getTimeoutMode() const
+{
+    return timeoutMode;
+}
+
+void UdpSocket::setOptions(const SockOptions &_options)
+{
+    if (sockfd != 0) _options.apply(sockfd);
+
+    options = _options;
+}
+
+int UdpSocket::getSocketFd() const
+{
+    return sockfd;
+}
+
+IoCounters UdpSocket::getIoCounters() const
+{
+    return ioCounters.load();
+}
+
 void UdpSocket::close()
 {
     if (sockfd != 0)
@@ -216,6 +430,10 @@ UdpSocket UdpSocket::clone() const
     other.raw_socklen = raw_socklen;
     other.address_family = address_family;
     other.autoclose = autoclose;
+    other.nonBlocking = nonBlocking;
+    other.options = options;
+    other.timeoutMode = timeoutMode;
+    other.recvTimeout = recvTimeout;
 
     return other;
 }
\ No newline at end of file
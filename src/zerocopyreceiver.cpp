@@ -0,0 +1,144 @@
+/* Copyright 2023 Daniel M
+ *
+ * Licensed under the MIT license.
+ * This file is part of dnlmlr/netlib project.
+ */
+
+#include "zerocopyreceiver.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+
+using namespace netlib;
+
+ZerocopyReceiver::ZerocopyReceiver(TcpStream &_stream, size_t chunkSize, size_t copySize)
+    : stream{_stream}
+{
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    regionSize = std::max((chunkSize + pageSize - 1) / pageSize * pageSize, pageSize);
+
+    copyBuffer.resize(std::max<size_t>(copySize, 1));
+
+    int sockfd = stream.getSocketFd();
+
+    // TLS data has to be decrypted in user space
+    bool plain = sockfd != 0;
+#ifdef NETLIB_SSL
+    plain = plain && stream.getSSL() == nullptr;
+#endif // NETLIB_SSL
+
+    // Mapping the socket reserves the address range for the received pages
+    if (plain)
+    {
+        void *addr = mmap(nullptr, regionSize, PROT_READ, MAP_SHARED, sockfd, 0);
+        if (addr != MAP_FAILED) region = addr;
+    }
+}
+
+ZerocopyReceiver::~ZerocopyReceiver()
+{
+    if (region != nullptr) munmap(region, regionSize);
+}
+
+ssize_t ZerocopyReceiver::receiveCopy(ZerocopyView &view, size_t len)
+{
+    ssize_t bytesRead = stream.read(copyBuffer.data(), std::min(len, copyBuffer.size()));
+    if (bytesRead < 0) return bytesRead;
+
+    view.data = copyBuffer.data();
+    view.size = bytesRead;
+    view.mapped = false;
+
+    outstanding = true;
+    bytesCopied += bytesRead;
+    return bytesRead;
+}
+
+ssize_t ZerocopyReceiver::receive(ZerocopyView &view)
+{
+    if (outstanding)
+        throw std::runtime_error("The previous view must be released before receiving");
+
+    if (region == nullptr || stream.isClosed()) return receiveCopy(view, copyBuffer.size());
+
+    tcp_zerocopy_receive zc;
+    std::memset(&zc, 0, sizeof(zc));
+    zc.address = (uint64_t)region;
+    zc.length = regionSize;
+
+    // The mapped bytes are counted like a read
+    ssize_t res = measureIo(IoOp::TcpRead, stream.socket->ioCounters, [&]() -> ssize_t {
+        socklen_t zcLen = sizeof(zc);
+        if (getsockopt(stream.getSocketFd(), IPPROTO_TCP, TCP_ZEROCOPY_RECEIVE, &zc, &zcLen) != 0) return -1;
+        return zc.length;
+    });
+
+    if (res < 0)
+    {
+        // The kernel does not support zerocopy receive for this socket
+        if (errno == EINVAL || errno == EOPNOTSUPP || errno == ENOPROTOOPT)
+        {
+            munmap(region, regionSize);
+            region = nullptr;
+        }
+
+        // The ordinary read reports EOF and connection errors like 
+        // TcpStream::read does
+        return receiveCopy(view, copyBuffer.size());
+    }
+
+    if (zc.length > 0)
+    {
+        view.data = (const uint8_t*)region;
+        view.size = zc.length;
+        view.mapped = true;
+
+        outstanding = true;
+        mappedSize = zc.length;
+        bytesMapped += zc.length;
+        return zc.length;
+    }
+
+    // The data that can't be mapped is read normally. If nothing is queued, 
+    // the ordinary read waits for data or EOF.
+    return receiveCopy(view, zc.recv_skip_hint > 0 ? zc.recv_skip_hint : copyBuffer.size());
+}
+
+void ZerocopyReceiver::release(ZerocopyView &view)
+{
+    if (!outstanding) return;
+
+    // Unmap the pages, so the kernel can reuse them
+    if (view.mapped && mappedSize > 0)
+    {
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        madvise(region, (mappedSize + pageSize - 1) / pageSize * pageSize, MADV_DONTNEED);
+        mappedSize = 0;
+    }
+
+    view = ZerocopyView{};
+    outstanding = false;
+}
+
+bool ZerocopyReceiver::isZerocopyEnabled() const
+{
+    return region != nullptr;
+}
+
+uint64_t ZerocopyReceiver::getBytesMapped() const
+{
+    return bytesMapped;
+}
+
+uint64_t ZerocopyReceiver::getBytesCopied() const
+{
+    return bytesCopied;
+}
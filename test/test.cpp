@@ -7,6 +7,12 @@
 
 #include "netlib.hpp"
 
+#include <thread>
+#include <climits>
+
+#include <fcntl.h>
+#include <netinet/tcp.h>
+
 using namespace netlib;
 
 TEST_CASE("Test IpAddr::V4") {
@@ -274,3 +280,1561 @@ TEST_CASE("Test Resolver IPv6 (fails without working IPv6)") {
 
     CHECK( found2 == true );
 }
+
+
+// Start listening on a random free loopback port and connect a client to it
+static void connectLoopback(TcpListener &listener, TcpStream &client, TcpStream &server)
+{
+    listener.listen();
+
+    SockAddr::RawSockAddr raw;
+    socklen_t rawLen = sizeof(raw);
+    getsockname(listener.sockfd, &raw.generic, &rawLen);
+
+    client.setRemote(SockAddr{"127.0.0.1", ntohs(raw.v4.sin_port)});
+    client.connect();
+    server = listener.accept();
+}
+
+TEST_CASE("Test BufferedWriter") {
+
+    TcpListener listener("127.0.0.1", 0);
+    TcpStream client;
+    TcpStream server;
+    connectLoopback(listener, client, server);
+
+    std::string expected;
+    {
+        BufferedWriter writer(client, 16, true);
+
+        writer.writeString("Hello");
+        writer.writeString(", ");
+        CHECK( writer.getBuffered() == 7 );
+
+        // Does not fit into the buffer anymore, so the buffer is sent first
+        writer.writeString("World!!!!!!!");
+        CHECK( writer.getBuffered() == 12 );
+
+        // Larger than the buffer, so this is sent directly
+        writer.writeString("0123456789abcdefghij");
+        CHECK( writer.getBuffered() == 0 );
+
+        writer.writeString("end");
+        writer.flush();
+        CHECK( writer.getBuffered() == 0 );
+
+        writer.writeString("-batch");
+        expected = "Hello, World!!!!!!!0123456789abcdefghijend-batch";
+    }
+
+    client.close();
+
+    char buffer[128];
+    ssize_t nread = server.readAll(buffer, sizeof(buffer));
+
+    CHECK( std::string(buffer, nread) == expected );
+
+}
+
+TEST_CASE("Test TcpStream sendAllv / readv") {
+
+    TcpListener listener("127.0.0.1", 0);
+    TcpStream client;
+    TcpStream server;
+    connectLoopback(listener, client, server);
+
+    char header[] = "HEAD";
+    char empty[] = "";
+    char body[] = "body-data";
+
+    iovec out[3] = {
+        { header, 4 },
+        { empty, 0 },
+        { body, 9 },
+    };
+    client.sendAllv(out, 3);
+    client.close();
+
+    char in1[6];
+    char in2[32];
+    iovec in[2] = {
+        { in1, sizeof(in1) },
+        { in2, sizeof(in2) },
+    };
+
+    // On loopback all data is available with a single read
+    ssize_t total = server.readv(in, 2);
+
+    CHECK( total == 13 );
+    CHECK( std::string(in1, 6) == "HEADbo" );
+    CHECK( std::string(in2, 7) == "dy-data" );
+
+}
+
+TEST_CASE("Test TcpStream sendFile") {
+
+    TcpListener listener("127.0.0.1", 0);
+    TcpStream client;
+    TcpStream server;
+    connectLoopback(listener, client, server);
+
+    FILE *file = tmpfile();
+    std::string content = "skipped|file content";
+    fwrite(content.c_str(), 1, content.size(), file);
+    fflush(file);
+
+    client.sendFile(fileno(file), 8, content.size() - 8);
+
+    // The file is shorter than requested
+    CHECK_THROWS( client.sendFile(fileno(file), 8, content.size()) );
+
+    client.close();
+    fclose(file);
+
+    char buffer[64];
+    ssize_t nread = server.readAll(buffer, sizeof(buffer));
+
+    // The second call sent the content once more before hitting the end
+    CHECK( std::string(buffer, nread) == "file contentfile content" );
+
+}
+
+TEST_CASE("Test Relay") {
+
+    TcpListener listenerA("127.0.0.1", 0);
+    TcpStream clientA;
+    TcpStream serverA;
+    connectLoopback(listenerA, clientA, serverA);
+
+    TcpListener listenerB("127.0.0.1", 0);
+    TcpStream clientB;
+    TcpStream serverB;
+    connectLoopback(listenerB, clientB, serverB);
+
+    Relay relay(serverA, serverB);
+    std::thread relayThread([&relay]() { relay.run(); });
+
+    clientA.sendAllString("ping");
+    clientB.sendAllString("pong!");
+
+    char buffer[8];
+    CHECK( clientA.readAll(buffer, 5) == 5 );
+    CHECK( std::string(buffer, 5) == "pong!" );
+    CHECK( clientB.readAll(buffer, 4) == 4 );
+    CHECK( std::string(buffer, 4) == "ping" );
+
+    // The half-close of A is propagated to B
+    clientA.close();
+    CHECK( clientB.read(buffer, sizeof(buffer)) == 0 );
+    clientB.close();
+
+    relayThread.join();
+
+    CHECK( relay.getBytesAToB() == 4 );
+    CHECK( relay.getBytesBToA() == 5 );
+
+}
+
+TEST_CASE("Test TcpStream zerocopy send") {
+
+    TcpListener listener("127.0.0.1", 0);
+    TcpStream client;
+    TcpStream server;
+    connectLoopback(listener, client, server);
+
+    bool enabled = client.enableZerocopy(1024);
+
+    std::vector<uint8_t> small(100, 'a');
+    std::vector<uint8_t> large(1024 * 1024, 'b');
+
+    std::vector<uint8_t> received(small.size() + large.size());
+    std::thread reader([&]() {
+        server.readAll(received.data(), received.size());
+    });
+
+    // Small writes are always copied
+    CHECK( client.sendAllZerocopy(small.data(), small.size()) == 0 );
+
+    uint64_t id = client.sendAllZerocopy(large.data(), large.size());
+    CHECK( (id > 0) == enabled );
+
+    reader.join();
+
+    CHECK( client.waitZerocopy(id, 5000) == true );
+    CHECK( std::equal(small.begin(), small.end(), received.begin()) );
+    CHECK( std::equal(large.begin(), large.end(), received.begin() + small.size()) );
+
+    if (!enabled) return;
+
+    // The buffer stays pinned while the data can't leave the send queue. A small receive 
+    // window on the peer keeps it there. With the connection shut down in both directions, 
+    // poll reports a hang-up on every call, which must not turn into a busy loop.
+    TcpListener smallListener("127.0.0.1", 0);
+    TcpStream pinnedClient;
+    TcpStream pinnedServer;
+    int rcvbuf = 4096;
+    setsockopt(smallListener.sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    connectLoopback(smallListener, pinnedClient, pinnedServer);
+    pinnedClient.enableZerocopy(1024);
+
+    std::vector<uint8_t> pinned(128 * 1024, 'c');
+    id = pinnedClient.sendAllZerocopy(pinned.data(), pinned.size());
+    shutdown(pinnedServer.getSocketFd(), SHUT_WR);
+    shutdown(pinnedClient.getSocketFd(), SHUT_WR);
+    usleep(10000);
+
+    timespec cpuStart, cpuEnd;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuStart);
+    CHECK( pinnedClient.waitZerocopy(id, 300) == false );
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuEnd);
+
+    long cpuMs = (cpuEnd.tv_sec - cpuStart.tv_sec) * 1000 + (cpuEnd.tv_nsec - cpuStart.tv_nsec) / 1000000;
+    CHECK( cpuMs < 100 );
+
+    std::vector<uint8_t> drained(pinned.size());
+    CHECK( pinnedServer.readAll(drained.data(), drained.size()) == (ssize_t)drained.size() );
+    CHECK( pinnedClient.waitZerocopy(id, 5000) == true );
+
+}
+
+TEST_CASE("Test non-blocking mode") {
+
+    TcpListener listener("127.0.0.1", 0);
+    listener.setNonBlocking(true);
+    listener.listen();
+
+    // Nothing to accept yet
+    CHECK( listener.accept().isClosed() );
+
+    SockAddr::RawSockAddr raw;
+    socklen_t rawLen = sizeof(raw);
+    getsockname(listener.sockfd, &raw.generic, &rawLen);
+
+    TcpStream client("127.0.0.1", ntohs(raw.v4.sin_port));
+    client.setNonBlocking(true);
+    client.connect();
+
+    int attempts = 0;
+    while (!client.finishConnect() && attempts++ < 1000) usleep(1000);
+    CHECK( client.isClosed() == false );
+
+    TcpStream server;
+    attempts = 0;
+    while (server.isClosed() && attempts++ < 1000)
+    {
+        server = listener.accept();
+        if (server.isClosed()) usleep(1000);
+    }
+    CHECK( server.isNonBlocking() );
+
+    char buffer[16];
+    CHECK( server.read(buffer, sizeof(buffer)) == -1 );
+    CHECK( server.isClosed() == false );
+
+    client.sendAllString("data");
+    CHECK( server.readTimeout(buffer, sizeof(buffer), 1000) == 4 );
+    CHECK( std::string(buffer, 4) == "data" );
+
+
+    UdpSocket udp("127.0.0.1", 0);
+    udp.setNonBlocking(true);
+    udp.bind();
+
+    CHECK( udp.receive(buffer, sizeof(buffer)) == -1 );
+    CHECK( udp.isNonBlocking() );
+
+}
+
+TEST_CASE("Test error_code overloads") {
+
+    TcpListener listener("127.0.0.1", 0);
+    TcpStream client;
+    TcpStream server;
+    connectLoopback(listener, client, server);
+
+    std::error_code ec;
+    char buffer[16];
+
+    CHECK( client.send("abc", 3, ec) == 3 );
+    CHECK( !ec );
+
+    CHECK( server.read(buffer, sizeof(buffer), ec) == 3 );
+    CHECK( !ec );
+
+    server.setNonBlocking(true);
+    CHECK( server.read(buffer, sizeof(buffer), ec) == -1 );
+    CHECK( ec == std::errc::operation_would_block );
+    CHECK( server.isClosed() == false );
+
+    server.close();
+    CHECK( server.readAll(buffer, sizeof(buffer), ec) == -1 );
+    CHECK( ec == std::errc::not_connected );
+
+    // The throwing API keeps the error code
+    try
+    {
+        server.read(buffer, sizeof(buffer));
+        CHECK( false );
+    }
+    catch (const std::system_error &e)
+    {
+        CHECK( e.code() == std::errc::not_connected );
+    }
+
+    listener.setNonBlocking(true);
+    CHECK( listener.accept(ec).isClosed() );
+    CHECK( ec == std::errc::operation_would_block );
+
+    UdpSocket udp("127.0.0.1", 0);
+    udp.bind();
+    CHECK( udp.sendTo(SockAddr{"::1", 1234}, buffer, 1, ec) == -1 );
+    CHECK( ec == std::errc::address_family_not_supported );
+
+}
+
+TEST_CASE("Test TcpStream connect with timeout") {
+
+    TcpListener listener("127.0.0.1", 0);
+    TcpStream client;
+    TcpStream server;
+    listener.listen();
+
+    SockAddr::RawSockAddr raw;
+    socklen_t rawLen = sizeof(raw);
+    getsockname(listener.sockfd, &raw.generic, &rawLen);
+    uint16_t port = ntohs(raw.v4.sin_port);
+
+    client.setRemote(SockAddr{"127.0.0.1", port});
+    client.connect(1000);
+    CHECK( client.isClosed() == false );
+    // The stream is blocking again after the connect
+    CHECK( (fcntl(client.socket->sockfd, F_GETFL) & O_NONBLOCK) == 0 );
+
+    server = listener.accept();
+    client.sendAllString("x");
+    char c;
+    CHECK( server.read(&c, 1) == 1 );
+
+    // Nothing listens on the port anymore
+    listener.close();
+    server.close();
+    client.close();
+
+    TcpStream refused("127.0.0.1", port);
+    CHECK_THROWS( refused.connect(1000) );
+    CHECK( refused.isClosed() );
+
+    TcpStream started("127.0.0.1", port);
+    int attempts = 0;
+    try
+    {
+        bool done = started.startConnect();
+        while (!done && attempts++ < 1000)
+        {
+            done = started.finishConnect();
+            usleep(1000);
+        }
+    }
+    catch (const std::system_error &e)
+    {
+        CHECK( e.code() == std::errc::connection_refused );
+    }
+    CHECK( started.isClosed() );
+
+}
+
+TEST_CASE("Test SockOptions") {
+
+    // Read back an int socket option
+    auto getOption = [](int sockfd, int level, int name) {
+        int value = 0;
+        socklen_t len = sizeof(value);
+        getsockopt(sockfd, level, name, &value, &len);
+        return value;
+    };
+
+    TcpListener listener("127.0.0.1", 0);
+    listener.setOptions(SockOptions().setReuseAddress(true));
+    listener.setStreamOptions(SockOptions().setNoDelay(true).setKeepAlive(30, 5, 3));
+
+    TcpStream client;
+    client.setOptions(SockOptions().setReceiveBufferSize(64 * 1024).setNotSentLowat(16 * 1024));
+
+    TcpStream server;
+    connectLoopback(listener, client, server);
+
+    CHECK( getOption(listener.getSocketFd(), SOL_SOCKET, SO_REUSEADDR) == 1 );
+
+    CHECK( getOption(server.getSocketFd(), IPPROTO_TCP, TCP_NODELAY) == 1 );
+    CHECK( getOption(server.getSocketFd(), SOL_SOCKET, SO_KEEPALIVE) == 1 );
+    CHECK( getOption(server.getSocketFd(), IPPROTO_TCP, TCP_KEEPIDLE) == 30 );
+    CHECK( getOption(server.getSocketFd(), IPPROTO_TCP, TCP_KEEPCNT) == 3 );
+
+    // The kernel doubles the buffer size
+    CHECK( getOption(client.getSocketFd(), SOL_SOCKET, SO_RCVBUF) == 128 * 1024 );
+    CHECK( getOption(client.getSocketFd(), IPPROTO_TCP, TCP_NOTSENT_LOWAT) == 16 * 1024 );
+    CHECK( getOption(client.getSocketFd(), IPPROTO_TCP, TCP_NODELAY) == 0 );
+
+    client.setOptions(SockOptions().setNoDelay(true));
+    CHECK( getOption(client.getSocketFd(), IPPROTO_TCP, TCP_NODELAY) == 1 );
+
+    // TCP options can't be set on a UdpSocket
+    UdpSocket udp("127.0.0.1", 0);
+    udp.bind();
+    CHECK_THROWS( udp.setOptions(SockOptions().setNoDelay(true)) );
+    udp.setOptions(SockOptions().setSendBufferSize(32 * 1024));
+    CHECK( getOption(udp.getSocketFd(), SOL_SOCKET, SO_SNDBUF) == 64 * 1024 );
+
+    client.close();
+    CHECK( client.getSocketFd() == 0 );
+
+}
+
+TEST_CASE("Test TCP Fast Open") {
+
+    TcpListener listener("127.0.0.1", 0);
+    listener.setOptions(SockOptions().setFastOpen(16));
+
+    TcpStream client;
+    client.setOptions(SockOptions().setFastOpenConnect(true));
+
+    TcpStream server;
+    connectLoopback(listener, client, server);
+
+    int value = 0;
+    socklen_t len = sizeof(value);
+    getsockopt(listener.getSocketFd(), IPPROTO_TCP, TCP_FASTOPEN, &value, &len);
+    CHECK( value == 16 );
+
+    // Whether the data is sent with the SYN depends on the sysctl and the 
+    // cookie cache, but it must arrive either way
+    for (int i = 0; i < 2; i++)
+    {
+        // The second connection can use the cookie from the first one. With 
+        // a cookie the SYN is only sent together with the data, so accept has
+        // to wait until after the send.
+        if (i > 0) client.connect();
+
+        client.sendAllString("request");
+        client.close();
+
+        if (i > 0) server = listener.accept();
+
+        char buffer[16];
+        CHECK( server.readAll(buffer, sizeof(buffer)) == 7 );
+        CHECK( std::string(buffer, 7) == "request" );
+        server.close();
+    }
+
+}
+
+TEST_CASE("Test TcpStream clone shares the socket") {
+
+    TcpListener listener("127.0.0.1", 0);
+    TcpStream client;
+    TcpStream server;
+    connectLoopback(listener, client, server);
+
+    // Streams that are not cloned keep the wrapper inline
+    CHECK( client.socket.shared == nullptr );
+    CHECK( server.socket.shared == nullptr );
+    CHECK( &*client.socket == &client.socket.local );
+
+    // The first clone moves the wrapper into the shared block
+    TcpStream clone = client.clone();
+    REQUIRE( client.socket.shared != nullptr );
+    const TcpSocketWrapper *wrapper = &*client.socket;
+    CHECK( wrapper == &client.socket.shared.load()->socket );
+    CHECK( client.socket.shared == clone.socket.shared );
+    CHECK( client.getSocketFd() == clone.getSocketFd() );
+    CHECK( client.socket.local.isValid() == false );
+
+    {
+        // Dropping a clone without autoclose keeps the socket open
+        TcpStream clone2 = clone.clone();
+        clone2.setAutoclose(false);
+        CHECK( client.socket.shared.load()->refs == 3 );
+    }
+    CHECK( client.socket.shared.load()->refs == 2 );
+
+    // Clones can be created from multiple threads at once
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++)
+    {
+        threads.emplace_back([&client]() {
+            for (int j = 0; j < 1000; j++)
+            {
+                TcpStream other = client.clone();
+                other.setAutoclose(false);
+            }
+        });
+    }
+    for (auto &thread : threads) thread.join();
+    CHECK( client.socket.shared.load()->refs == 2 );
+    CHECK( &*client.socket == wrapper );
+
+    clone.sendAllString("via clone");
+
+    // Moving keeps the shared state
+    TcpStream moved = std::move(clone);
+    moved.close();
+    CHECK( client.isClosed() );
+
+    char buffer[16];
+    CHECK( server.readAll(buffer, sizeof(buffer)) == 9 );
+    CHECK( std::string(buffer, 9) == "via clone" );
+
+}
+
+TEST_CASE("Test TcpStream deadlines") {
+
+    TcpListener listener("127.0.0.1", 0);
+    TcpStream client;
+    TcpStream server;
+    connectLoopback(listener, client, server);
+
+    using namespace std::chrono;
+
+    char buffer[64];
+
+    // Data that is already available is returned without waiting
+    client.sendAllString("abc");
+    usleep(10000);
+    CHECK( server.readDeadline(buffer, sizeof(buffer), steady_clock::now()) == 3 );
+
+    CHECK( server.readDeadline(buffer, sizeof(buffer), steady_clock::now() + milliseconds(20)) == 0 );
+
+    // Deadlines beyond the int range of poll are not truncated
+    std::thread delayed([&client]() {
+        usleep(50000);
+        client.sendAllString("d");
+    });
+    CHECK( server.readDeadline(buffer, sizeof(buffer), steady_clock::now() + milliseconds((1LL << 32) + 10)) == 1 );
+    delayed.join();
+
+    // A full buffer is returned without waiting for the deadline
+    client.sendAllString("full");
+    auto fullStart = steady_clock::now();
+    CHECK( server.readAllDeadline(buffer, 4, fullStart + seconds(1)) == 4 );
+    CHECK( steady_clock::now() - fullStart < milliseconds(500) );
+
+    // A peer that trickles data can't extend the deadline
+    std::thread trickle([&client]() {
+        for (int i = 0; i < 10; i++)
+        {
+            client.sendAllString("x");
+            usleep(20000);
+        }
+    });
+
+    auto start = steady_clock::now();
+    ssize_t nread = server.readAllDeadline(buffer, sizeof(buffer), start + milliseconds(100));
+    auto elapsed = steady_clock::now() - start;
+    trickle.join();
+
+    CHECK( nread < 0 );
+    CHECK( nread > -10 );
+    CHECK( elapsed < milliseconds(180) );
+
+    // The peer does not read, so the socket buffers fill up
+    std::vector<uint8_t> large(64 * 1024 * 1024);
+    ssize_t nsent = client.sendAllDeadline(large.data(), large.size(), steady_clock::now() + milliseconds(100));
+    CHECK( nsent < 0 );
+    CHECK( client.isClosed() == false );
+
+}
+
+TEST_CASE("Test TcpStream readExact and readToEnd") {
+
+    TcpListener listener("127.0.0.1", 0);
+    TcpStream client;
+    TcpStream server;
+    connectLoopback(listener, client, server);
+
+    std::string msg(100000, 'a');
+    for (size_t i = 0; i < msg.size(); i++) msg[i] = 'a' + i % 26;
+
+    std::thread sender([&client, &msg]() {
+        client.sendAll("0123456789", 10);
+        client.sendAllString(msg);
+        client.close();
+    });
+
+    char head[10];
+    server.readExact(head, sizeof(head));
+    CHECK( std::string(head, sizeof(head)) == "0123456789" );
+
+    ByteBuffer buffer;
+    buffer.push_back('x');
+    CHECK( server.readToEnd(buffer, 16) == msg.size() );
+    sender.join();
+
+    REQUIRE( buffer.size() == msg.size() + 1 );
+    CHECK( std::string(buffer.begin() + 1, buffer.end()) == msg );
+
+    // The connection is closed, so there is not enough data left
+    CHECK_THROWS( server.readExact(head, sizeof(head)) );
+
+}
+
+TEST_CASE("Test FrameCodec") {
+
+    TcpListener listener("127.0.0.1", 0);
+    TcpStream client;
+    TcpStream server;
+    connectLoopback(listener, client, server);
+
+    FrameCodec sender(client, 1024);
+    // A small buffer makes sure that frames are split over multiple reads
+    FrameCodec receiver(server, 1024, 16);
+
+    std::string big(1000, 'b');
+    sender.sendFrame("hello", 5);
+    sender.sendFrame(nullptr, 0);
+    sender.sendFrame(big.c_str(), big.size());
+
+    std::string a = "first", b = "second";
+    iovec payloads[2] = { { (void*)a.c_str(), a.size() }, { (void*)b.c_str(), b.size() } };
+    sender.sendFrames(payloads, 2);
+
+    CHECK_THROWS( sender.sendFrame(big.c_str(), 1025) );
+
+    FrameView frame;
+    REQUIRE( receiver.receiveFrame(frame) );
+    CHECK( std::string((const char*)frame.data, frame.size) == "hello" );
+    REQUIRE( receiver.receiveFrame(frame) );
+    CHECK( frame.size == 0 );
+    REQUIRE( receiver.receiveFrame(frame) );
+    CHECK( std::string((const char*)frame.data, frame.size) == big );
+    REQUIRE( receiver.receiveFrame(frame) );
+    CHECK( std::string((const char*)frame.data, frame.size) == a );
+    REQUIRE( receiver.receiveFrame(frame) );
+    CHECK( std::string((const char*)frame.data, frame.size) == b );
+
+    // Batches larger than one vectored write are sent in order
+    std::vector<std::string> many;
+    std::vector<iovec> manyPayloads;
+    for (int i = 0; i < 100; i++) many.push_back(std::to_string(i));
+    for (auto &payload : many) manyPayloads.push_back({ (void*)payload.c_str(), payload.size() });
+
+    // An oversized frame anywhere in the batch is rejected before sending
+    manyPayloads.push_back({ (void*)big.c_str(), 1025 });
+    CHECK_THROWS( sender.sendFrames(manyPayloads.data(), manyPayloads.size()) );
+    manyPayloads.pop_back();
+
+    sender.sendFrames(manyPayloads.data(), manyPayloads.size());
+    for (auto &payload : many)
+    {
+        REQUIRE( receiver.receiveFrame(frame) );
+        CHECK( std::string((const char*)frame.data, frame.size) == payload );
+    }
+
+    // A length prefix above the maximum frame size is rejected
+    uint32_t header = htonl(2000);
+    client.sendAll(&header, sizeof(header));
+    CHECK_THROWS( receiver.receiveFrame(frame) );
+
+}
+
+TEST_CASE("Test FrameCodec EOF") {
+
+    TcpListener listener("127.0.0.1", 0);
+    TcpStream client;
+    TcpStream server;
+    connectLoopback(listener, client, server);
+
+    FrameCodec sender(client);
+    FrameCodec receiver(server);
+
+    sender.sendFrame("last", 4);
+    client.close();
+
+    FrameView frame;
+    REQUIRE( receiver.receiveFrame(frame) );
+    CHECK( std::string((const char*)frame.data, frame.size) == "last" );
+    CHECK( receiver.receiveFrame(frame) == false );
+    CHECK( receiver.isEof() );
+
+}
+
+TEST_CASE("Test LineScanner") {
+
+    std::vector<std::string_view> lines;
+
+    CHECK( LineScanner::split("a\nbc\r\n\nrest", 11, lines) == 7 );
+    REQUIRE( lines.size() == 3 );
+    CHECK( lines[0] == "a" );
+    CHECK( lines[1] == "bc" );
+    CHECK( lines[2] == "" );
+
+    // All implementations must find the same lines, including lines that 
+    // cross the SIMD block boundaries
+    std::string text;
+    for (int i = 0; i < 500; i++)
+    {
+        text += std::string(i % 37, 'a' + i % 26);
+        text += (i % 3 == 0) ? "\r\n" : "\n";
+    }
+    text += "incomplete";
+
+    std::vector<std::string_view> scalar;
+    size_t consumed = LineScanner::splitScalar(text.c_str(), text.size(), scalar, 0);
+    CHECK( scalar.size() == 500 );
+    CHECK( consumed == text.size() - 10 );
+
+    std::vector<std::string_view> sse2;
+    CHECK( LineScanner::splitSse2(text.c_str(), text.size(), sse2, 0) == consumed );
+    CHECK( sse2 == scalar );
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        std::vector<std::string_view> avx2;
+        CHECK( LineScanner::splitAvx2(text.c_str(), text.size(), avx2, 0) == consumed );
+        CHECK( avx2 == scalar );
+    }
+
+}
+
+TEST_CASE("Test LineReader and UdpSocket receiveLines") {
+
+    TcpListener listener("127.0.0.1", 0);
+    TcpStream client;
+    TcpStream server;
+    connectLoopback(listener, client, server);
+
+    // A small buffer makes sure that lines are split over multiple reads
+    LineReader reader(server, 64, 8);
+
+    client.sendAllString("SET key value\r\nGET key\nPING\r\n");
+    client.sendAllString("last");
+    client.close();
+
+    std::string_view line;
+    REQUIRE( reader.readLine(line) );
+    CHECK( line == "SET key value" );
+
+    // The views are only valid until the next call, so they are copied
+    std::vector<std::string> lines;
+    std::vector<std::string_view> views;
+    while (reader.readLines(views) > 0)
+    {
+        lines.insert(lines.end(), views.begin(), views.end());
+        views.clear();
+    }
+    REQUIRE( lines.size() == 3 );
+    CHECK( lines[0] == "GET key" );
+    CHECK( lines[1] == "PING" );
+    CHECK( lines[2] == "last" );
+    CHECK( reader.isEof() );
+
+
+    UdpSocket receiver("127.0.0.1", 0);
+    receiver.bind();
+
+    sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    getsockname(receiver.sockfd, (sockaddr*)&addr, &addrLen);
+
+    UdpSocket sender("127.0.0.1", 0);
+    sender.bind();
+    std::string packet = "a.count:1|c\nb.time:20|ms";
+    sender.sendTo("127.0.0.1", ntohs(addr.sin_port), packet.c_str(), packet.size());
+
+    char buffer[1500];
+    SockAddr remote;
+    std::vector<std::string_view> metrics;
+    CHECK( receiver.receiveLines(buffer, sizeof(buffer), remote, metrics) == (ssize_t)packet.size() );
+    REQUIRE( metrics.size() == 2 );
+    CHECK( metrics[0] == "a.count:1|c" );
+    CHECK( metrics[1] == "b.time:20|ms" );
+
+}
+
+TEST_CASE("Test TcpStream transportInfo and TransportSampler") {
+
+    TcpListener listener("127.0.0.1", 0);
+    TcpStream client;
+    TcpStream server;
+    connectLoopback(listener, client, server);
+
+    std::string data(100000, 'x');
+    client.sendAllString(data);
+
+    std::vector<char> buffer(data.size());
+    server.readExact(buffer.data(), buffer.size());
+
+    TransportInfo info = client.transportInfo();
+    CHECK( info.state == TCP_ESTABLISHED );
+    CHECK( info.sendCwnd > 0 );
+    CHECK( info.sendMss > 0 );
+    CHECK( info.bytesAcked > 0 );
+
+    CHECK( server.transportInfo().bytesReceived >= data.size() );
+
+    TransportSampler sampler(std::chrono::milliseconds(50), 3);
+    sampler.track(client);
+    sampler.track(server);
+    sampler.track(client);
+    CHECK( sampler.getTracked() == 2 );
+
+    CHECK( sampler.sampleIfDue() );
+    CHECK( sampler.sampleIfDue() == false );
+
+    // Closed streams are untracked
+    server.close();
+    sampler.sample();
+    CHECK( sampler.getTracked() == 1 );
+
+    // Only the newest samples are kept
+    auto samples = sampler.takeSamples();
+    REQUIRE( samples.size() == 3 );
+    CHECK( samples.back().sockfd == client.getSocketFd() );
+    // The peer closed the connection
+    CHECK( samples.back().info.state == TCP_CLOSE_WAIT );
+    CHECK( sampler.takeSamples().empty() );
+
+    CHECK_THROWS( server.transportInfo() );
+
+    // Streams can be moved and destroyed while they are tracked
+    {
+        TcpListener otherListener("127.0.0.1", 0);
+        TcpStream otherClient;
+        TcpStream otherServer;
+        connectLoopback(otherListener, otherClient, otherServer);
+        sampler.track(otherClient);
+
+        TcpStream moved = std::move(otherClient);
+        sampler.sample();
+        CHECK( sampler.getTracked() == 2 );
+    }
+    sampler.sample();
+    CHECK( sampler.getTracked() == 1 );
+
+    sampler.untrack(client);
+    CHECK( sampler.getTracked() == 0 );
+
+}
+
+TEST_CASE("Test IoStats") {
+
+    TcpListener listener("127.0.0.1", 0);
+    TcpStream client;
+    TcpStream server;
+    connectLoopback(listener, client, server);
+
+    IoStatsSnapshot before = IoStats::snapshot();
+
+    char buffer[16];
+    client.sendAll("hello", 5);
+    server.readExact(buffer, 5);
+
+    // Calls from other threads are merged into the snapshot
+    std::thread other([&server]() { server.sendAll("abc", 3); });
+    other.join();
+
+    IoStatsSnapshot after = IoStats::snapshot();
+    IoCounters counters = client.getIoCounters();
+
+    if (!IoStats::ENABLED)
+    {
+        CHECK( after[IoOp::TcpWrite].calls == 0 );
+        CHECK( counters.writeCalls == 0 );
+        return;
+    }
+
+    CHECK( after[IoOp::TcpWrite].calls - before[IoOp::TcpWrite].calls == 2 );
+    CHECK( after[IoOp::TcpWrite].bytes - before[IoOp::TcpWrite].bytes == 8 );
+    CHECK( after[IoOp::TcpRead].bytes - before[IoOp::TcpRead].bytes == 5 );
+    CHECK( after[IoOp::TcpWrite].percentileNs(0.5) > 0 );
+
+    CHECK( counters.writeCalls == 1 );
+    CHECK( counters.writeBytes == 5 );
+    CHECK( server.getIoCounters().readBytes == 5 );
+    CHECK( server.getIoCounters().writeBytes == 3 );
+
+    // sendfile and io_uring completions are counted as well
+    FILE *file = tmpfile();
+    fwrite("0123456789", 1, 10, file);
+    fflush(file);
+    client.sendFile(fileno(file), 0, 10);
+    fclose(file);
+    CHECK( client.getIoCounters().writeBytes == 15 );
+
+    EventLoop loop;
+    uint64_t readBytes = server.getIoCounters().readBytes;
+    ssize_t n = syncWait(loop, [&]() -> Task<ssize_t> {
+        co_return co_await server.asyncRead(buffer, sizeof(buffer));
+    }());
+    CHECK( n == 10 );
+    CHECK( server.getIoCounters().readBytes == readBytes + 10 );
+
+}
+
+TEST_CASE("Test available, peek and AdaptiveReader") {
+
+    TcpListener listener("127.0.0.1", 0);
+    TcpStream client;
+    TcpStream server;
+    connectLoopback(listener, client, server);
+
+    CHECK( server.available() == 0 );
+
+    client.sendAllString("peekaboo");
+    usleep(10000);
+    CHECK( server.available() == 8 );
+
+    char buffer[16];
+    CHECK( server.peek(buffer, 4) == 4 );
+    CHECK( std::string(buffer, 4) == "peek" );
+    CHECK( server.available() == 8 );
+
+    AdaptiveReader reader(server, 64, 256, 64 * 1024);
+    const uint8_t *data;
+    CHECK( reader.read(data) == 8 );
+    CHECK( std::string((const char*)data, 8) == "peekaboo" );
+
+    // The rest of a queued burst is read with a single call once a read 
+    // filled the buffer
+    std::string burst(32 * 1024, 'x');
+    client.sendAllString(burst);
+    usleep(10000);
+    CHECK( reader.read(data) == 256 );
+    CHECK( reader.read(data) == (ssize_t)burst.size() - 256 );
+    CHECK( reader.getNextSize() == 2 * (burst.size() - 256) );
+
+    // Repeated small reads shrink the prediction and eventually the buffer
+    for (int i = 0; i < 40; i++)
+    {
+        client.sendAllString("a");
+        CHECK( reader.read(data) == 1 );
+    }
+    CHECK( reader.getNextSize() == 64 );
+    CHECK( reader.buffer.capacity() < 1024 );
+
+
+    UdpSocket udpReceiver("127.0.0.1", 0);
+    udpReceiver.bind();
+
+    sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    getsockname(udpReceiver.sockfd, (sockaddr*)&addr, &addrLen);
+
+    UdpSocket udpSender("127.0.0.1", 0);
+    udpSender.bind();
+    udpSender.sendTo("127.0.0.1", ntohs(addr.sin_port), "datagram", 8);
+    usleep(10000);
+
+    CHECK( udpReceiver.available() == 8 );
+
+    SockAddr remote;
+    CHECK( udpReceiver.peek(buffer, sizeof(buffer), remote) == 8 );
+    CHECK( udpReceiver.receive(buffer, sizeof(buffer)) == 8 );
+    CHECK( std::string(buffer, 8) == "datagram" );
+    CHECK( udpReceiver.available() == 0 );
+
+}
+
+TEST_CASE("Test timeout modes") {
+
+    TcpListener listener("127.0.0.1", 0);
+    TcpStream client;
+    TcpStream server;
+    connectLoopback(listener, client, server);
+
+    char buffer[16];
+
+    for (TimeoutMode mode : { TimeoutMode::Poll, TimeoutMode::Optimistic, TimeoutMode::Kernel })
+    {
+        server.setTimeoutMode(mode);
+        CHECK( server.getTimeoutMode() == mode );
+
+        CHECK( server.readTimeout(buffer, sizeof(buffer), 20) == 0 );
+
+        client.sendAllString("abc");
+        CHECK( server.readTimeout(buffer, sizeof(buffer), 1000) == 3 );
+
+        client.sendAllString("de");
+        CHECK( server.readAllTimeout(buffer, 4, 20) == -2 );
+        CHECK( server.isClosed() == false );
+    }
+
+    // The kernel timeout is set once and kept
+    CHECK( server.socket->recvTimeout.get() == 20 );
+
+    // Reads without timeout still block until data is available
+    std::thread sender([&client]() {
+        usleep(60000);
+        client.sendAllString("late");
+    });
+    CHECK( server.read(buffer, sizeof(buffer)) == 4 );
+    sender.join();
+
+
+    UdpSocket receiver("127.0.0.1", 0);
+    receiver.setTimeoutMode(TimeoutMode::Kernel);
+    receiver.bind();
+
+    sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    getsockname(receiver.sockfd, (sockaddr*)&addr, &addrLen);
+
+    CHECK( receiver.receiveTimeout(buffer, sizeof(buffer), 20) == 0 );
+    CHECK( receiver.recvTimeout->get() == 20 );
+
+    UdpSocket udpSender("127.0.0.1", 0);
+    udpSender.bind();
+    udpSender.sendTo("127.0.0.1", ntohs(addr.sin_port), "ping", 4);
+    CHECK( receiver.receiveTimeout(buffer, sizeof(buffer), 20) == 4 );
+
+    // Clones share the socket option, so they also share the cached value
+    UdpSocket receiverClone = receiver.clone();
+    receiverClone.setAutoclose(false);
+    CHECK( receiverClone.receiveTimeout(buffer, sizeof(buffer), 30) == 0 );
+    CHECK( receiver.recvTimeout->get() == 30 );
+
+    timeval tv;
+    socklen_t tvLen = sizeof(tv);
+    getsockopt(receiver.sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, &tvLen);
+    CHECK( tv.tv_usec >= 30000 );
+
+    // Blocking peeks still wait past the kernel timeout
+    std::thread udpLate([&udpSender, &addr]() {
+        usleep(60000);
+        udpSender.sendTo("127.0.0.1", ntohs(addr.sin_port), "late", 4);
+    });
+    SockAddr peekRemote;
+    CHECK( receiver.peek(buffer, sizeof(buffer), peekRemote) == 4 );
+    CHECK( receiver.receive(buffer, sizeof(buffer)) == 4 );
+    udpLate.join();
+
+    receiver.setTimeoutMode(TimeoutMode::Optimistic);
+    CHECK( receiver.receiveTimeout(buffer, sizeof(buffer), 20) == 0 );
+
+}
+
+TEST_CASE("Test TcpStream receiveToFile") {
+
+    TcpListener listener("127.0.0.1", 0);
+    TcpStream client;
+    TcpStream server;
+    connectLoopback(listener, client, server);
+
+    std::string upload(300000, 'u');
+    for (size_t i = 0; i < upload.size(); i++) upload[i] = 'a' + i % 26;
+
+    std::thread sender([&client, &upload]() {
+        client.sendAllString(upload);
+        client.sendAllString("tail");
+        client.close();
+    });
+
+    FILE *file = tmpfile();
+    CHECK( server.receiveToFile(fileno(file), upload.size()) == upload.size() );
+
+    // The connection is closed before the requested length
+    CHECK( server.receiveToFile(fileno(file), 100) == 4 );
+    sender.join();
+
+    std::string content(upload.size() + 4, '\0');
+    CHECK( pread(fileno(file), &content[0], content.size(), 0) == (ssize_t)content.size() );
+    CHECK( content == upload + "tail" );
+    fclose(file);
+
+}
+
+TEST_CASE("Test ZerocopyReceiver") {
+
+    TcpListener listener("127.0.0.1", 0);
+    TcpStream client;
+    TcpStream server;
+    connectLoopback(listener, client, server);
+
+    std::string data(1024 * 1024, 'z');
+    for (size_t i = 0; i < data.size(); i++) data[i] = 'a' + (i / 4096) % 26;
+
+    std::thread sender([&client, &data]() {
+        client.sendAllString(data);
+        client.close();
+    });
+
+    ZerocopyReceiver receiver(server, 256 * 1024);
+
+    // Mapped and copied data must be returned in order either way
+    std::string received;
+    ZerocopyView view;
+    while (receiver.receive(view) > 0)
+    {
+        received.append((const char*)view.data, view.size);
+
+        // A view must be released before receiving again
+        CHECK_THROWS( receiver.receive(view) );
+        receiver.release(view);
+    }
+    sender.join();
+
+    CHECK( received == data );
+    CHECK( receiver.getBytesMapped() + receiver.getBytesCopied() == data.size() );
+
+}
+
+TEST_CASE("Test EventLoop") {
+
+    EventLoop loop;
+
+    TcpListener listener("127.0.0.1", 0);
+    listener.setNonBlocking(true);
+    listener.listen();
+
+    SockAddr::RawSockAddr raw;
+    socklen_t rawLen = sizeof(raw);
+    getsockname(listener.sockfd, &raw.generic, &rawLen);
+    uint16_t port = ntohs(raw.v4.sin_port);
+
+    // Echo server for all accepted connections, served by the loop thread
+    std::vector<std::unique_ptr<TcpStream>> connections;
+    loop.add(listener, EventLoop::READABLE, [&](uint32_t) {
+        while (true)
+        {
+            TcpStream stream = listener.accept();
+            if (stream.isClosed()) break;
+
+            stream.setNonBlocking(true);
+            connections.push_back(std::make_unique<TcpStream>(std::move(stream)));
+            TcpStream *conn = connections.back().get();
+
+            loop.add(*conn, EventLoop::READABLE, [&loop, conn](uint32_t) {
+                char buffer[64];
+                ssize_t n = conn->read(buffer, sizeof(buffer));
+                if (n == 0)
+                {
+                    loop.remove(conn->getSocketFd());
+                    conn->close();
+                    return;
+                }
+                if (n > 0) conn->sendAll(buffer, n);
+            });
+        }
+    });
+
+    std::atomic<int> ticks{0};
+    EventLoop::TimerId ticker = loop.addTimer(std::chrono::milliseconds(5), [&ticks]() { ticks++; }, 
+        std::chrono::milliseconds(5));
+    bool canceledRan = false;
+    EventLoop::TimerId canceled = loop.addTimer(std::chrono::milliseconds(5), [&canceledRan]() { canceledRan = true; });
+    loop.cancelTimer(canceled);
+
+    std::thread loopThread([&loop]() { loop.run(); });
+
+    std::vector<TcpStream> clients;
+    for (int i = 0; i < 20; i++)
+    {
+        clients.emplace_back(SockAddr{"127.0.0.1", port});
+        clients.back().connect();
+    }
+
+    for (int i = 0; i < 20; i++)
+    {
+        std::string msg = "msg" + std::to_string(i);
+        clients[i].sendAllString(msg);
+
+        char buffer[16];
+        CHECK( clients[i].readAllTimeout(buffer, msg.size(), 1000) == (ssize_t)msg.size() );
+        CHECK( std::string(buffer, msg.size()) == msg );
+    }
+
+    // The echo round trips can finish before the first tick
+    while (ticks == 0) usleep(1000);
+
+    // Functions posted from other threads run on the loop thread
+    std::atomic<bool> ranOnLoop{false};
+    std::thread::id loopId = loopThread.get_id();
+    loop.post([&]() { 
+        ranOnLoop = std::this_thread::get_id() == loopId;
+        loop.cancelTimer(ticker);
+    });
+
+    usleep(50000);
+    loop.post([&loop]() { loop.stop(); });
+    loopThread.join();
+
+    CHECK( ranOnLoop );
+    CHECK( ticks > 0 );
+    CHECK( canceledRan == false );
+    CHECK( loop.size() == 21 );
+
+    // Closed connections are removed by their callback
+    clients[0].close();
+    while (loop.size() == 21) loop.runOnce(1000);
+    CHECK( loop.size() == 20 );
+
+    // Timers beyond the int range of the wait are clamped instead of truncated
+    EventLoop farLoop(false);
+    farLoop.addTimer(std::chrono::milliseconds((1LL << 31) + 5), []() {});
+    CHECK( farLoop.nextTimeout(-1) == INT_MAX );
+    CHECK( farLoop.nextTimeout(50) == 50 );
+
+}
+
+static Task<size_t> asyncEchoCount(TcpListener &listener, size_t expected)
+{
+    TcpStream stream = co_await listener.asyncAccept();
+
+    std::vector<uint8_t> buffer(64 * 1024);
+    size_t total = 0;
+    while (total < expected)
+    {
+        ssize_t n = co_await stream.asyncRead(buffer.data(), buffer.size());
+        if (n <= 0) break;
+        total += n;
+    }
+
+    uint64_t reply = total;
+    co_await stream.asyncSendAll(&reply, sizeof(reply));
+    co_return total;
+}
+
+static Task<ssize_t> asyncReadSome(TcpStream &stream, void *data, size_t len)
+{
+    co_return co_await stream.asyncRead(data, len);
+}
+
+static Task<void> asyncStoreResult(Task<size_t> task, size_t &result)
+{
+    result = co_await task;
+}
+
+TEST_CASE("Test coroutines") {
+
+    bool useIoUring = false;
+    SUBCASE("epoll") { useIoUring = false; }
+    SUBCASE("io_uring") { useIoUring = true; }
+
+    EventLoop loop(useIoUring);
+    CHECK( (loop.getIoUring() != nullptr) == (useIoUring && IoUring::isSupported()) );
+
+    TcpListener listener("127.0.0.1", 0);
+    listener.setNonBlocking(true);
+    listener.listen();
+
+    SockAddr::RawSockAddr raw;
+    socklen_t rawLen = sizeof(raw);
+    getsockname(listener.sockfd, &raw.generic, &rawLen);
+    uint16_t port = ntohs(raw.v4.sin_port);
+
+    // Large enough that sending has to wait for the server to read
+    const size_t size = 8 * 1024 * 1024;
+
+    // A spawned task outlives this statement, so it can't be a capturing
+    // lambda
+    size_t serverTotal = 0;
+    spawn(loop, asyncStoreResult(asyncEchoCount(listener, size), serverTotal));
+
+    uint64_t reply = syncWait(loop, [&]() -> Task<uint64_t> {
+        TcpStream client(SockAddr{"127.0.0.1", port});
+        co_await client.asyncConnect();
+
+        std::vector<uint8_t> data(size, 0x42);
+        co_await client.asyncSendAll(data.data(), data.size());
+
+        uint64_t result = 0;
+        ssize_t n = co_await client.asyncRead(&result, sizeof(result));
+        CHECK( n == sizeof(result) );
+        co_return result;
+    }());
+
+    CHECK( reply == size );
+    CHECK( serverTotal == size );
+
+    // Connecting to a closed port throws in the coroutine
+    listener.close();
+    CHECK_THROWS( syncWait(loop, [&]() -> Task<void> {
+        TcpStream client(SockAddr{"127.0.0.1", port});
+        co_await client.asyncConnect();
+    }()) );
+
+    // The packet is sent by a timer while the receiver is suspended
+    UdpSocket receiver("127.0.0.1", 0);
+    receiver.bind();
+    rawLen = sizeof(raw);
+    getsockname(receiver.sockfd, &raw.generic, &rawLen);
+    SockAddr receiverAddr{"127.0.0.1", ntohs(raw.v4.sin_port)};
+
+    UdpSocket sender("127.0.0.1", 0);
+    sender.bind();
+    loop.addTimer(std::chrono::milliseconds(10), [&]() { sender.sendTo(receiverAddr, "ping", 4); });
+
+    std::string packet = syncWait(loop, [&]() -> Task<std::string> {
+        char buffer[16];
+        SockAddr remote;
+        ssize_t n = co_await receiver.asyncReceive(buffer, sizeof(buffer), remote);
+        co_return std::string(buffer, n);
+    }());
+
+    CHECK( packet == "ping" );
+
+    packet = syncWait(loop, [&]() -> Task<std::string> {
+        CHECK( co_await sender.asyncSendTo(receiverAddr, "pong", 4) == 4 );
+
+        char buffer[16];
+        ssize_t n = co_await receiver.asyncReceive(buffer, sizeof(buffer));
+        co_return std::string(buffer, n);
+    }());
+
+    CHECK( packet == "pong" );
+
+    // Destroying a task that waits for data cancels its operation
+    TcpListener idleListener("127.0.0.1", 0);
+    TcpStream idleClient;
+    TcpStream idleServer;
+    connectLoopback(idleListener, idleClient, idleServer);
+
+    char idleBuffer[16];
+    {
+        Task<ssize_t> idle = asyncReadSome(idleServer, idleBuffer, sizeof(idleBuffer));
+
+        EventLoop::CurrentGuard guard(loop);
+        idle.handle.resume();
+        loop.runOnce(0);
+        CHECK( idle.isDone() == false );
+    }
+
+    idleClient.sendAll("late", 4);
+    loop.runOnce(10);
+    CHECK( idleServer.read(idleBuffer, sizeof(idleBuffer)) == 4 );
+    CHECK( loop.size() == 0 );
+
+}
+
+TEST_CASE("Test IoUring") {
+
+    if (!IoUring::isSupported()) return;
+
+    IoUring ring(8);
+
+    int sv[2];
+    REQUIRE( socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0 );
+
+    // The reading end is only referenced by its index in the registered files
+    int files[2] = { sv[1], -1 };
+    ring.registerFiles(files, 2);
+
+    alignas(64) static char writeBuffer[4096];
+    alignas(64) static char readBuffer[4096];
+    std::memset(writeBuffer, 'x', sizeof(writeBuffer));
+
+    iovec buffers[2] = { { writeBuffer, sizeof(writeBuffer) }, { readBuffer, sizeof(readBuffer) } };
+    ring.registerBuffers(buffers, 2);
+
+    io_uring_sqe *sqe = ring.getSqe();
+    IoUring::prepWriteFixed(sqe, sv[0], writeBuffer, 100, 0);
+    sqe->flags |= IOSQE_IO_LINK;
+    sqe->user_data = 1;
+
+    sqe = ring.getSqe();
+    IoUring::prepReadFixed(sqe, 0, readBuffer, sizeof(readBuffer), 1);
+    sqe->flags |= IOSQE_FIXED_FILE;
+    sqe->user_data = 2;
+
+    // Both operations are submitted with one call
+    CHECK( ring.getPending() == 2 );
+    CHECK( ring.submit(2) == 2 );
+    CHECK( ring.getPending() == 0 );
+
+    int results[3] = { 0, 0, 0 };
+    io_uring_cqe cqe;
+    int completions = 0;
+    while (completions < 2)
+    {
+        if (!ring.popCompletion(cqe)) 
+        {
+            ring.submit(1, 1000);
+            continue;
+        }
+        REQUIRE( cqe.user_data <= 2 );
+        results[cqe.user_data] = cqe.res;
+        completions++;
+    }
+
+    CHECK( results[1] == 100 );
+    CHECK( results[2] == 100 );
+    CHECK( std::memcmp(readBuffer, writeBuffer, 100) == 0 );
+
+    // A slot can be replaced without registering all files again
+    files[1] = sv[0];
+    ring.updateFiles(1, &files[1], 1);
+
+    ring.unregisterBuffers();
+    ring.unregisterFiles();
+
+    close(sv[0]);
+    close(sv[1]);
+
+}
+
+static Task<std::string> asyncReceiveAll(MultishotReceiver &receiver)
+{
+    std::string result;
+    while (true)
+    {
+        ReceivedBuffer buf = co_await receiver.next();
+        if (buf.size == 0) break;
+
+        result.append((const char*)buf.data, buf.size);
+        receiver.release(buf);
+    }
+    co_return result;
+}
+
+TEST_CASE("Test multishot accept and receive") {
+
+    bool useIoUring = false;
+    SUBCASE("epoll") { useIoUring = false; }
+    SUBCASE("io_uring") { useIoUring = true; }
+
+    EventLoop loop(useIoUring);
+
+    TcpListener listener("127.0.0.1", 0);
+    listener.listen();
+
+    SockAddr::RawSockAddr raw;
+    socklen_t rawLen = sizeof(raw);
+    getsockname(listener.sockfd, &raw.generic, &rawLen);
+    uint16_t port = ntohs(raw.v4.sin_port);
+
+    MultishotAcceptor acceptor(loop, listener);
+    CHECK( acceptor.isMultishot() == (loop.getIoUring() != nullptr) );
+
+    // The connections wait in the backlog until they are accepted
+    std::vector<TcpStream> clients;
+    for (int i = 0; i < 5; i++)
+    {
+        clients.emplace_back(SockAddr{"127.0.0.1", port});
+        clients.back().connect();
+    }
+
+    std::vector<TcpStream> servers;
+    syncWait(loop, [&]() -> Task<void> {
+        for (int i = 0; i < 5; i++) servers.push_back(co_await acceptor.next());
+    }());
+
+    REQUIRE( servers.size() == 5 );
+    for (auto &server : servers) CHECK( server.isClosed() == false );
+
+    rawLen = sizeof(raw);
+    getsockname(clients[0].socket->sockfd, &raw.generic, &rawLen);
+    CHECK( servers[0].getRemoteAddr().port == ntohs(raw.v4.sin_port) );
+
+    // The data is received into the buffers of the receiver until EOF
+    MultishotReceiver tcpReceiver(loop, servers[0], 4, 1024);
+    CHECK( tcpReceiver.isMultishot() == (loop.getIoUring() != nullptr) );
+    std::string expected(10000, 'a');
+    clients[0].sendAll(expected.data(), expected.size());
+    clients[0].close();
+
+    std::string received = syncWait(loop, asyncReceiveAll(tcpReceiver));
+    CHECK( received == expected );
+    CHECK( tcpReceiver.getHeld() == 0 );
+
+    {
+        // Destroying a receiver doesn't touch the fd once it was closed and
+        // reused by another socket of the loop
+        auto closedReceiver = std::make_unique<MultishotReceiver>(loop, servers[1], 4, 1024);
+        clients[1].close();
+        CHECK( syncWait(loop, asyncReceiveAll(*closedReceiver)) == "" );
+
+        int oldFd = servers[1].getSocketFd();
+        servers[1].close();
+        UdpSocket reused("127.0.0.1", 0);
+        reused.bind();
+        int reusedFd = dup2(reused.getSocketFd(), oldFd);
+        REQUIRE( reusedFd == oldFd );
+
+        bool reusedReadable = false;
+        loop.add(reusedFd, EventLoop::READABLE, [&](uint32_t) { reusedReadable = true; });
+        closedReceiver.reset();
+
+        SockAddr::RawSockAddr reusedRaw;
+        socklen_t reusedLen = sizeof(reusedRaw);
+        getsockname(reused.getSocketFd(), &reusedRaw.generic, &reusedLen);
+        UdpSocket poke("127.0.0.1", 0);
+        poke.bind();
+        poke.sendTo(SockAddr{"127.0.0.1", ntohs(reusedRaw.v4.sin_port)}, "x", 1);
+
+        for (int i = 0; i < 10 && !reusedReadable; i++) loop.runOnce(100);
+        CHECK( reusedReadable );
+        loop.remove(reusedFd);
+        close(reusedFd);
+    }
+
+    // Every UDP packet is received into its own buffer
+    UdpSocket udp("127.0.0.1", 0);
+    udp.bind();
+    rawLen = sizeof(raw);
+    getsockname(udp.sockfd, &raw.generic, &rawLen);
+    SockAddr udpAddr{"127.0.0.1", ntohs(raw.v4.sin_port)};
+
+    UdpSocket sender("127.0.0.1", 0);
+    sender.bind();
+    rawLen = sizeof(raw);
+    getsockname(sender.sockfd, &raw.generic, &rawLen);
+    uint16_t senderPort = ntohs(raw.v4.sin_port);
+
+    MultishotReceiver udpReceiver(loop, udp, 8, 2048);
+    CHECK( udpReceiver.isMultishot() == (loop.getIoUring() != nullptr) );
+
+    for (int i = 0; i < 3; i++)
+    {
+        std::string msg = "packet" + std::to_string(i);
+        sender.sendTo(udpAddr, msg.data(), msg.size());
+    }
+
+    std::vector<std::string> packets;
+    std::vector<uint16_t> ports;
+    syncWait(loop, [&]() -> Task<void> {
+        for (int i = 0; i < 3; i++)
+        {
+            ReceivedBuffer buf = co_await udpReceiver.next();
+            packets.emplace_back((const char*)buf.data, buf.size);
+            ports.push_back(buf.remote.port);
+            udpReceiver.release(buf);
+        }
+    }());
+
+    REQUIRE( packets.size() == 3 );
+    for (int i = 0; i < 3; i++)
+    {
+        CHECK( packets[i] == "packet" + std::to_string(i) );
+        CHECK( ports[i] == senderPort );
+    }
+
+    // Packets that don't fit into a buffer are truncated
+    std::string large(3000, 'x');
+    for (size_t i = 0; i < large.size(); i++) large[i] = 'a' + i % 26;
+    sender.sendTo(udpAddr, large.data(), large.size());
+
+    std::string truncated;
+    bool wasTruncated = false;
+    syncWait(loop, [&]() -> Task<void> {
+        ReceivedBuffer buf = co_await udpReceiver.next();
+        truncated.assign((const char*)buf.data, buf.size);
+        wasTruncated = buf.truncated;
+        udpReceiver.release(buf);
+    }());
+
+    CHECK( wasTruncated );
+    CHECK( truncated.size() > 1900 );
+    CHECK( truncated.size() <= 2048 );
+    CHECK( large.compare(0, truncated.size(), truncated) == 0 );
+
+    // Empty packets are delivered with size 0 in both modes
+    sender.sendTo(udpAddr, "", 0);
+    ReceivedBuffer empty;
+    syncWait(loop, [&]() -> Task<void> {
+        empty = co_await udpReceiver.next();
+    }());
+    CHECK( empty.size == 0 );
+    CHECK( empty.truncated == false );
+    CHECK( empty.remote.port == senderPort );
+    udpReceiver.release(empty);
+
+}